@@ -5,135 +5,2581 @@
  */
 
 #include "s_index_succinct.h"
+#include "s_index_wal.h"
 #include "s_index.h"
 
+#define RETRY 8 /* optimistic attempts before a reader takes the lock */
+#define BATCH 16 /* lookups per s__index_find_batch() read section */
+#define COMPACT 8 /* compact once 1/COMPACT of compressed keys are removed */
+#define SORT 65536 /* minimum keys per s__index_load() sort partition */
+#define SORTERS 64 /* maximum s__index_load() sort partitions */
+#define INTERVAL 1000 /* microseconds a group commit of the log gathers */
+#define CHAR2INT(c) ( (int)((unsigned char)(c)) )
+
+/**
+ * Concurrency: a single writer runs s__index_update() under the lock, and
+ * brackets the update with increments of version, leaving it odd for the
+ * duration. Readers of the tree run optimistically: they sample an even
+ * version, perform the lookup, and retry if the version has moved. Tree
+ * node space is never freed before truncation, only reused by new nodes,
+ * never by prefix strings or leaves, and every descent is bounded by the
+ * height of the tree, so a stale traversal ends and is safe to discard. A
+ * reader that keeps losing to the writer takes the lock.
+ */
+
+/**
+ * Delta: once s__index_delta() runs, new keys go to the tree, which serves
+ * as a small mutable delta in front of the compressed index. A merge
+ * freezes the tree, replacing it with an empty one, and streams the union
+ * of the frozen tree and the compressed index into a fresh compressed
+ * index, left ready. Readers look in the tree, then the frozen tree, then
+ * the compressed index, so a key in an earlier layer shadows the same key
+ * in a later one.
+ *
+ * Only the writer freezes the tree, at the start of a call, once done with
+ * the record it last obtained, and then hands the frozen tree to the
+ * background thread. From then on, the writer stores only to records of
+ * the new tree, copying a frozen or compressed record before changing it,
+ * so the merge streams records that no longer move. The writer installs
+ * a ready index at a later call. Readers register in one of two epoch
+ * counters, and the writer frees the replaced layers only after the
+ * readers of the previous epoch have left.
+ */
+
+/**
+ * Durability: with a log, s__index_put() and s__index_remove() append each
+ * mutation to it after applying it, and the log's thread makes the appended
+ * mutations durable together, once per interval. A snapshot writes every
+ * key and record to a new file, renamed over the last snapshot once
+ * durable, and then empties the log once the directory holding the rename
+ * is durable too. Recovery replays the snapshot, then the log. A crash
+ * between the rename and the emptying replays a log whose mutations the
+ * snapshot already holds; replayed in order, they leave the same index.
+ * Truncation runs the other way: the snapshot is unlinked, and the unlink
+ * made durable, before the log is emptied.
+ */
+
+enum op { FIND, NEXT, PREV };
+
+enum kind { AVL, ART, CODED, FIXED };
+
+enum layer { TREE, FROZEN, SUCCINCT, LAYERS }; /* of a delta cursor */
+
+struct delta {
+	s__index_tree_t volatile frozen; /* tree being merged, or NULL */
+	s__index_succinct_t ready; /* merged, awaiting the writer, or NULL */
+	uint64_t shadows; /* keys of tree also in frozen or succinct */
+	uint64_t shadows_; /* keys of frozen also in succinct */
+	uint64_t threshold;
+	/*-*/
+	int stop;
+	int pending;
+	s__thread_t thread;
+	s__mutex_t merging; /* serializes merges */
+	s__mutex_t mutex;
+	s__cond_t cond;
+	/*-*/
+	volatile uint64_t epoch;
+	volatile uint64_t readers[2];
+};
+
+struct merge {
+	s__index_succinct_cursor_t succinct;
+	s__index_tree_cursor_t frozen;
+	uint64_t *record1;
+	uint64_t *record2;
+	uint64_t record_size;
+	int d;
+};
+
+struct entry {
+	const char *key;
+	uint64_t i; /* position in the input, breaking ties */
+};
+
+struct sort {
+	struct entry *entries;
+	const uint64_t *records;
+	uint64_t record_size;
+	uint64_t n;
+	uint64_t i;
+};
+
 struct s__index {
+	enum kind kind; /* of the mutable trees */
+	int collapse; /* compressed indexes collapse their chains */
+	uint64_t filter; /* bits per key of the negative lookup filter, or 0 */
+	int pack; /* compressed indexes bit pack their records */
+	uint64_t record_size; /* bytes per record, a multiple of eight */
 	s__index_tree_t tree;
 	s__index_succinct_t succinct;
+	/*-*/
+	void *map;
+	uint64_t map_size;
+	/*-*/
+	volatile uint64_t version;
+	volatile s__spinlock_t lock;
+	/*-*/
+	struct delta *delta;
+	/*-*/
+	s__index_wal_t wal; /* durability log, or NULL */
+	char *snap; /* pathname of the snapshot */
+	char *snap_; /* pathname of the snapshot being written */
+	uint64_t snapshot; /* log bytes triggering a snapshot, or 0 */
+};
+
+struct s__index_cursor {
+	char *hi;
+	uint64_t *record;
+	struct s__index *index; /* set for a delta cursor */
+	s__index_tree_cursor_t tree;
+	s__index_succinct_cursor_t succinct;
+	/*-*/
+	s__index_tree_cursor_t frozen;
+	s__index_tree_t trees[2]; /* tree and frozen, as the cursors opened */
+	s__index_succinct_t base; /* succinct, as its cursor opened */
+	uint64_t epoch; /* of the delta, as the cursors opened */
+	uint64_t *heads[LAYERS];
+	enum layer layer; /* holding the position */
+	int d; /* 1 after a forward step, -1 after a backward one */
+	char *key; /* scratch */
 };
 
-s__index_t
-s__index_open(void)
+static const char *
+layer_key(const struct s__index_cursor *cursor, enum layer layer)
+{
+	if (SUCCINCT == layer) {
+		return s__index_succinct_cursor_key(cursor->succinct);
+	}
+	return s__index_tree_cursor_key((TREE == layer) ?
+					cursor->tree :
+					cursor->frozen);
+}
+
+static const char *
+cursor_key(const struct s__index_cursor *cursor)
+{
+	if (cursor->index) {
+		return layer_key(cursor, cursor->layer);
+	}
+	if (cursor->succinct) {
+		return s__index_succinct_cursor_key(cursor->succinct);
+	}
+	return s__index_tree_cursor_key(cursor->tree);
+}
+
+static uint64_t *
+cursor_bound(struct s__index_cursor *cursor, uint64_t *record)
+{
+	const char *key;
+
+	if (record && cursor->hi) {
+		key = cursor_key(cursor);
+		if (0 < strcmp(key, cursor->hi)) {
+			record = NULL;
+		}
+	}
+	cursor->record = record;
+	return record;
+}
+
+static int
+layout(const struct s__index *index, s__index_succinct_t succinct)
+{
+	if ((index->collapse && s__index_succinct_collapse(succinct)) ||
+	    (index->filter && s__index_succinct_filter(succinct,
+						       index->filter)) ||
+	    (index->pack && s__index_succinct_pack(succinct))) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+static s__index_tree_t
+tree_open(const struct s__index *index)
+{
+	switch (index->kind) {
+	case ART:
+		return s__index_tree_open_art(index->record_size);
+	case CODED:
+		return s__index_tree_open_coded(index->record_size);
+	case FIXED:
+		return s__index_tree_open_u64(index->record_size);
+	default:
+		return s__index_tree_open(index->record_size);
+	}
+}
+
+static uint64_t
+read_begin(struct s__index *index)
+{
+	uint64_t version;
+
+	while (1 & (version = index->version)) {
+		s__spinlock_lock(&index->lock); /* wait out the writer */
+		s__spinlock_unlock(&index->lock);
+	}
+	s__fence_acquire();
+	return version;
+}
+
+static int
+read_retry(const struct s__index *index, uint64_t version)
+{
+	s__fence_acquire();
+	return version != index->version;
+}
+
+static uint64_t *
+read_(struct s__index *index,
+      enum op op,
+      const char *key,
+      char *okey,
+      void *copy)
+{
+	uint64_t *record, version;
+	int i;
+
+	for (i=0; i<=RETRY; ++i) {
+		if (RETRY == i) {
+			s__spinlock_lock(&index->lock);
+		}
+		version = read_begin(index);
+		if (FIND == op) {
+			record = s__index_tree_find(index->tree, key);
+		}
+		else if (NEXT == op) {
+			record = s__index_tree_next(index->tree, key, okey);
+		}
+		else {
+			record = s__index_tree_prev(index->tree, key, okey);
+		}
+		if (record && copy) { /* validated with the lookup */
+			memcpy(copy, record, (size_t)index->record_size);
+		}
+		if (RETRY == i) {
+			s__spinlock_unlock(&index->lock);
+			break;
+		}
+		if (!read_retry(index, version)) {
+			break;
+		}
+	}
+	return record;
+}
+
+static void
+read_batch(struct s__index *index,
+	   const char **keys,
+	   uint64_t n,
+	   uint64_t **records)
+{
+	uint64_t version;
+	int i;
+
+	for (i=0; i<=RETRY; ++i) {
+		if (RETRY == i) {
+			s__spinlock_lock(&index->lock);
+		}
+		version = read_begin(index);
+		s__index_tree_find_batch(index->tree, keys, n, records);
+		if (RETRY == i) {
+			s__spinlock_unlock(&index->lock);
+			break;
+		}
+		if (!read_retry(index, version)) {
+			break;
+		}
+	}
+}
+
+static uint64_t
+enter(struct delta *delta)
+{
+	uint64_t epoch;
+
+	while (1) {
+		epoch = delta->epoch;
+		__sync_fetch_and_add(&delta->readers[epoch & 1], 1);
+		if (epoch == delta->epoch) {
+			return epoch;
+		}
+		__sync_fetch_and_sub(&delta->readers[epoch & 1], 1);
+	}
+}
+
+static void
+leave(struct delta *delta, uint64_t epoch)
+{
+	__sync_fetch_and_sub(&delta->readers[epoch & 1], 1);
+}
+
+static void
+synchronize(struct delta *delta)
+{
+	uint64_t epoch;
+
+	epoch = __sync_fetch_and_add(&delta->epoch, 1);
+	while (__sync_fetch_and_add(&delta->readers[epoch & 1], 0)) {
+		s__usleep(10);
+	}
+}
+
+static uint64_t *
+delta_find(struct s__index *index, const char *key, void *copy)
+{
+	s__index_tree_t frozen;
+	uint64_t *record, epoch;
+
+	epoch = enter(index->delta);
+	if (!(record = read_(index, FIND, key, NULL, copy))) {
+		s__fence_acquire();
+		frozen = index->delta->frozen;
+		s__fence_acquire();
+		if (!frozen || !(record = s__index_tree_find(frozen, key))) {
+			record = s__index_succinct_find(index->succinct, key);
+		}
+		if (record && copy) { /* before a replaced layer is freed */
+			memcpy(copy, record, (size_t)index->record_size);
+		}
+	}
+	leave(index->delta, epoch);
+	return record;
+}
+
+static uint64_t *
+delta_step(struct s__index *index, enum op op, const char *key, char *okey)
+{
+	char buf[S__INDEX_MAX_KEY_LEN], probe[S__INDEX_MAX_KEY_LEN];
+	uint64_t *record, *best, epoch;
+	s__index_tree_t frozen;
+	int i, d;
+
+	if (key) {
+		memcpy(probe, key, s__strlen(key) + 1); /* key may alias okey */
+		key = probe;
+	}
+	epoch = enter(index->delta);
+	best = read_(index, op, key, okey, NULL);
+	s__fence_acquire();
+	frozen = index->delta->frozen;
+	s__fence_acquire();
+	for (i=0; i<2; ++i) {
+		if (!i && !frozen) {
+			continue;
+		}
+		if (NEXT == op) {
+			record = i ?
+				s__index_succinct_next(index->succinct,
+						       key,
+						       buf) :
+				s__index_tree_next(frozen, key, buf);
+		}
+		else {
+			record = i ?
+				s__index_succinct_prev(index->succinct,
+						       key,
+						       buf) :
+				s__index_tree_prev(frozen, key, buf);
+		}
+		d = (NEXT == op) ? -1 : 1;
+		if (record && (!best || (0 < (d * strcmp(buf, okey))))) {
+			memcpy(okey, buf, s__strlen(buf) + 1);
+			best = record;
+		}
+	}
+	leave(index->delta, epoch);
+	return best;
+}
+
+static uint64_t *
+delta_update(struct s__index *index, const char *key)
+{
+	struct delta *delta;
+	uint64_t *record, *base;
+
+	delta = index->delta;
+	if (!(record = s__index_tree_find(index->tree, key))) {
+		base = NULL;
+		if (delta->frozen) {
+			base = s__index_tree_find(delta->frozen, key);
+		}
+		if (!base) {
+			base = s__index_succinct_find(index->succinct, key);
+		}
+		if (base && !delta->frozen) {
+			record = base;
+		}
+		else {
+			++index->version;
+			s__fence_release();
+			record = s__index_tree_update(index->tree, key);
+			if (record && base) {
+				memcpy(record, /* shadow a merging key */
+				       base,
+				       (size_t)index->record_size);
+				++delta->shadows;
+			}
+			s__fence_release();
+			++index->version;
+		}
+	}
+	return record;
+}
+
+static int
+_merge_(void *ctx, int rewind, const char **key, uint64_t *record)
+{
+	const char *key1, *key2;
+	struct merge *merge;
+
+	merge = (struct merge *)ctx;
+	if (rewind) {
+		merge->record1 = s__index_succinct_cursor_seek(merge->succinct,
+							       NULL);
+		merge->record2 = s__index_tree_cursor_seek(merge->frozen, NULL);
+	}
+	else {
+		if (0 >= merge->d) {
+			merge->record1 =
+				s__index_succinct_cursor_next(merge->succinct);
+		}
+		if (0 <= merge->d) {
+			merge->record2 =
+				s__index_tree_cursor_next(merge->frozen);
+		}
+	}
+	if (!merge->record1 && !merge->record2) {
+		return 0;
+	}
+	key1 = key2 = NULL;
+	if (merge->record1) {
+		key1 = s__index_succinct_cursor_key(merge->succinct);
+	}
+	if (merge->record2) {
+		key2 = s__index_tree_cursor_key(merge->frozen);
+	}
+	if (!key2) {
+		merge->d = -1;
+	}
+	else if (!key1) {
+		merge->d = 1;
+	}
+	else {
+		merge->d = strcmp(key1, key2);
+	}
+	(*key) = (0 > merge->d) ? key1 : key2;
+	memcpy(record,
+	       (0 > merge->d) ? merge->record1 : merge->record2,
+	       (size_t)merge->record_size);
+	return 1;
+}
+
+static int
+freeze(struct s__index *index)
+{
+	struct delta *delta;
+	s__index_tree_t tree;
+
+	delta = index->delta;
+	if (delta->frozen ||
+	    (!s__index_tree_items(index->tree) &&
+	     !s__index_succinct_removed(index->succinct))) {
+		return 0;
+	}
+	if (!(tree = tree_open(index))) {
+		S__TRACE(0);
+		return -1;
+	}
+	s__spinlock_lock(&index->lock);
+	++index->version;
+	s__fence_release();
+	delta->frozen = index->tree;
+	delta->shadows_ = delta->shadows;
+	delta->shadows = 0;
+	s__fence_release();
+	index->tree = tree;
+	s__fence_release();
+	++index->version;
+	s__spinlock_unlock(&index->lock);
+	return 0;
+}
+
+static int
+merge_(struct s__index *index)
+{
+	s__index_succinct_t succinct;
+	struct delta *delta;
+	struct merge merge;
+
+	delta = index->delta;
+	if (delta->ready || !delta->frozen) {
+		return 0;
+	}
+	memset(&merge, 0, sizeof (struct merge));
+	merge.record_size = index->record_size;
+	succinct = NULL;
+	merge.succinct = s__index_succinct_cursor_open(index->succinct);
+	if (!merge.succinct ||
+	    !(merge.frozen = s__index_tree_cursor_open(delta->frozen)) ||
+	    !(succinct = s__index_succinct_stream(_merge_,
+						  &merge,
+						  index->record_size))) {
+		s__index_succinct_cursor_close(merge.succinct);
+		s__index_tree_cursor_close(merge.frozen);
+		S__TRACE(0);
+		return -1;
+	}
+	s__index_succinct_cursor_close(merge.succinct);
+	s__index_tree_cursor_close(merge.frozen);
+	if (layout(index, succinct)) {
+		s__index_succinct_close(succinct);
+		S__TRACE(0);
+		return -1;
+	}
+	s__spinlock_lock(&index->lock);
+	delta->ready = succinct;
+	s__spinlock_unlock(&index->lock);
+	return 0;
+}
+
+static void
+install(struct s__index *index)
+{
+	s__index_succinct_t succinct, base;
+	struct delta *delta;
+	s__index_tree_t tree;
+	uint64_t map_size;
+	void *map;
+
+	delta = index->delta;
+	s__spinlock_lock(&index->lock);
+	if (!(succinct = delta->ready)) {
+		s__spinlock_unlock(&index->lock);
+		return;
+	}
+	tree = delta->frozen;
+	map = index->map;
+	map_size = index->map_size;
+	base = index->succinct;
+	index->succinct = succinct;
+	s__fence_release();
+	delta->frozen = NULL;
+	delta->ready = NULL;
+	delta->shadows_ = 0;
+	index->map = NULL;
+	index->map_size = 0;
+	s__spinlock_unlock(&index->lock);
+	synchronize(delta);
+	s__index_succinct_close(base);
+	s__index_tree_close(tree);
+	s__file_unmap(map, map_size);
+}
+
+static void
+_merger_(void *ctx)
+{
+	struct s__index *index;
+	struct delta *delta;
+
+	index = (struct s__index *)ctx;
+	delta = index->delta;
+	s__mutex_lock(delta->mutex);
+	while (!delta->stop) {
+		if (!delta->pending) {
+			s__cond_wait(delta->cond);
+			continue;
+		}
+		delta->pending = 0;
+		s__mutex_unlock(delta->mutex);
+		s__mutex_lock(delta->merging);
+		if (merge_(index)) {
+			S__TRACE(0); /* retried on the next signal */
+		}
+		s__mutex_unlock(delta->merging);
+		s__mutex_lock(delta->mutex);
+	}
+	s__mutex_unlock(delta->mutex);
+}
+
+static void
+delta_signal(struct delta *delta, int stop)
+{
+	s__mutex_lock(delta->mutex);
+	delta->pending = 1;
+	delta->stop |= stop;
+	s__cond_signal(delta->cond);
+	s__mutex_unlock(delta->mutex);
+}
+
+static void
+delta_close(struct s__index *index)
+{
+	struct delta *delta;
+
+	if ((delta = index->delta)) {
+		if (delta->thread) {
+			delta_signal(delta, 1);
+			s__thread_close(delta->thread);
+		}
+		s__index_tree_close(delta->frozen);
+		s__index_succinct_close(delta->ready);
+		s__cond_close(delta->cond);
+		s__mutex_close(delta->mutex);
+		s__mutex_close(delta->merging);
+		memset(delta, 0, sizeof (struct delta));
+	}
+	S__FREE(delta);
+	index->delta = NULL;
+}
+
+static int
+crowded(struct s__index *index)
+{
+	uint64_t removed;
+
+	removed = s__index_succinct_removed(index->succinct);
+	return removed &&
+		((s__index_succinct_items(index->succinct) + removed) <
+		 (COMPACT * removed));
+}
+
+static int
+compact(struct s__index *index)
+{
+	s__index_succinct_t succinct;
+
+	if (!(succinct = s__index_succinct_compact(index->succinct))) {
+		S__TRACE(0);
+		return -1;
+	}
+	if (layout(index, succinct)) {
+		s__index_succinct_close(succinct);
+		S__TRACE(0);
+		return -1;
+	}
+	s__index_succinct_close(index->succinct);
+	s__file_unmap(index->map, index->map_size);
+	index->succinct = succinct;
+	index->map = NULL;
+	index->map_size = 0;
+	return 0;
+}
+
+static int
+schedule(struct s__index *index)
+{
+	struct delta *delta;
+
+	delta = index->delta;
+	if (!delta->pending &&
+	    ((delta->threshold <= s__index_tree_items(index->tree)) ||
+	     crowded(index))) {
+		if (freeze(index)) {
+			S__TRACE(0);
+			return -1;
+		}
+		delta_signal(delta, 0);
+	}
+	return 0;
+}
+
+static int
+delta_remove(struct s__index *index, const char *key)
+{
+	struct delta *delta;
+	int e1, e2;
+
+	delta = index->delta;
+	s__mutex_lock(delta->merging);
+	install(index);
+	if (delta->frozen) { /* not yet merged */
+		if (merge_(index)) {
+			s__mutex_unlock(delta->merging);
+			S__TRACE(0);
+			return -1;
+		}
+		install(index);
+	}
+	s__spinlock_lock(&index->lock);
+	++index->version;
+	s__fence_release();
+	e2 = s__index_succinct_remove(index->succinct, key); /* tree hides it */
+	e1 = (0 > e2) ? -1 : s__index_tree_remove(index->tree, key);
+	s__fence_release();
+	++index->version;
+	if ((0 < e1) && (0 < e2)) {
+		--delta->shadows;
+	}
+	s__spinlock_unlock(&index->lock);
+	s__mutex_unlock(delta->merging);
+	if ((0 > e1) || (0 > e2) || schedule(index)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return ((0 < e1) || (0 < e2)) ? 1 : 0;
+}
+
+/**
+ * Load: s__index_load() sorts (key, position) entries in partitions, one
+ * thread each, then merges the partitions into a single sorted array
+ * through a heap of partition heads, keeping the last occurrence of a
+ * repeated key. A partition whose thread cannot start is sorted by the
+ * calling thread. The array is streamed into the tree by
+ * s__index_tree_bulk_stream().
+ */
+
+static int
+compare(const void *a_, const void *b_)
+{
+	const struct entry *a, *b;
+	int d;
+
+	a = (const struct entry *)a_;
+	b = (const struct entry *)b_;
+	if ((d = strcmp(a->key, b->key))) {
+		return d;
+	}
+	return (a->i < b->i) ? -1 : (a->i > b->i);
+}
+
+static void
+_sort_(void *ctx)
+{
+	struct sort *sort;
+
+	sort = (struct sort *)ctx;
+	qsort(sort->entries,
+	      (size_t)sort->n,
+	      sizeof (sort->entries[0]),
+	      compare);
+}
+
+static int
+_sorted_(void *ctx, int rewind, const char **key, uint64_t *record)
+{
+	struct entry *entry;
+	struct sort *sort;
+
+	sort = (struct sort *)ctx;
+	if (rewind) {
+		sort->i = 0;
+	}
+	if (sort->i >= sort->n) {
+		return 0;
+	}
+	entry = &sort->entries[sort->i++];
+	(*key) = entry->key;
+	if (sort->records) {
+		memcpy(record,
+		       (const char *)sort->records +
+		       entry->i * sort->record_size,
+		       (size_t)sort->record_size);
+	}
+	else {
+		memset(record, 0, (size_t)sort->record_size);
+	}
+	return 1;
+}
+
+static const struct entry *
+head(const struct sort *sorts, int j)
+{
+	return &sorts[j].entries[sorts[j].i];
+}
+
+static void
+sift(const struct sort *sorts, int *heap, int k, int i)
+{
+	int c, t;
+
+	while ((c = 2 * i + 1) < k) {
+		if (((c + 1) < k) &&
+		    (0 > compare(head(sorts, heap[c + 1]),
+				 head(sorts, heap[c])))) {
+			++c;
+		}
+		if (0 < compare(head(sorts, heap[c]), head(sorts, heap[i]))) {
+			break;
+		}
+		t = heap[c];
+		heap[c] = heap[i];
+		heap[i] = t;
+		i = c;
+	}
+}
+
+static uint64_t
+merge_sorts(struct sort *sorts, int k, struct entry *entries)
+{
+	int heap[SORTERS], i, m;
+	struct sort *sort;
+	uint64_t n;
+
+	for (i=0, m=0; i<k; ++i) {
+		if (sorts[i].n) {
+			heap[m++] = i;
+		}
+	}
+	for (i=(m / 2) - 1; 0 <= i; --i) {
+		sift(sorts, heap, m, i);
+	}
+	n = 0;
+	while (m) {
+		sort = &sorts[heap[0]];
+		if (!n ||
+		    strcmp(entries[n - 1].key, sort->entries[sort->i].key)) {
+			++n;
+		}
+		entries[n - 1] = sort->entries[sort->i++];
+		if (sort->i == sort->n) {
+			heap[0] = heap[--m];
+		}
+		sift(sorts, heap, m, 0);
+	}
+	return n;
+}
+
+static int
+sort(const char **keys, uint64_t n, struct entry *entries, uint64_t *m)
+{
+	s__thread_t threads[SORTERS];
+	struct sort sorts[SORTERS];
+	struct entry *partitions;
+	uint64_t i, size;
+	int k, j;
+
+	if (!(partitions = s__malloc(S__MAX(n, 1) * sizeof (partitions[0])))) {
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0; i<n; ++i) {
+		partitions[i].key = keys[i];
+		partitions[i].i = i;
+	}
+	k = (int)S__MIN(S__MIN(s__cores(), SORTERS), S__MAX(n / SORT, 1));
+	size = S__DUP(n, k);
+	memset(threads, 0, sizeof (threads));
+	memset(sorts, 0, sizeof (sorts));
+	for (j=0; j<k; ++j) {
+		sorts[j].entries = partitions + S__MIN(j * size, n);
+		sorts[j].n = S__MIN((j + 1) * size, n) - S__MIN(j * size, n);
+	}
+	for (j=1; j<k; ++j) {
+		if (!(threads[j] = s__thread_open(_sort_, &sorts[j]))) {
+			_sort_(&sorts[j]);
+		}
+	}
+	_sort_(&sorts[0]);
+	for (j=1; j<k; ++j) {
+		s__thread_close(threads[j]);
+	}
+	(*m) = merge_sorts(sorts, k, entries);
+	S__FREE(partitions);
+	return 0;
+}
+
+static void
+unlog(struct s__index *index)
+{
+	s__index_wal_close(index->wal);
+	S__FREE(index->snap);
+	S__FREE(index->snap_);
+	index->wal = NULL;
+	index->snapshot = 0;
+}
+
+static int
+logged(struct s__index *index,
+       int op,
+       const char *key,
+       const uint64_t *record)
+{
+	if (s__index_wal_append(index->wal, op, key, record) ||
+	    (index->snapshot &&
+	     (index->snapshot <= s__index_wal_bytes(index->wal)) &&
+	     s__index_snapshot(index))) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+static char *
+extend(const char *pathname, const char *extension)
+{
+	uint64_t n;
+	char *s;
+
+	n = s__strlen(pathname) + s__strlen(extension) + 1;
+	if (!(s = s__malloc(n))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	s__sprintf(s, n, "%s%s", pathname, extension);
+	return s;
+}
+
+static int
+_replay_(void *ctx, int op, const char *key, const uint64_t *record)
+{
+	struct s__index *index;
+
+	index = (struct s__index *)ctx;
+	if (S__INDEX_WAL_PUT == op) {
+		if (s__index_put(index, key, record)) {
+			S__TRACE(0);
+			return -1;
+		}
+	}
+	else if (0 > s__index_remove(index, key)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+s__index_t
+s__index_open(void)
+{
+	struct s__index *index;
+
+	assert( S__INDEX_MAX_KEY_LEN == S__INDEX_TREE_MAX_KEY_LEN );
+
+	if (!(index = s__malloc(sizeof (struct s__index)))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memset(index, 0, sizeof (struct s__index));
+	index->record_size = sizeof (uint64_t);
+	if (!(index->tree = tree_open(index))) {
+		s__index_close(index);
+		S__TRACE(0);
+		return NULL;
+	}
+	return index;
+}
+
+static s__index_t
+open_kind(enum kind kind)
+{
+	struct s__index *index;
+
+	if (!(index = s__index_open())) {
+		S__TRACE(0);
+		return NULL;
+	}
+	s__index_tree_close(index->tree);
+	index->kind = kind;
+	if (!(index->tree = tree_open(index))) {
+		s__index_close(index);
+		S__TRACE(0);
+		return NULL;
+	}
+	return index;
+}
+
+s__index_t
+s__index_open_art(void)
+{
+	return open_kind(ART);
+}
+
+s__index_t
+s__index_open_coded(void)
+{
+	return open_kind(CODED);
+}
+
+s__index_t
+s__index_open_u64(void)
+{
+	return open_kind(FIXED);
+}
+
+void
+s__index_close(s__index_t index)
+{
+	if (index) {
+		unlog(index);
+		delta_close(index);
+		s__index_tree_close(index->tree);
+		s__index_succinct_close(index->succinct);
+		s__file_unmap(index->map, index->map_size);
+		memset(index, 0, sizeof (struct s__index));
+	}
+	S__FREE(index);
+}
+
+void
+s__index_truncate(s__index_t index)
+{
+	assert( index );
+
+	delta_close(index);
+	s__index_tree_truncate(index->tree);
+	s__index_succinct_close(index->succinct);
+	s__file_unmap(index->map, index->map_size);
+	index->succinct = NULL;
+	index->map = NULL;
+	index->map_size = 0;
+	if (index->wal) {
+		s__unlink(index->snap);
+		if (s__file_sync_dir(index->snap) ||
+		    s__index_wal_reset(index->wal)) {
+			S__TRACE(0);
+		}
+	}
+}
+
+int
+s__index_compress(s__index_t index)
+{
+	s__index_succinct_t succinct;
+
+	assert( index );
+	assert( !index->succinct );
+
+	if (!(succinct = s__index_succinct_build(index->tree,
+						 (int)s__cores()))) {
+		S__TRACE(0);
+		return -1;
+	}
+	if (layout(index, succinct)) {
+		s__index_succinct_close(succinct);
+		S__TRACE(0);
+		return -1;
+	}
+	index->succinct = succinct;
+	s__index_tree_truncate(index->tree);
+	return 0;
+}
+
+int
+s__index_compress_sorted(s__index_t index, s__index_fnc_t fnc, void *ctx)
+{
+	s__index_succinct_t succinct;
+
+	assert( index );
+	assert( !index->succinct );
+	assert( !s__index_tree_items(index->tree) );
+	assert( fnc );
+
+	if (!(succinct = s__index_succinct_stream(fnc,
+						  ctx,
+						  index->record_size))) {
+		S__TRACE(0);
+		return -1;
+	}
+	if (layout(index, succinct)) {
+		s__index_succinct_close(succinct);
+		S__TRACE(0);
+		return -1;
+	}
+	index->succinct = succinct;
+	return 0;
+}
+
+int
+s__index_load(s__index_t index,
+	      const char **keys,
+	      const uint64_t *records,
+	      uint64_t n)
+{
+	struct sort sort_;
+	uint64_t m;
+	int e;
+
+	assert( index );
+	assert( !index->succinct );
+	assert( !s__index_tree_items(index->tree) );
+	assert( !n || keys );
+
+	memset(&sort_, 0, sizeof (struct sort));
+	sort_.records = records;
+	sort_.record_size = index->record_size;
+	m = S__MAX(n, 1) * sizeof (sort_.entries[0]);
+	if (!(sort_.entries = s__malloc(m)) ||
+	    sort(keys, n, sort_.entries, &sort_.n)) {
+		S__FREE(sort_.entries);
+		S__TRACE(0);
+		return -1;
+	}
+	s__spinlock_lock(&index->lock);
+	++index->version;
+	s__fence_release();
+	e = s__index_tree_bulk_stream(index->tree, sort_.n, _sorted_, &sort_);
+	s__fence_release();
+	++index->version;
+	s__spinlock_unlock(&index->lock);
+	S__FREE(sort_.entries);
+	if (e) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+int
+s__index_load_sorted(s__index_t index, s__index_fnc_t fnc, void *ctx)
+{
+	uint64_t record[S__INDEX_MAX_RECORD_SIZE / sizeof (uint64_t)];
+	const char *key;
+	uint64_t n;
+	int e;
+
+	assert( index );
+	assert( !index->succinct );
+	assert( !s__index_tree_items(index->tree) );
+	assert( fnc );
+
+	n = 0;
+	while (0 < (e = fnc(ctx, !n, &key, record))) {
+		++n;
+	}
+	if (e) {
+		S__TRACE(0);
+		return -1;
+	}
+	s__spinlock_lock(&index->lock);
+	++index->version;
+	s__fence_release();
+	e = s__index_tree_bulk_stream(index->tree, n, fnc, ctx);
+	s__fence_release();
+	++index->version;
+	s__spinlock_unlock(&index->lock);
+	if (e) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+int
+s__index_delta(s__index_t index, uint64_t threshold)
+{
+	struct delta *delta;
+
+	assert( index );
+	assert( index->succinct );
+	assert( !index->delta );
+	assert( !index->pack );
+	assert( 0 < threshold );
+
+	if (!(delta = s__malloc(sizeof (struct delta)))) {
+		S__TRACE(0);
+		return -1;
+	}
+	memset(delta, 0, sizeof (struct delta));
+	delta->threshold = threshold;
+	index->delta = delta;
+	if (!(delta->merging = s__mutex_open()) ||
+	    !(delta->mutex = s__mutex_open()) ||
+	    !(delta->cond = s__cond_open(delta->mutex)) ||
+	    !(delta->thread = s__thread_open(_merger_, index))) {
+		delta_close(index);
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+int
+s__index_merge(s__index_t index)
+{
+	assert( index );
+	assert( index->delta );
+
+	s__mutex_lock(index->delta->merging);
+	install(index);
+	if (freeze(index) || merge_(index)) {
+		s__mutex_unlock(index->delta->merging);
+		S__TRACE(0);
+		return -1;
+	}
+	install(index);
+	s__mutex_unlock(index->delta->merging);
+	return 0;
+}
+
+static int
+save(struct s__index *index, const char *pathname)
+{
+	FILE *file;
+
+	if (!(file = fopen(pathname, "wb"))) {
+		S__TRACE(S__ERR_FILE_OPEN);
+		return -1;
+	}
+	if (s__index_succinct_save(index->succinct, file)) {
+		fclose(file);
+		s__unlink(pathname);
+		S__TRACE(0);
+		return -1;
+	}
+	if (fclose(file)) {
+		s__unlink(pathname);
+		S__TRACE(S__ERR_FILE_WRITE);
+		return -1;
+	}
+	return 0;
+}
+
+int
+s__index_save(s__index_t index, const char *pathname)
+{
+	int e;
+
+	assert( index );
+	assert( index->succinct );
+	assert( s__strlen(pathname) );
+
+	if (!index->delta) {
+		if ((s__index_succinct_removed(index->succinct) &&
+		     compact(index)) ||
+		    save(index, pathname)) {
+			S__TRACE(0);
+			return -1;
+		}
+		return 0;
+	}
+	if (s__index_merge(index)) {
+		S__TRACE(0);
+		return -1;
+	}
+	s__mutex_lock(index->delta->merging);
+	e = save(index, pathname);
+	s__mutex_unlock(index->delta->merging);
+	if (e) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+s__index_t
+s__index_mmap(const char *pathname)
+{
+	struct s__index *index;
+	uint64_t size;
+
+	assert( s__strlen(pathname) );
+
+	if (!(index = s__index_open())) {
+		S__TRACE(0);
+		return NULL;
+	}
+	if (!(index->map = s__file_map(pathname, &index->map_size))) {
+		s__index_close(index);
+		S__TRACE(0);
+		return NULL;
+	}
+	if (!(index->succinct = s__index_succinct_map(index->map,
+						      index->map_size))) {
+		s__index_close(index);
+		S__TRACE(0);
+		return NULL;
+	}
+	size = s__index_succinct_record_size(index->succinct);
+	if (s__index_record_size(index, size)) {
+		s__index_close(index);
+		S__TRACE(0);
+		return NULL;
+	}
+	return index;
+}
+
+uint64_t *
+s__index_update(s__index_t index, const char *key)
+{
+	uint64_t *record;
+
+	assert( index );
+	assert( !index->succinct || index->delta );
+	assert( s__strlen(key) );
+	assert( S__INDEX_MAX_KEY_LEN > s__strlen(key) );
+
+	if (index->delta) {
+		if (index->delta->ready) {
+			install(index);
+		}
+		if (schedule(index)) {
+			S__TRACE(0);
+			return NULL;
+		}
+	}
+	s__spinlock_lock(&index->lock);
+	if (index->delta) {
+		record = delta_update(index, key);
+	}
+	else {
+		++index->version;
+		s__fence_release();
+		record = s__index_tree_update(index->tree, key);
+		s__fence_release();
+		++index->version;
+	}
+	s__spinlock_unlock(&index->lock);
+	if (!record) {
+		S__TRACE(0);
+		return NULL;
+	}
+	return record;
+}
+
+static int
+remove_(struct s__index *index, const char *key)
+{
+	int e;
+
+	if (index->delta) {
+		if (0 > (e = delta_remove(index, key))) {
+			S__TRACE(0);
+			return -1;
+		}
+		return e;
+	}
+	if (index->succinct) { /* exclusive, compact() frees the index */
+		e = s__index_succinct_remove(index->succinct, key);
+		if ((0 > e) || ((0 < e) && crowded(index) && compact(index))) {
+			S__TRACE(0);
+			return -1;
+		}
+		return e;
+	}
+	s__spinlock_lock(&index->lock);
+	++index->version;
+	s__fence_release();
+	e = s__index_tree_remove(index->tree, key);
+	s__fence_release();
+	++index->version;
+	s__spinlock_unlock(&index->lock);
+	if (0 > e) {
+		S__TRACE(0);
+		return -1;
+	}
+	return e;
+}
+
+int
+s__index_remove(s__index_t index, const char *key)
+{
+	int e;
+
+	assert( index );
+	assert( s__strlen(key) );
+
+	if (0 > (e = remove_(index, key))) {
+		S__TRACE(0);
+		return -1;
+	}
+	if (e && index->wal && logged(index, S__INDEX_WAL_REMOVE, key, NULL)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return e;
+}
+
+int
+s__index_log(s__index_t index, const char *pathname, uint64_t snapshot)
+{
+	assert( index );
+	assert( !index->wal );
+	assert( !s__index_items(index) );
+	assert( s__strlen(pathname) );
+
+	if (!(index->snap = extend(pathname, ".snap")) ||
+	    !(index->snap_ = extend(pathname, ".snap.tmp"))) {
+		unlog(index);
+		S__TRACE(0);
+		return -1;
+	}
+	if (s__index_wal_replay(index->snap,
+				index->record_size,
+				_replay_,
+				index) ||
+	    s__index_wal_replay(pathname,
+				index->record_size,
+				_replay_,
+				index) ||
+	    !(index->wal = s__index_wal_open(pathname,
+					     index->record_size,
+					     INTERVAL))) {
+		unlog(index);
+		S__TRACE(0);
+		return -1;
+	}
+	index->snapshot = snapshot;
+	if (s__index_wal_bytes(index->wal) && s__index_snapshot(index)) {
+		unlog(index);
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+int
+s__index_put(s__index_t index, const char *key, const uint64_t *record)
+{
+	uint64_t *record_;
+
+	assert( index );
+	assert( record );
+
+	if (!(record_ = s__index_update(index, key))) {
+		S__TRACE(0);
+		return -1;
+	}
+	memcpy(record_, record, (size_t)index->record_size);
+	if (index->wal && logged(index, S__INDEX_WAL_PUT, key, record)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+int
+s__index_commit(s__index_t index)
+{
+	assert( index );
+
+	if (index->wal && s__index_wal_commit(index->wal)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+int
+s__index_snapshot(s__index_t index)
+{
+	s__index_cursor_t cursor;
+	s__index_wal_t wal;
+	uint64_t *record;
+	int e;
+
+	assert( index );
+	assert( index->wal );
+
+	s__unlink(index->snap_);
+	if (!(wal = s__index_wal_open(index->snap_, index->record_size, 0))) {
+		S__TRACE(0);
+		return -1;
+	}
+	if (!(cursor = s__index_cursor_open(index))) {
+		s__index_wal_close(wal);
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	record = s__index_cursor_seek(cursor, NULL, NULL);
+	while (!e && record) {
+		e = s__index_wal_append(wal,
+					S__INDEX_WAL_PUT,
+					s__index_cursor_key(cursor),
+					record);
+		record = s__index_cursor_next(cursor);
+	}
+	s__index_cursor_close(cursor);
+	if (e || s__index_wal_commit(wal)) {
+		s__index_wal_close(wal);
+		S__TRACE(0);
+		return -1;
+	}
+	s__index_wal_close(wal);
+	if (rename(index->snap_, index->snap)) {
+		S__TRACE(S__ERR_FILE_WRITE);
+		return -1;
+	}
+	if (s__file_sync_dir(index->snap) || s__index_wal_reset(index->wal)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+uint64_t *
+s__index_find(s__index_t index, const char *key)
+{
+	assert( index );
+	assert( !index->pack || !index->succinct );
+	assert( s__strlen(key) );
+
+	if (index->delta) {
+		return delta_find(index, key, NULL);
+	}
+	if (index->succinct) {
+		return s__index_succinct_find(index->succinct, key);
+	}
+	return read_(index, FIND, key, NULL, NULL);
+}
+
+int
+s__index_find_copy(s__index_t index, const char *key, void *record)
+{
+	uint64_t *record_;
+
+	assert( index );
+	assert( s__strlen(key) );
+	assert( record );
+
+	if (index->pack && index->succinct) {
+		return s__index_succinct_get(index->succinct,
+					     key,
+					     (uint64_t *)record);
+	}
+	if (index->delta) {
+		record_ = delta_find(index, key, record);
+	}
+	else if (index->succinct) {
+		if ((record_ = s__index_succinct_find(index->succinct, key))) {
+			memcpy(record, record_, (size_t)index->record_size);
+		}
+	}
+	else {
+		record_ = read_(index, FIND, key, NULL, record);
+	}
+	return record_ ? 1 : 0;
+}
+
+int
+s__index_find_value(s__index_t index, const char *key, uint64_t *value)
+{
+	uint64_t record[S__INDEX_MAX_RECORD_SIZE / sizeof (uint64_t)];
+
+	assert( index );
+	assert( s__strlen(key) );
+	assert( value );
+
+	if (!s__index_find_copy(index, key, record)) {
+		return 0;
+	}
+	(*value) = record[0];
+	return 1;
+}
+
+void
+s__index_find_batch(s__index_t index,
+		    const char **keys,
+		    uint64_t n,
+		    uint64_t **records)
+{
+	uint64_t i, m;
+
+	assert( index );
+	assert( !index->pack || !index->succinct );
+	assert( !n || (keys && records) );
+
+	if (index->delta) {
+		for (i=0; i<n; ++i) {
+			records[i] = delta_find(index, keys[i], NULL);
+		}
+		return;
+	}
+	if (index->succinct) {
+		s__index_succinct_find_batch(index->succinct, keys, n, records);
+		return;
+	}
+	for (i=0; i<n; i+=m) {
+		m = S__MIN(BATCH, n - i);
+		read_batch(index, keys + i, m, records + i);
+	}
+}
+
+uint64_t *
+s__index_next(s__index_t index, const char *key, char *okey)
+{
+	assert( index );
+	assert( !index->pack || !index->succinct );
+	assert( okey );
+
+	if (index->delta) {
+		return delta_step(index, NEXT, key, okey);
+	}
+	if (index->succinct) {
+		return s__index_succinct_next(index->succinct, key, okey);
+	}
+	return read_(index, NEXT, key, okey, NULL);
+}
+
+uint64_t *
+s__index_prev(s__index_t index, const char *key, char *okey)
+{
+	assert( index );
+	assert( !index->pack || !index->succinct );
+	assert( okey );
+
+	if (index->delta) {
+		return delta_step(index, PREV, key, okey);
+	}
+	if (index->succinct) {
+		return s__index_succinct_prev(index->succinct, key, okey);
+	}
+	return read_(index, PREV, key, okey, NULL);
+}
+
+/**
+ * Binary keys: byte 0x00 is written as 0x01 0x01, and 0x01 as 0x01 0x02,
+ * so that an encoded key holds no '\0' and strcmp() orders encoded keys as
+ * memcmp() orders their bytes, a key before its extensions. Integer keys
+ * are written as ten bytes of seven bits each, most significant first,
+ * with the high bit set, so that they are fixed in width and ordered by
+ * value.
+ */
+
+static void
+encode(const void *key, uint64_t len, char *okey)
+{
+	const unsigned char *p;
+	uint64_t i;
+
+	p = (const unsigned char *)key;
+	for (i=0; i<len; ++i) {
+		if (1 < p[i]) {
+			(*okey++) = (char)p[i];
+		}
+		else {
+			(*okey++) = 1;
+			(*okey++) = (char)(p[i] + 1);
+		}
+	}
+	(*okey) = '\0';
+}
+
+static uint64_t
+decode(const char *key, void *okey)
+{
+	unsigned char *p;
+
+	p = (unsigned char *)okey;
+	while (*key) {
+		if (1 == (*key)) {
+			(*p++) = (unsigned char)((*(++key)) - 1);
+		}
+		else {
+			(*p++) = (unsigned char)(*key);
+		}
+		++key;
+	}
+	return (uint64_t)(p - (unsigned char *)okey);
+}
+
+uint64_t *
+s__index_update_n(s__index_t index, const void *key, uint64_t len)
+{
+	char buf[S__INDEX_MAX_KEY_LEN];
+
+	assert( index );
+	assert( key );
+	assert( len && (S__INDEX_MAX_KEY_LEN_N >= len) );
+
+	encode(key, len, buf);
+	return s__index_update(index, buf);
+}
+
+int
+s__index_remove_n(s__index_t index, const void *key, uint64_t len)
+{
+	char buf[S__INDEX_MAX_KEY_LEN];
+
+	assert( index );
+	assert( key );
+	assert( len && (S__INDEX_MAX_KEY_LEN_N >= len) );
+
+	encode(key, len, buf);
+	return s__index_remove(index, buf);
+}
+
+uint64_t *
+s__index_find_n(s__index_t index, const void *key, uint64_t len)
+{
+	char buf[S__INDEX_MAX_KEY_LEN];
+
+	assert( index );
+	assert( key );
+	assert( len && (S__INDEX_MAX_KEY_LEN_N >= len) );
+
+	encode(key, len, buf);
+	return s__index_find(index, buf);
+}
+
+static uint64_t *
+step_n(s__index_t index,
+       enum op op,
+       const void *key,
+       uint64_t len,
+       void *okey,
+       uint64_t *olen)
+{
+	char buf[S__INDEX_MAX_KEY_LEN], obuf[S__INDEX_MAX_KEY_LEN];
+	uint64_t *record;
+
+	if (key) {
+		encode(key, len, buf);
+	}
+	record = (NEXT == op) ?
+		s__index_next(index, key ? buf : NULL, obuf) :
+		s__index_prev(index, key ? buf : NULL, obuf);
+	if (record) {
+		(*olen) = decode(obuf, okey);
+	}
+	return record;
+}
+
+uint64_t *
+s__index_next_n(s__index_t index,
+		const void *key,
+		uint64_t len,
+		void *okey,
+		uint64_t *olen)
+{
+	assert( index );
+	assert( !key || (len && (S__INDEX_MAX_KEY_LEN_N >= len)) );
+	assert( okey && olen );
+
+	return step_n(index, NEXT, key, len, okey, olen);
+}
+
+uint64_t *
+s__index_prev_n(s__index_t index,
+		const void *key,
+		uint64_t len,
+		void *okey,
+		uint64_t *olen)
+{
+	assert( index );
+	assert( !key || (len && (S__INDEX_MAX_KEY_LEN_N >= len)) );
+	assert( okey && olen );
+
+	return step_n(index, PREV, key, len, okey, olen);
+}
+
+uint64_t *
+s__index_update_u64(s__index_t index, uint64_t key)
+{
+	char buf[S__INDEX_TREE_U64_LEN + 1];
+
+	assert( index );
+
+	s__index_tree_encode_u64(key, buf);
+	return s__index_update(index, buf);
+}
+
+int
+s__index_remove_u64(s__index_t index, uint64_t key)
+{
+	char buf[S__INDEX_TREE_U64_LEN + 1];
+
+	assert( index );
+
+	s__index_tree_encode_u64(key, buf);
+	return s__index_remove(index, buf);
+}
+
+uint64_t *
+s__index_find_u64(s__index_t index, uint64_t key)
+{
+	char buf[S__INDEX_TREE_U64_LEN + 1];
+
+	assert( index );
+
+	s__index_tree_encode_u64(key, buf);
+	return s__index_find(index, buf);
+}
+
+static uint64_t *
+step_u64(s__index_t index, enum op op, const uint64_t *key, uint64_t *okey)
+{
+	char buf[S__INDEX_TREE_U64_LEN + 1], obuf[S__INDEX_MAX_KEY_LEN];
+	uint64_t *record;
+
+	if (key) {
+		s__index_tree_encode_u64((*key), buf);
+	}
+	record = (NEXT == op) ?
+		s__index_next(index, key ? buf : NULL, obuf) :
+		s__index_prev(index, key ? buf : NULL, obuf);
+	if (record && s__index_tree_decode_u64(obuf, okey)) {
+		(*okey) = 0; /* a key of another family */
+	}
+	return record;
+}
+
+uint64_t *
+s__index_next_u64(s__index_t index, const uint64_t *key, uint64_t *okey)
+{
+	assert( index );
+	assert( okey );
+
+	return step_u64(index, NEXT, key, okey);
+}
+
+uint64_t *
+s__index_prev_u64(s__index_t index, const uint64_t *key, uint64_t *okey)
+{
+	assert( index );
+	assert( okey );
+
+	return step_u64(index, PREV, key, okey);
+}
+
+uint64_t
+s__index_items(s__index_t index)
+{
+	struct delta *delta;
+	uint64_t items;
+
+	assert( index );
+
+	if ((delta = index->delta)) {
+		s__spinlock_lock(&index->lock);
+		items = s__index_succinct_items(index->succinct);
+		items += s__index_tree_items(index->tree) - delta->shadows;
+		if (delta->frozen) {
+			items += s__index_tree_items(delta->frozen);
+			items -= delta->shadows_;
+		}
+		s__spinlock_unlock(&index->lock);
+		return items;
+	}
+	if (index->succinct) {
+		return s__index_succinct_items(index->succinct);
+	}
+	return s__index_tree_items(index->tree);
+}
+
+/**
+ * Delta cursor: a cursor over the tree, the frozen tree and the compressed
+ * index, each positioned on its own head, steps the layers whose heads
+ * hold its key and then moves to the least head, or the greatest when
+ * stepping backward, the earliest layer winning a tie, as it shadows the
+ * others. Turning around steps every layer past the key once, and only a
+ * layer exhausted in the old direction descends again, from its far end.
+ * The layer cursors are reopened by a seek once the delta has replaced a
+ * layer.
+ */
+
+static int
+layers(struct s__index_cursor *cursor)
 {
 	struct s__index *index;
+	struct delta *delta;
 
-	assert( S__INDEX_MAX_KEY_LEN == S__INDEX_TREE_MAX_KEY_LEN );
+	index = cursor->index;
+	delta = index->delta;
+	if ((cursor->epoch == delta->epoch) &&
+	    (cursor->trees[TREE] == index->tree) &&
+	    (cursor->trees[FROZEN] == delta->frozen) &&
+	    (cursor->base == index->succinct)) {
+		return 0;
+	}
+	s__index_tree_cursor_close(cursor->tree);
+	s__index_tree_cursor_close(cursor->frozen);
+	s__index_succinct_cursor_close(cursor->succinct);
+	cursor->tree = NULL;
+	cursor->frozen = NULL;
+	cursor->succinct = NULL;
+	cursor->base = NULL;
+	if (!(cursor->tree = s__index_tree_cursor_open(index->tree)) ||
+	    (delta->frozen &&
+	     !(cursor->frozen = s__index_tree_cursor_open(delta->frozen))) ||
+	    !(cursor->succinct =
+	      s__index_succinct_cursor_open(index->succinct))) {
+		S__TRACE(0);
+		return -1;
+	}
+	cursor->trees[TREE] = index->tree;
+	cursor->trees[FROZEN] = delta->frozen;
+	cursor->base = index->succinct;
+	cursor->epoch = delta->epoch;
+	return 0;
+}
 
-	if (!(index = s__malloc(sizeof (struct s__index)))) {
+static uint64_t *
+layer_seek(struct s__index_cursor *cursor, enum layer layer, const char *key)
+{
+	if (SUCCINCT == layer) {
+		return s__index_succinct_cursor_seek(cursor->succinct, key);
+	}
+	if (FROZEN == layer) {
+		if (!cursor->frozen) {
+			return NULL;
+		}
+		return s__index_tree_cursor_seek(cursor->frozen, key);
+	}
+	return s__index_tree_cursor_seek(cursor->tree, key);
+}
+
+static uint64_t *
+layer_step(struct s__index_cursor *cursor, enum layer layer, enum op op)
+{
+	s__index_tree_cursor_t tree;
+
+	if (SUCCINCT == layer) {
+		return (NEXT == op) ?
+			s__index_succinct_cursor_next(cursor->succinct) :
+			s__index_succinct_cursor_prev(cursor->succinct);
+	}
+	tree = (TREE == layer) ? cursor->tree : cursor->frozen;
+	return (NEXT == op) ?
+		s__index_tree_cursor_next(tree) :
+		s__index_tree_cursor_prev(tree);
+}
+
+static uint64_t *
+layer_last(struct s__index_cursor *cursor, enum layer layer)
+{
+	uint64_t *record;
+
+	if (SUCCINCT == layer) {
+		record = s__index_succinct_prev(cursor->base, NULL, cursor->key);
+	}
+	else if ((FROZEN == layer) && !cursor->frozen) {
+		record = NULL;
+	}
+	else {
+		record = s__index_tree_prev(cursor->trees[layer],
+					    NULL,
+					    cursor->key);
+	}
+	return record ? layer_seek(cursor, layer, cursor->key) : NULL;
+}
+
+static uint64_t *
+pick(struct s__index_cursor *cursor, int d)
+{
+	enum layer layer, best;
+
+	best = LAYERS;
+	for (layer=TREE; layer<LAYERS; ++layer) {
+		if (cursor->heads[layer] &&
+		    ((LAYERS == best) ||
+		     (0 < (d * strcmp(layer_key(cursor, best),
+				      layer_key(cursor, layer)))))) {
+			best = layer;
+		}
+	}
+	cursor->d = d;
+	if (LAYERS == best) {
+		return NULL;
+	}
+	cursor->layer = best;
+	return cursor->heads[best];
+}
+
+static uint64_t *
+delta_seek(struct s__index_cursor *cursor, const char *key)
+{
+	enum layer layer;
+
+	if (layers(cursor)) {
 		S__TRACE(0);
 		return NULL;
 	}
-	memset(index, 0, sizeof (struct s__index));
-	if (!(index->tree = s__index_tree_open())) {
-		s__index_close(index);
+	for (layer=TREE; layer<LAYERS; ++layer) {
+		cursor->heads[layer] = layer_seek(cursor, layer, key);
+	}
+	return pick(cursor, 1);
+}
+
+static uint64_t *
+delta_advance(struct s__index_cursor *cursor, enum op op)
+{
+	enum layer layer, at;
+	const char *key;
+	int d;
+
+	d = (NEXT == op) ? 1 : -1;
+	at = cursor->layer;
+	key = layer_key(cursor, at);
+	for (layer=TREE; layer<LAYERS; ++layer) {
+		if (at == layer) {
+			continue;
+		}
+		if (cursor->heads[layer]) {
+			if ((d != cursor->d) ||
+			    !strcmp(key, layer_key(cursor, layer))) {
+				cursor->heads[layer] = layer_step(cursor,
+								  layer,
+								  op);
+			}
+		}
+		else if (d != cursor->d) { /* exhausted the other way */
+			cursor->heads[layer] = (NEXT == op) ?
+				layer_seek(cursor, layer, NULL) :
+				layer_last(cursor, layer);
+		}
+	}
+	cursor->heads[at] = layer_step(cursor, at, op);
+	return pick(cursor, d);
+}
+
+s__index_cursor_t
+s__index_cursor_open(s__index_t index)
+{
+	struct s__index_cursor *cursor;
+
+	assert( index );
+
+	if (!(cursor = s__malloc(sizeof (struct s__index_cursor)))) {
 		S__TRACE(0);
 		return NULL;
 	}
-	return index;
+	memset(cursor, 0, sizeof (struct s__index_cursor));
+	if (index->delta) {
+		cursor->index = index;
+		if (!(cursor->key = s__malloc(S__INDEX_MAX_KEY_LEN))) {
+			s__index_cursor_close(cursor);
+			S__TRACE(0);
+			return NULL;
+		}
+	}
+	else if (index->succinct) {
+		if (!(cursor->succinct =
+		      s__index_succinct_cursor_open(index->succinct))) {
+			s__index_cursor_close(cursor);
+			S__TRACE(0);
+			return NULL;
+		}
+	}
+	else if (!(cursor->tree = s__index_tree_cursor_open(index->tree))) {
+		s__index_cursor_close(cursor);
+		S__TRACE(0);
+		return NULL;
+	}
+	return cursor;
 }
 
 void
-s__index_close(s__index_t index)
+s__index_cursor_close(s__index_cursor_t cursor)
 {
-	if (index) {
-		s__index_tree_close(index->tree);
-		s__index_succinct_close(index->succinct);
-		memset(index, 0, sizeof (struct s__index));
+	if (cursor) {
+		s__index_tree_cursor_close(cursor->tree);
+		s__index_tree_cursor_close(cursor->frozen);
+		s__index_succinct_cursor_close(cursor->succinct);
+		S__FREE(cursor->hi);
+		S__FREE(cursor->key);
+		memset(cursor, 0, sizeof (struct s__index_cursor));
 	}
-	S__FREE(index);
+	S__FREE(cursor);
 }
 
-void
-s__index_truncate(s__index_t index)
+uint64_t *
+s__index_cursor_seek(s__index_cursor_t cursor, const char *key, const char *hi)
+{
+	uint64_t *record;
+
+	assert( cursor );
+
+	S__FREE(cursor->hi);
+	cursor->record = NULL;
+	if (hi && !(cursor->hi = s__strdup(hi))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	if (cursor->index) {
+		record = delta_seek(cursor, key);
+	}
+	else if (cursor->succinct) {
+		record = s__index_succinct_cursor_seek(cursor->succinct, key);
+	}
+	else {
+		record = s__index_tree_cursor_seek(cursor->tree, key);
+	}
+	return cursor_bound(cursor, record);
+}
+
+uint64_t *
+s__index_cursor_next(s__index_cursor_t cursor)
+{
+	uint64_t *record;
+
+	assert( cursor );
+
+	if (!cursor->record) {
+		return NULL;
+	}
+	if (cursor->index) {
+		record = delta_advance(cursor, NEXT);
+	}
+	else if (cursor->succinct) {
+		record = s__index_succinct_cursor_next(cursor->succinct);
+	}
+	else {
+		record = s__index_tree_cursor_next(cursor->tree);
+	}
+	return cursor_bound(cursor, record);
+}
+
+uint64_t *
+s__index_cursor_prev(s__index_cursor_t cursor)
+{
+	uint64_t *record;
+
+	assert( cursor );
+
+	if (!cursor->record) {
+		return NULL;
+	}
+	if (cursor->index) {
+		record = delta_advance(cursor, PREV);
+	}
+	else if (cursor->succinct) {
+		record = s__index_succinct_cursor_prev(cursor->succinct);
+	}
+	else {
+		record = s__index_tree_cursor_prev(cursor->tree);
+	}
+	return cursor_bound(cursor, record);
+}
+
+const char *
+s__index_cursor_key(s__index_cursor_t cursor)
+{
+	assert( cursor );
+	assert( cursor->record );
+
+	return cursor_key(cursor);
+}
+
+int
+s__index_prefix_iterate(s__index_t index,
+			const char *prefix,
+			s__index_prefix_fnc_t fnc,
+			void *ctx)
 {
+	s__index_cursor_t cursor;
+	uint64_t n, *record;
+	const char *key;
+	int e;
+
 	assert( index );
+	assert( prefix );
+	assert( fnc );
 
-	s__index_tree_truncate(index->tree);
-	s__index_succinct_close(index->succinct);
-	index->succinct = NULL;
+	if (!(cursor = s__index_cursor_open(index))) {
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	n = s__strlen(prefix);
+	record = s__index_cursor_seek(cursor, n ? prefix : NULL, NULL);
+	while (record) {
+		key = s__index_cursor_key(cursor);
+		if (strncmp(key, prefix, n) || (e = fnc(ctx, key, record))) {
+			break;
+		}
+		record = s__index_cursor_next(cursor);
+	}
+	s__index_cursor_close(cursor);
+	if (0 > e) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Fuzzy: the cursor visits keys in lexicographical order, that is, in the
+ * depth first order of a trie, so consecutive keys share the edit distance
+ * rows of their common prefix and only the rows of the bytes that follow
+ * are computed. Row d holds the distance from the first d key bytes to
+ * every prefix of the query, within a band of max_edits cells on either
+ * side of the diagonal, beyond which a distance always exceeds the
+ * budget. Once every cell of a row exceeds the budget, no key below that
+ * prefix can match, and the cursor seeks past the prefix.
+ */
+
+struct fuzzy {
+	const char *query;
+	uint64_t m; /* query length */
+	uint64_t k; /* edit budget */
+	uint64_t width; /* cells per row */
+	uint64_t *rows;
+	char *path; /* key bytes of the rows */
+};
+
+static uint64_t
+cell(const struct fuzzy *fuzzy, uint64_t d, uint64_t j)
+{
+	if ((j + fuzzy->k < d) || (d + fuzzy->k < j) || (fuzzy->m < j)) {
+		return fuzzy->k + 1;
+	}
+	return fuzzy->rows[d * fuzzy->width + (j + fuzzy->k - d)];
+}
+
+static uint64_t
+row(struct fuzzy *fuzzy, uint64_t d, char c)
+{
+	uint64_t j, lo, hi, v, min;
+
+	lo = (d > fuzzy->k) ? (d - fuzzy->k) : 0;
+	hi = S__MIN(fuzzy->m, d + fuzzy->k);
+	min = fuzzy->k + 1;
+	for (j=lo; j<=hi; ++j) {
+		if (!j) {
+			v = d;
+		}
+		else {
+			v = cell(fuzzy, d - 1, j - 1);
+			v += (c != fuzzy->query[j - 1]) ? 1 : 0;
+			v = S__MIN(v, cell(fuzzy, d - 1, j) + 1);
+			v = S__MIN(v, cell(fuzzy, d, j - 1) + 1);
+		}
+		v = S__MIN(v, fuzzy->k + 1);
+		fuzzy->rows[d * fuzzy->width + (j + fuzzy->k - d)] = v;
+		min = S__MIN(min, v);
+	}
+	return min;
 }
 
 int
-s__index_compress(s__index_t index)
+s__index_fuzzy(s__index_t index,
+	       const char *key,
+	       uint64_t max_edits,
+	       s__index_prefix_fnc_t fnc,
+	       void *ctx)
 {
-	s__index_ternary_t ternary;
+	s__index_cursor_t cursor;
+	struct fuzzy fuzzy;
+	uint64_t d, n, valid, *record;
+	const char *key_;
+	int e, pruned;
 
 	assert( index );
-	assert( !index->succinct );
+	assert( key && (S__INDEX_MAX_KEY_LEN > s__strlen(key)) );
+	assert( S__INDEX_MAX_EDITS >= max_edits );
+	assert( fnc );
 
-	if (!(ternary = s__index_ternary_open(index->tree))) {
+	memset(&fuzzy, 0, sizeof (struct fuzzy));
+	fuzzy.query = key;
+	fuzzy.m = s__strlen(key);
+	fuzzy.k = max_edits;
+	fuzzy.width = 2 * max_edits + 1;
+	n = fuzzy.m + fuzzy.k + 2;
+	cursor = NULL;
+	if (!(fuzzy.rows = s__malloc(n * fuzzy.width * sizeof (uint64_t))) ||
+	    !(fuzzy.path = s__malloc(n)) ||
+	    !(cursor = s__index_cursor_open(index))) {
+		S__FREE(fuzzy.rows);
+		S__FREE(fuzzy.path);
 		S__TRACE(0);
 		return -1;
 	}
-	s__index_tree_truncate(index->tree);
-	if (!(index->succinct = s__index_succinct_open(ternary))) {
+	for (d=0; d<=S__MIN(fuzzy.m, fuzzy.k); ++d) {
+		fuzzy.rows[d + fuzzy.k] = d;
+	}
+	e = 0;
+	valid = 0;
+	record = s__index_cursor_seek(cursor, NULL, NULL);
+	while (record) {
+		key_ = s__index_cursor_key(cursor);
+		for (d=0; (d < valid) && (fuzzy.path[d] == key_[d]); ++d);
+		pruned = 0;
+		for (; key_[d]; ++d) {
+			fuzzy.path[d] = key_[d];
+			if (fuzzy.k < row(&fuzzy, d + 1, key_[d])) {
+				pruned = 1;
+				break;
+			}
+		}
+		valid = d;
+		if (!pruned) {
+			if ((fuzzy.k >= cell(&fuzzy, d, fuzzy.m)) &&
+			    (e = fnc(ctx, key_, record))) {
+				break;
+			}
+			record = s__index_cursor_next(cursor);
+			continue;
+		}
+		for (n=d + 1; n && (0xff == CHAR2INT(fuzzy.path[n - 1])); --n);
+		if (!n) {
+			break;
+		}
+		fuzzy.path[n - 1] = (char)(CHAR2INT(fuzzy.path[n - 1]) + 1);
+		fuzzy.path[n] = '\0';
+		valid = n - 1;
+		record = s__index_cursor_seek(cursor, fuzzy.path, NULL);
+	}
+	s__index_cursor_close(cursor);
+	S__FREE(fuzzy.rows);
+	S__FREE(fuzzy.path);
+	if (0 > e) {
 		S__TRACE(0);
 		return -1;
 	}
-	s__index_ternary_close(ternary);
 	return 0;
 }
 
-uint64_t *
-s__index_update(s__index_t index, const char *key)
+static int
+_count_(void *ctx, const char *key, uint64_t *record)
 {
-	uint64_t *record;
+	S__UNUSED(key);
+	S__UNUSED(record);
+
+	(*((uint64_t *)ctx)) += 1;
+	return 0;
+}
 
+int
+s__index_prefix_count(s__index_t index, const char *prefix, uint64_t *count)
+{
 	assert( index );
-	assert( !index->succinct );
-	assert( s__strlen(key) );
-	assert( S__INDEX_MAX_KEY_LEN > s__strlen(key) );
+	assert( prefix );
+	assert( count );
 
-	if (!(record = s__index_tree_update(index->tree, key))) {
+	(*count) = 0;
+	if (!index->delta && index->succinct) {
+		if (s__index_succinct_count(index->succinct, prefix, count)) {
+			S__TRACE(0);
+			return -1;
+		}
+		return 0;
+	}
+	if (s__index_prefix_iterate(index, prefix, _count_, count)) {
 		S__TRACE(0);
-		return NULL;
+		return -1;
 	}
-	return record;
+	return 0;
 }
 
-uint64_t *
-s__index_find(s__index_t index, const char *key)
+static void
+add(struct s__index_tree_stats *a, const struct s__index_tree_stats *b)
+{
+	a->used += b->used;
+	a->allocated += b->allocated;
+	a->nodes += b->nodes;
+	a->keys += b->keys;
+	a->depths += b->depths;
+	a->max_depth = S__MAX(a->max_depth, b->max_depth);
+}
+
+static void
+part(struct s__index_stats_part *part_, const struct s__index_tree_stats *b)
+{
+	part_->used = b->used;
+	part_->allocated = b->allocated;
+	part_->nodes = b->nodes;
+	part_->keys = b->keys;
+	part_->avg_depth = b->keys ? ((double)b->depths / b->keys) : 0.0;
+	part_->max_depth = b->max_depth;
+}
+
+static int
+_lens_(void *ctx, const char *key, uint64_t *record)
+{
+	struct s__index_stats *stats;
+	uint64_t n;
+	int i;
+
+	S__UNUSED(record);
+
+	stats = (struct s__index_stats *)ctx;
+	n = s__strlen(key);
+	for (i=0; (1 < n) && (i < (S__INDEX_STATS_LENS - 1)); ++i) {
+		n >>= 1;
+	}
+	stats->lens[i] += 1;
+	return 0;
+}
+
+int
+s__index_stats(s__index_t index, struct s__index_stats *stats)
 {
+	struct s__index_tree_stats tree, frozen, succinct, all;
+	int e;
+
 	assert( index );
-	assert( s__strlen(key) );
+	assert( stats );
 
+	memset(stats, 0, sizeof (struct s__index_stats));
+	memset(&succinct, 0, sizeof (struct s__index_tree_stats));
+	memset(&frozen, 0, sizeof (struct s__index_tree_stats));
+	if (index->delta) {
+		s__mutex_lock(index->delta->merging);
+		install(index);
+		if (index->delta->frozen) { /* not yet merged */
+			s__index_tree_stats(index->delta->frozen, &frozen);
+		}
+	}
+	s__index_tree_stats(index->tree, &tree);
+	e = 0;
 	if (index->succinct) {
-		return s__index_succinct_find(index->succinct, key);
+		e = s__index_succinct_stats(index->succinct, &succinct);
+	}
+	if (index->delta) {
+		s__mutex_unlock(index->delta->merging);
+	}
+	if (e) {
+		S__TRACE(0);
+		return -1;
 	}
-	return s__index_tree_find(index->tree, key);
+	add(&tree, &frozen);
+	part(&stats->tree, &tree);
+	part(&stats->succinct, &succinct);
+	memset(&all, 0, sizeof (struct s__index_tree_stats));
+	add(&all, &tree);
+	add(&all, &succinct);
+	stats->items = s__index_items(index);
+	stats->used = all.used;
+	stats->allocated = all.allocated;
+	if (stats->items) {
+		stats->bytes_per_key = (double)all.allocated / stats->items;
+	}
+	stats->avg_depth = all.keys ? ((double)all.depths / all.keys) : 0.0;
+	stats->max_depth = all.max_depth;
+	if (index->succinct) {
+		stats->filtered = s__index_succinct_filtered(index->succinct);
+		stats->chained = s__index_succinct_chained(index->succinct);
+	}
+	if (s__index_prefix_iterate(index, "", _lens_, stats)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
 }
 
-uint64_t *
-s__index_next(s__index_t index, const char *key, char *okey)
+int
+s__index_record_size(s__index_t index, uint64_t record_size)
 {
+	s__index_tree_t tree;
+	uint64_t size;
+
 	assert( index );
-	assert( okey );
+	assert( !index->delta );
+	assert( !s__index_tree_items(index->tree) );
 
-	if (index->succinct) {
-		return s__index_succinct_next(index->succinct, key, okey);
+	if (!record_size ||
+	    (record_size % sizeof (uint64_t)) ||
+	    (S__INDEX_MAX_RECORD_SIZE < record_size) ||
+	    (index->pack && (sizeof (uint64_t) != record_size)) ||
+	    (index->succinct &&
+	     (s__index_succinct_record_size(index->succinct) != record_size))) {
+		S__TRACE(S__ERR_ARGUMENT);
+		return -1;
 	}
-	return s__index_tree_next(index->tree, key, okey);
+	if (record_size != index->record_size) {
+		size = index->record_size;
+		index->record_size = record_size;
+		if (!(tree = tree_open(index))) {
+			index->record_size = size;
+			S__TRACE(0);
+			return -1;
+		}
+		s__index_tree_close(index->tree);
+		index->tree = tree;
+	}
+	return 0;
 }
 
-uint64_t *
-s__index_prev(s__index_t index, const char *key, char *okey)
+int
+s__index_filter(s__index_t index, uint64_t bits_per_key)
 {
 	assert( index );
-	assert( okey );
+	assert( bits_per_key );
+	assert( S__INDEX_MAX_FILTER_BITS >= bits_per_key );
 
-	if (index->succinct) {
-		return s__index_succinct_prev(index->succinct, key, okey);
+	if (index->delta) {
+		s__mutex_lock(index->delta->merging);
+	}
+	index->filter = bits_per_key;
+	if (index->delta) {
+		s__mutex_unlock(index->delta->merging);
+	}
+	if (index->succinct && layout(index, index->succinct)) {
+		S__TRACE(0);
+		return -1;
 	}
-	return s__index_tree_prev(index->tree, key, okey);
+	return 0;
 }
 
-uint64_t
-s__index_items(s__index_t index)
+int
+s__index_pack(s__index_t index)
 {
 	assert( index );
+	assert( !index->delta );
 
-	if (index->succinct) {
-		return s__index_succinct_items(index->succinct);
+	if (sizeof (uint64_t) != index->record_size) {
+		S__TRACE(S__ERR_ARGUMENT);
+		return -1;
 	}
-	return s__index_tree_items(index->tree);
+	index->pack = 1;
+	if (index->succinct && layout(index, index->succinct)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Collapsing rebuilds a published compressed index: a compacted copy is
+ * collapsed, and swapped in under the readers of a delta, or in place of
+ * the index without one.
+ */
+
+static int
+collapse(struct s__index *index)
+{
+	s__index_succinct_t succinct;
+
+	index->collapse = 1;
+	if (!index->succinct || s__index_succinct_collapsed(index->succinct)) {
+		return 0;
+	}
+	if (!(succinct = s__index_succinct_compact(index->succinct))) {
+		S__TRACE(0);
+		return -1;
+	}
+	if (layout(index, succinct)) {
+		s__index_succinct_close(succinct);
+		S__TRACE(0);
+		return -1;
+	}
+	if (index->delta) {
+		s__spinlock_lock(&index->lock);
+		index->delta->ready = succinct;
+		s__spinlock_unlock(&index->lock);
+		install(index);
+		return 0;
+	}
+	s__index_succinct_close(index->succinct);
+	s__file_unmap(index->map, index->map_size);
+	index->succinct = succinct;
+	index->map = NULL;
+	index->map_size = 0;
+	return 0;
+}
+
+int
+s__index_collapse(s__index_t index)
+{
+	struct delta *delta;
+
+	assert( index );
+
+	if (!(delta = index->delta)) {
+		if (collapse(index)) {
+			S__TRACE(0);
+			return -1;
+		}
+		return 0;
+	}
+	s__mutex_lock(delta->merging);
+	install(index);
+	if (delta->frozen) { /* not yet merged */
+		if (merge_(index)) {
+			s__mutex_unlock(delta->merging);
+			S__TRACE(0);
+			return -1;
+		}
+		install(index);
+	}
+	if (collapse(index)) {
+		s__mutex_unlock(delta->merging);
+		S__TRACE(0);
+		return -1;
+	}
+	s__mutex_unlock(delta->merging);
+	return 0;
 }
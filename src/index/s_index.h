@@ -11,8 +11,66 @@
 
 #define S__INDEX_MAX_KEY_LEN 32767 /* including '\0' */
 
+#define S__INDEX_MAX_KEY_LEN_N 16383 /* of binary keys */
+
+#define S__INDEX_MAX_RECORD_SIZE 256 /* bytes */
+
+#define S__INDEX_MAX_EDITS 255 /* of a fuzzy search */
+
+#define S__INDEX_MAX_FILTER_BITS 64 /* per key */
+
+#define S__INDEX_STATS_LENS 16 /* key length histogram buckets */
+
 typedef struct s__index *s__index_t;
 
+typedef struct s__index_cursor *s__index_cursor_t;
+
+struct s__index_stats_part {
+	uint64_t used; /* bytes of live nodes, keys and records */
+	uint64_t allocated; /* bytes reserved, including free space */
+	uint64_t nodes;
+	uint64_t keys;
+	double avg_depth; /* nodes visited by a lookup, per key */
+	uint64_t max_depth;
+};
+
+struct s__index_stats {
+	struct s__index_stats_part tree; /* mutable keys */
+	struct s__index_stats_part succinct; /* compressed keys */
+	uint64_t items;
+	uint64_t used;
+	uint64_t allocated;
+	double bytes_per_key; /* allocated bytes per item */
+	double avg_depth;
+	uint64_t max_depth;
+	uint64_t lens[S__INDEX_STATS_LENS]; /* lengths in [2^i, 2^(i + 1)) */
+	uint64_t filtered; /* misses answered by the filter */
+	uint64_t chained; /* compressed nodes replaced by chain fragments */
+};
+
+struct s__index_bench {
+	struct s__index *(*open)(void); /* s__index_open(), or a variant */
+	uint64_t keys;
+	uint64_t min_len; /* key lengths are in [min_len, max_len] */
+	uint64_t max_len;
+	int zipf; /* lengths are Zipf distributed, s = 1, rather than uniform */
+	uint64_t prefix; /* leading bytes shared by every key, below 64 */
+	int threads; /* concurrent lookup threads */
+	uint64_t seed;
+	int collapse; /* s__index_collapse() after compressing */
+	uint64_t filter; /* s__index_filter() bits per key, or 0 for none */
+	const char *log; /* s__index_log() pathname, not yet existing, or NULL */
+};
+
+typedef int (*s__index_fnc_t)(void *ctx,
+			      int rewind,
+			      const char **key,
+			      uint64_t *record);
+
+typedef int (*s__index_prefix_fnc_t)(void *ctx,
+				     const char *key,
+				     uint64_t *record);
+
 /**
  * Opens an empty index and returns an s__index_t handle for subsequent use.
  *
@@ -21,6 +79,69 @@ typedef struct s__index *s__index_t;
 
 s__index_t s__index_open(void);
 
+/**
+ * Opens an empty index whose mutable keys live in an adaptive radix tree
+ * rather than the default AVL tree, and returns an s__index_t handle for
+ * subsequent use. The radix tree branches on one key byte per node, with
+ * 4 to 256 children, and stores only the bytes that distinguish keys.
+ *
+ * @return  An s__index_t handle or NULL on error
+ *
+ * NOTES: Lookups cost one node per distinguishing key byte, rather than a
+ *        key comparison per level, favoring large indexes of short keys.
+ *        Every other function behaves the same on either kind of index.
+ */
+
+s__index_t s__index_open_art(void);
+
+/**
+ * Opens an empty index whose mutable keys are front coded, and returns an
+ * s__index_t handle for subsequent use. Each key stores only the suffix
+ * that follows the prefix it shares with its neighbor in key order; the
+ * shared prefix is kept once and referenced by every key that uses it.
+ *
+ * @return  An s__index_t handle or NULL on error
+ *
+ * NOTES: Favors keys with long common prefixes, such as URLs or paths, at
+ *        the cost of a little extra work per key comparison. Every other
+ *        function behaves the same on either kind of index.
+ */
+
+s__index_t s__index_open_coded(void);
+
+/**
+ * Opens an empty index for integer keys, and returns an s__index_t handle
+ * for subsequent use. Its mutable keys are stored as eight big-endian
+ * bytes, and compared as 64-bit integers rather than as strings.
+ *
+ * @return  An s__index_t handle or NULL on error
+ *
+ * NOTES: Keys are written by s__index_update_u64() and its companions. The
+ *        string functions see each key as its ten byte encoding, and no
+ *        other string may be added. Compressed keys are strings as usual.
+ */
+
+s__index_t s__index_open_u64(void);
+
+/**
+ * Sets the size of the record associated with each key, which defaults to
+ * eight bytes. Records are stored inline, next to their node in the
+ * mutable trees and back to back in the compressed index, in trie level
+ * order by the rank of their valid bit, so a lookup returns a pointer to
+ * the payload itself.
+ *
+ * @index        A valid, empty and uncompressed index handle
+ * @record_size  A multiple of eight, up to S__INDEX_MAX_RECORD_SIZE
+ * @return       0 on success or -1 on error
+ *
+ * NOTES: Every record pointer returned by the index, and every record set
+ *        by an s__index_fnc_t source, then spans record_size bytes, as do
+ *        the entries of the records array given to s__index_load(). The
+ *        size is saved with the index and restored by s__index_mmap().
+ */
+
+int s__index_record_size(s__index_t index, uint64_t record_size);
+
 /**
  * Closes the index and frees resources associated with it.
  *
@@ -37,6 +158,41 @@ void s__index_close(s__index_t index);
 
 void s__index_truncate(s__index_t index);
 
+/**
+ * Loads a batch of keys into an empty index, sorting them in parallel and
+ * building a balanced tree in a single pass, rather than inserting them
+ * one at a time. When a key repeats, its last record in the batch wins.
+ *
+ * @index    A valid, empty and uncompressed index handle
+ * @keys     An array of n non-empty keys, in any order
+ * @records  An array of n records, or NULL for zero records, each of the
+ *           index's record size
+ * @n        The number of keys
+ * @return   0 on success or -1 on error
+ *
+ * NOTES: Beyond the index, sorting takes 32 bytes per key.
+ */
+
+int s__index_load(s__index_t index,
+		  const char **keys,
+		  const uint64_t *records,
+		  uint64_t n);
+
+/**
+ * Loads an empty index from a source of keys in sorted order, building a
+ * balanced tree in a single pass.
+ *
+ * @index   A valid, empty and uncompressed index handle
+ * @fnc     A source, as for s__index_compress_sorted()
+ * @ctx     An opaque pointer passed to fnc
+ * @return  0 on success or -1 on error
+ *
+ * NOTES: Keys must be non-empty, unique and in strictly ascending order.
+ *        The source is traversed twice, first to count the keys.
+ */
+
+int s__index_load_sorted(s__index_t index, s__index_fnc_t fnc, void *ctx);
+
 /**
  * Compresses the index, reducing its memory footprint.
  *
@@ -44,12 +200,158 @@ void s__index_truncate(s__index_t index);
  * @return  0 on success or -1 on error
  *
  * NOTES: A compressed index is no longer able to accept new keys,
- *        effectively turning into a read-only dictionary. However, records
- *        associated with existing keys can still be modified.
+ *        effectively turning into a read-only dictionary, until
+ *        s__index_delta() is called. However, records associated with
+ *        existing keys can still be modified.
  */
 
 int s__index_compress(s__index_t index);
 
+/**
+ * Compresses an empty index directly from a source of keys in sorted
+ * order, such as an external sorted file, without first loading them.
+ *
+ * @index   A valid and empty index handle
+ * @fnc     A source, called with rewind set to restart from the first key,
+ *          and otherwise to advance; it sets key and record and returns 1,
+ *          or returns 0 past the last key, or -1 on error
+ * @ctx     An opaque pointer passed to fnc
+ * @return  0 on success or -1 on error
+ *
+ * NOTES: Keys must be non-empty, unique and in strictly ascending order.
+ *        The source is traversed three times, and the key it returns need
+ *        only remain valid until the next call. Beyond the compressed
+ *        index, memory use is one byte per trie sibling group and two
+ *        counters per trie level.
+ */
+
+int s__index_compress_sorted(s__index_t index, s__index_fnc_t fnc, void *ctx);
+
+/**
+ * Makes a compressed index accept new keys again. New keys are added to a
+ * small mutable delta, searched ahead of the compressed index, and a
+ * background thread merges the delta into a fresh compressed index each
+ * time it reaches threshold keys. The writer hands the delta over at its
+ * next call to s__index_update(), and swaps in the fresh index atomically
+ * at a later call to s__index_update() or s__index_merge().
+ *
+ * @index      A valid and compressed index handle
+ * @threshold  The number of delta keys that triggers a merge
+ * @return     0 on success or -1 on error
+ *
+ * NOTES: Readers and the writer proceed while a merge runs. From then on,
+ *        a record pointer remains valid until the next call by the writer
+ *        to s__index_update() or s__index_merge(), which may free the
+ *        replaced index under it. The writer can rely on this; reader
+ *        threads cannot, and must read records by s__index_find_copy()
+ *        or s__index_find_value() rather than through the pointers of
+ *        s__index_find(), s__index_next() and s__index_prev().
+ */
+
+int s__index_delta(s__index_t index, uint64_t threshold);
+
+/**
+ * Merges the delta into a fresh compressed index and swaps it in, waiting
+ * for any merge in progress. Called by the writer.
+ *
+ * @index   A valid index handle, after s__index_delta()
+ * @return  0 on success or -1 on error
+ */
+
+int s__index_merge(s__index_t index);
+
+/**
+ * Collapses the chains of the compressed index, and of every one that
+ * later replaces it. A chain is a run of at least four trie nodes, each
+ * the only child of the one before, as in the unique tail of a key. The
+ * trie is rebuilt with each chain replaced by its first node, followed
+ * by the key bytes of the others as one fragment, which s__index_find()
+ * and s__index_find_batch() compare with the key in a single step, so
+ * lookups cost one step per branching node rather than per key byte.
+ *
+ * @index   A valid index handle
+ * @return  0 on success or -1 on error
+ *
+ * NOTES: Called by the writer. With a delta, readers may proceed and the
+ *        collapsed index is installed under them, as a merge is. Without
+ *        one, the compressed index is replaced, and requires exclusive
+ *        access. A fragment byte costs less than the node it replaces,
+ *        while ordered traversals still step through fragments byte by
+ *        byte, each step locating the fragment by rank and select. The
+ *        chained field of s__index_stats counts the nodes replaced.
+ *        Chains are saved, and restored by s__index_mmap().
+ */
+
+int s__index_collapse(s__index_t index);
+
+/**
+ * Puts a blocked Bloom filter of every compressed key in front of the
+ * compressed index, and of every one that later replaces it. A lookup
+ * hashes the key and tests bits within a single cache line of the filter,
+ * answering most misses without descending the trie.
+ *
+ * @index         A valid index handle
+ * @bits_per_key  The filter size, up to S__INDEX_MAX_FILTER_BITS; each
+ *                further bit divides false positives by about 1.6
+ * @return        0 on success or -1 on error
+ *
+ * NOTES: Called by the writer. Readers may proceed meanwhile. A compressed
+ *        index keeps the filter it was first given. The filtered field of
+ *        s__index_stats() counts the misses it answered since then. The
+ *        filter is not saved, and is rebuilt after s__index_mmap() by
+ *        calling this function again.
+ */
+
+int s__index_filter(s__index_t index, uint64_t bits_per_key);
+
+/**
+ * Bit packs the records of the compressed index, and of every one that
+ * later replaces it. Each record is stored as its offset from the smallest
+ * record, in as many bits as the largest offset needs, and is read back in
+ * constant time. By default, records stay uncompressed, 8 bytes each.
+ *
+ * @index   A valid index handle, without a delta, of 8 byte records
+ * @return  0 on success or -1 on error
+ *
+ * NOTES: A packed compressed index hands out record values, not pointers:
+ *        it is read by s__index_find_copy(), s__index_find_value() and
+ *        cursors, whose records are copies that the caller can read but
+ *        not update. Neither s__index_find(), s__index_find_batch(),
+ *        s__index_next(), s__index_prev() nor s__index_delta() may be
+ *        called on it, as asserted. Keys can still be removed. Requires
+ *        exclusive access.
+ */
+
+int s__index_pack(s__index_t index);
+
+/**
+ * Saves a compressed index to a file, in a position-independent layout
+ * that can be mapped back into memory by s__index_mmap().
+ *
+ * @index     A valid and compressed index handle
+ * @pathname  The pathname of the file to create or overwrite
+ * @return    0 on success or -1 on error
+ *
+ * NOTES: With a delta, the delta is first merged by s__index_merge().
+ *        Removed keys are dropped from the saved index.
+ */
+
+int s__index_save(s__index_t index, const char *pathname);
+
+/**
+ * Opens a compressed index previously saved by s__index_save(). The file
+ * is memory-mapped as is, without parsing or copying, allowing its pages
+ * to be shared across processes.
+ *
+ * @pathname  The pathname of an index file
+ * @return    An s__index_t handle or NULL on error
+ *
+ * NOTES: The mapping is private. Records modified by the caller are
+ *        copy-on-write and never written back to the file.
+ */
+
+s__index_t s__index_mmap(const char *pathname);
+
 /**
  * Updates the index by adding a new key or returning the record associated
  * with an existing key.
@@ -58,10 +360,105 @@ int s__index_compress(s__index_t index);
  * @key     A non-empty key
  * @return  A pointer to a record, which can be modified by the caller,
  *          or NULL in case of an error
+ *
+ * NOTES: One writer thread may call s__index_update() and s__index_remove()
+ *        while any number of reader threads call s__index_find(),
+ *        s__index_find_copy(), s__index_find_value(),
+ *        s__index_find_batch(), s__index_next(), s__index_prev() and
+ *        s__index_items(). Readers run lock-free, retrying when they
+ *        overlap an update. All other functions, including cursors,
+ *        require exclusive access, as does s__index_remove() on a
+ *        compressed index without s__index_delta(). The record of a new
+ *        key reads zero until the writer stores to it, and such stores
+ *        are not ordered with respect to readers. A compressed index
+ *        accepts new keys only after s__index_delta().
  */
 
 uint64_t *s__index_update(s__index_t index, const char *key);
 
+/**
+ * Removes a key and its record from the index.
+ *
+ * @index   A valid index handle
+ * @key     A non-empty key
+ * @return  1 if the key was removed, 0 if it does not exist, or -1 on error
+ *
+ * NOTES: The space of a key removed from an uncompressed index is reused
+ *        by later keys. A compressed index marks the key removed and is
+ *        rebuilt without its removed keys once they exceed an eighth of
+ *        its keys. Without s__index_delta(), the rebuild happens within
+ *        the call and frees the index under any reader, so every removal
+ *        from a compressed index requires exclusive access. With a delta,
+ *        the background thread rebuilds the index, readers may proceed,
+ *        and the call waits for any merge in progress.
+ */
+
+int s__index_remove(s__index_t index, const char *key);
+
+/**
+ * Makes the index durable by logging its mutations to a file. The index is
+ * first recovered from the file and its last snapshot, if any; thereafter,
+ * s__index_put() and s__index_remove() append each mutation to the log. A
+ * background thread, idle while nothing is appended, wakes at the first
+ * mutation and a millisecond later writes and syncs every mutation
+ * appended by then, as one batch. A mutation is durable once
+ * s__index_commit() returns, or once the next batch is synced.
+ *
+ * @index     A valid and empty index handle
+ * @pathname  The pathname of the log, created if missing; the snapshot is
+ *            kept at the same pathname followed by ".snap"
+ * @snapshot  The log size, in bytes, at which s__index_snapshot() is
+ *            called, or 0 for never
+ * @return    0 on success or -1 on error
+ *
+ * NOTES: Recovery maps the log and verifies its batches in parallel, and
+ *        stops at the first torn or corrupt batch, as a crash leaves
+ *        behind; a log written with another record size is an error. A
+ *        recovered log is then folded into a new snapshot. Records stored
+ *        through pointers, including those of s__index_update(), and keys
+ *        added by s__index_load() are not logged. s__index_truncate()
+ *        empties the log and deletes the snapshot.
+ */
+
+int s__index_log(s__index_t index, const char *pathname, uint64_t snapshot);
+
+/**
+ * Adds a key or replaces its record, as s__index_update() followed by a
+ * copy of record, and logs the mutation when the index has a log.
+ *
+ * @index   A valid index handle
+ * @key     A non-empty key
+ * @record  The record, of the index's record size
+ * @return  0 on success or -1 on error
+ */
+
+int s__index_put(s__index_t index, const char *key, const uint64_t *record);
+
+/**
+ * Waits until every mutation logged so far is durable.
+ *
+ * @index   A valid index handle
+ * @return  0 on success or -1 on error
+ *
+ * NOTES: Returns at once for an index without a log.
+ */
+
+int s__index_commit(s__index_t index);
+
+/**
+ * Writes every key and record of the index to a new snapshot, replacing
+ * the last one once durable, and empties the log.
+ *
+ * @index   A valid index handle with a log
+ * @return  0 on success or -1 on error
+ *
+ * NOTES: Runs in the writer, as it does within s__index_put() and
+ *        s__index_remove() once the log reaches its snapshot size.
+ *        Readers may proceed concurrently.
+ */
+
+int s__index_snapshot(s__index_t index);
+
 /**
  * Finds and returns the record associated with the key.
  *
@@ -73,6 +470,54 @@ uint64_t *s__index_update(s__index_t index, const char *key);
 
 uint64_t *s__index_find(s__index_t index, const char *key);
 
+/**
+ * Finds the record associated with the key and copies it out.
+ *
+ * @index   A valid index handle
+ * @key     A non-empty key
+ * @record  Receives the record_size bytes of the record, if the key exists;
+ *          aligned for a uint64_t
+ * @return  1 if the key exists, otherwise 0
+ *
+ * NOTES: May be called by readers, as s__index_find(). The copy is taken
+ *        while the record is still reachable, so unlike a pointer it stays
+ *        valid after the writer installs a merged index.
+ */
+
+int s__index_find_copy(s__index_t index, const char *key, void *record);
+
+/**
+ * Finds the record associated with the key and copies its first 8 bytes,
+ * on a packed index as on any other.
+ *
+ * @index   A valid index handle
+ * @key     A non-empty key
+ * @value   Receives the record, if the key exists
+ * @return  1 if the key exists, otherwise 0
+ *
+ * NOTES: May be called by readers, as s__index_find_copy().
+ */
+
+int s__index_find_value(s__index_t index, const char *key, uint64_t *value);
+
+/**
+ * Finds the records associated with a batch of keys. Lookups advance in
+ * lockstep and prefetch their next node, overlapping the cache misses of
+ * independent keys.
+ *
+ * @index    A valid index handle
+ * @keys     An array of n non-empty keys
+ * @n        The number of keys
+ * @records  An array of n entries, receiving a pointer to the record of
+ *           each key, which can be modified by the caller, or NULL if
+ *           the key does not exist
+ */
+
+void s__index_find_batch(s__index_t index,
+			 const char **keys,
+			 uint64_t n,
+			 uint64_t **records);
+
 /**
  * Finds and returns the record associated with the lexicographical
  * successor of key.
@@ -105,6 +550,74 @@ uint64_t *s__index_next(s__index_t succinct, const char *key, char *okey);
 
 uint64_t *s__index_prev(s__index_t succinct, const char *key, char *okey);
 
+/**
+ * Binary key variants of s__index_update(), s__index_remove(),
+ * s__index_find(), s__index_next() and s__index_prev(). A key is len bytes
+ * long, and may hold any byte, including '\0'. Keys are ordered as by
+ * memcmp(), a key before its extensions.
+ *
+ * @index   A valid index handle
+ * @key     A key of 1 to S__INDEX_MAX_KEY_LEN_N bytes, or NULL (next and
+ *          prev only)
+ * @len     The key length in bytes
+ * @okey    Receives the key found, of up to S__INDEX_MAX_KEY_LEN_N bytes
+ * @olen    Receives the length of the key found
+ *
+ * NOTES: A binary key is stored as a string with its bytes 0x00 and 0x01
+ *        escaped to two bytes each, so that keys of random bytes grow by
+ *        under 1%, rather than doubling when written in hexadecimal. An
+ *        index should hold keys written by one family of functions: the
+ *        string functions see the escaped form of a binary key.
+ */
+
+uint64_t *s__index_update_n(s__index_t index, const void *key, uint64_t len);
+
+int s__index_remove_n(s__index_t index, const void *key, uint64_t len);
+
+uint64_t *s__index_find_n(s__index_t index, const void *key, uint64_t len);
+
+uint64_t *s__index_next_n(s__index_t index,
+			  const void *key,
+			  uint64_t len,
+			  void *okey,
+			  uint64_t *olen);
+
+uint64_t *s__index_prev_n(s__index_t index,
+			  const void *key,
+			  uint64_t len,
+			  void *okey,
+			  uint64_t *olen);
+
+/**
+ * Integer key variants of s__index_update(), s__index_remove(),
+ * s__index_find(), s__index_next() and s__index_prev(). Keys are ordered
+ * by value.
+ *
+ * @index   A valid index handle
+ * @key     A key, or for next and prev, a pointer to a key or NULL
+ * @okey    Receives the key found
+ *
+ * NOTES: An integer key is stored as a fixed ten byte string, seven bits
+ *        per byte, most significant first, against 16 bytes in
+ *        hexadecimal, except in the mutable keys of s__index_open_u64(),
+ *        stored as eight big-endian bytes. An index should hold keys
+ *        written by one family of functions.
+ */
+
+uint64_t *s__index_update_u64(s__index_t index, uint64_t key);
+
+int s__index_remove_u64(s__index_t index, uint64_t key);
+
+uint64_t *s__index_find_u64(s__index_t index, uint64_t key);
+
+uint64_t *s__index_next_u64(s__index_t index,
+			    const uint64_t *key,
+			    uint64_t *okey);
+
+uint64_t *s__index_prev_u64(s__index_t index,
+			    const uint64_t *key,
+			    uint64_t *okey);
+
 /**
  * Returns the number of indexed items.
  *
@@ -114,6 +627,176 @@ uint64_t *s__index_prev(s__index_t succinct, const char *key, char *okey);
 
 uint64_t s__index_items(s__index_t index);
 
+/**
+ * Opens a cursor for ordered range scans over the index. Consecutive
+ * steps resume from the saved traversal path rather than restarting at
+ * the root, so scanning N adjacent keys costs O(N + depth).
+ *
+ * @index   A valid index handle
+ * @return  An s__index_cursor_t handle or NULL on error
+ *
+ * NOTES: A cursor is invalidated by any update, compression or truncation
+ *        of its index. It may be repositioned with s__index_cursor_seek().
+ */
+
+s__index_cursor_t s__index_cursor_open(s__index_t index);
+
+/**
+ * Closes the cursor and frees resources associated with it.
+ *
+ * @cursor  A valid cursor handle or NULL
+ */
+
+void s__index_cursor_close(s__index_cursor_t cursor);
+
+/**
+ * Positions the cursor on the smallest key that is greater than or equal
+ * to key, optionally bounding subsequent forward steps.
+ *
+ * @cursor  A valid cursor handle
+ * @key     A key, or NULL for the smallest key
+ * @hi      An inclusive upper bound for the scan, or NULL for none
+ * @return  A pointer to a record, which can be modified by the caller,
+ *          or NULL if no such key exists or in case of an error
+ */
+
+uint64_t *s__index_cursor_seek(s__index_cursor_t cursor,
+			       const char *key,
+			       const char *hi);
+
+/**
+ * Advances the cursor to the lexicographical successor of its key.
+ *
+ * @cursor  A valid cursor handle
+ * @return  A pointer to a record, which can be modified by the caller,
+ *          or NULL once the cursor moves past the last key or the bound
+ */
+
+uint64_t *s__index_cursor_next(s__index_cursor_t cursor);
+
+/**
+ * Moves the cursor to the lexicographical predecessor of its key.
+ *
+ * @cursor  A valid cursor handle
+ * @return  A pointer to a record, which can be modified by the caller,
+ *          or NULL once the cursor moves past the first key
+ */
+
+uint64_t *s__index_cursor_prev(s__index_cursor_t cursor);
+
+/**
+ * Returns the key at the current cursor position.
+ *
+ * @cursor  A valid cursor handle, positioned on a key
+ * @return  The key, valid until the next cursor operation
+ */
+
+const char *s__index_cursor_key(s__index_cursor_t cursor);
+
+/**
+ * Calls fnc for every key that starts with prefix, in lexicographical
+ * order. The search descends to the prefix once, and stops at the first
+ * key past it.
+ *
+ * @index   A valid index handle
+ * @prefix  A prefix, or an empty string for every key
+ * @fnc     A function receiving each key and a pointer to its record,
+ *          which can be modified, returning 0 to continue, a positive
+ *          value to stop, or a negative value on error
+ * @ctx     An opaque pointer passed to fnc
+ * @return  0 on success or -1 on error
+ *
+ * NOTES: Requires the same access as cursors.
+ */
+
+int s__index_prefix_iterate(s__index_t index,
+			    const char *prefix,
+			    s__index_prefix_fnc_t fnc,
+			    void *ctx);
+
+/**
+ * Counts the keys that start with prefix.
+ *
+ * @index   A valid index handle
+ * @prefix  A prefix, or an empty string for every key
+ * @count   Receives the number of keys
+ * @return  0 on success or -1 on error
+ *
+ * NOTES: A compressed index answers from the subtree size of the prefix
+ *        in time proportional to its length. The first count computes
+ *        the subtree sizes, at 8 bytes per trie node. Otherwise, the keys
+ *        are enumerated as by s__index_prefix_iterate().
+ */
+
+int s__index_prefix_count(s__index_t index,
+			  const char *prefix,
+			  uint64_t *count);
+
+/**
+ * Calls fnc for every key within max_edits insertions, deletions and
+ * substitutions of a byte from key, in lexicographical order. The search
+ * walks the keys once, as a depth first walk of a trie, extending a row of
+ * edit distances per key byte and skipping every key below a prefix that
+ * already exceeds the budget.
+ *
+ * @index      A valid index handle
+ * @key        The query, or an empty string
+ * @max_edits  The edit budget, up to S__INDEX_MAX_EDITS
+ * @fnc        A function receiving each key and a pointer to its record,
+ *             as for s__index_prefix_iterate()
+ * @ctx        An opaque pointer passed to fnc
+ * @return     0 on success or -1 on error
+ *
+ * NOTES: Requires the same access as cursors. Beyond the cursor, memory
+ *        use is 2 * max_edits + 1 counters of 8 bytes per byte of the
+ *        query and of the budget. Binary and integer keys are compared in
+ *        their encoded form.
+ */
+
+int s__index_fuzzy(s__index_t index,
+		   const char *key,
+		   uint64_t max_edits,
+		   s__index_prefix_fnc_t fnc,
+		   void *ctx);
+
+/**
+ * Reports the memory and shape of the index: bytes used and allocated,
+ * node counts and lookup depths, per component and overall, and a
+ * histogram of key lengths.
+ *
+ * @index   A valid index handle
+ * @stats   Receives the statistics
+ * @return  0 on success or -1 on error
+ *
+ * NOTES: Called by the writer. Walks every node and enumerates every key,
+ *        so it costs time proportional to the size of the index. With a
+ *        delta, the mutable keys include a tree awaiting merge, and a
+ *        merge in progress is waited for. The last bucket of the key
+ *        length histogram holds all longer keys.
+ */
+
+int s__index_stats(s__index_t index, struct s__index_stats *stats);
+
+/**
+ * Runs a benchmark on a fresh index, writing a JSON report to file. The
+ * keys are random lowercase strings, of uniform lengths or of Zipf lengths
+ * that make the shortest most frequent, inserted by one writer and then
+ * found, missed, and searched for their next and previous neighbors by
+ * concurrent threads, before and after compression. Each phase reports
+ * its throughput and the mean, p50, p99, p999 and maximum latency of its
+ * operations, and memory use is reported after each layer is built.
+ *
+ * @config  The benchmark configuration
+ * @file    The file receiving the report
+ * @return  0 on success or -1 on error
+ *
+ * NOTES: Latencies are kept in histograms with 16 buckets per power of
+ *        two, within about 6% of the true value, and include the cost of
+ *        reading a monotonic clock twice per operation.
+ */
+
+int s__index_bench(const struct s__index_bench *config, FILE *file);
+
 /**
  * Runs the built-in self test.
  *
@@ -0,0 +1,1445 @@
+/**
+ * Copyright (c) Tony Givargis, 2020-2025
+ *
+ * s_index_art.c
+ */
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "s_index_art.h"
+
+#define PREFIX 9 /* prefix bytes stored in a node */
+#define BATCH 16 /* lookups interleaved by s__index_art_find_batch() */
+#define ALIGN 8 /* node size granularity */
+#define CHUNK_SIZE 1048576 /* node space per allocation */
+#define CLASSES S__DUP(S__INDEX_ART_MAX_RECORD_SIZE +			\
+		       S__INDEX_ART_MAX_KEY_LEN,			\
+		       ALIGN)
+
+/**
+ * Adaptive radix tree: inner nodes branch on one key byte and grow from 4
+ * to 16, 48 and 256 children as needed. The terminating '\0' is a key
+ * byte, so no key is a prefix of another and every key ends at a leaf.
+ * A node stores the length of the bytes shared by all keys below it, but
+ * only the first PREFIX of them; lookups skip the rest and confirm the
+ * key at the leaf, while ordered searches read the rest off the smallest
+ * leaf below the node. Leaf pointers are tagged in their lowest bit.
+ *
+ * Node space is managed as in s_index_tree.c: nodes and leaves take a
+ * multiple of ALIGN bytes from chunks, a leaf holding its key preceded by
+ * its record of record_size bytes. Freed space is type stable: a replaced
+ * node is reused only by the next node of its type, linked through the
+ * tail of its prefix, and a removed leaf only by the next leaf of its
+ * size class, linked through its record. A stale reader therefore always
+ * finds a node of the type it reads, whose type, count and children are
+ * never overwritten by a link, or a leaf whose last byte is zero. It may
+ * observe a node in transition, but every loop of a reader is bounded by
+ * the length of its key or the maximum key length, and its result is
+ * discarded by the caller's version check.
+ */
+
+enum type { NODE4, NODE16, NODE48, NODE256 };
+
+struct node {
+	uint32_t prefix_len;
+	uint16_t count;
+	uint8_t type;
+	uint8_t prefix[PREFIX];
+};
+
+struct node4 {
+	struct node node;
+	uint8_t keys[4];
+	void *children[4];
+};
+
+struct node16 {
+	struct node node;
+	uint8_t keys[16];
+	void *children[16];
+};
+
+struct node48 {
+	struct node node;
+	uint8_t index[256]; /* child slot + 1, or 0 */
+	void *children[48];
+};
+
+struct node256 {
+	struct node node;
+	void *children[256];
+};
+
+struct leaf {
+	char key[1];
+};
+
+struct s__index_art {
+	uint64_t record_size;
+	void *chunk;
+	uint64_t size;
+	uint64_t used; /* bytes of live nodes and leaves */
+	void **free; /* free leaves, per size class */
+	struct node *nodes[4]; /* free nodes, per type */
+	/*-*/
+	void *root;
+	uint64_t items;
+};
+
+struct step {
+	struct node *node;
+	int c;
+};
+
+struct s__index_art_cursor {
+	struct s__index_art *art;
+	struct leaf *leaf;
+	uint64_t depth;
+	uint64_t size;
+	struct step *path;
+};
+
+static int
+is_leaf(const void *p)
+{
+	return ((size_t)p & 1) ? 1 : 0;
+}
+
+static struct leaf *
+get_leaf(void *p)
+{
+	return (struct leaf *)((char *)p - 1);
+}
+
+static void *
+tag(struct leaf *leaf)
+{
+	return (char *)leaf + 1;
+}
+
+static const char *
+get_key(const struct leaf *leaf)
+{
+	return leaf->key;
+}
+
+static uint64_t *
+get_record(const struct s__index_art *art, const struct leaf *leaf)
+{
+	return (uint64_t *)((char *)leaf - art->record_size);
+}
+
+static uint64_t
+leaf_size(const struct s__index_art *art, const char *key)
+{
+	return S__DUP(art->record_size + s__strlen(key) + 1, ALIGN) * ALIGN;
+}
+
+static uint64_t
+node_size(int type)
+{
+	switch (type) {
+	case NODE4: return S__DUP(sizeof (struct node4), ALIGN) * ALIGN;
+	case NODE16: return S__DUP(sizeof (struct node16), ALIGN) * ALIGN;
+	case NODE48: return S__DUP(sizeof (struct node48), ALIGN) * ALIGN;
+	}
+	return S__DUP(sizeof (struct node256), ALIGN) * ALIGN;
+}
+
+static int
+check(struct s__index_art *art, uint64_t n)
+{
+	void *chunk;
+	uint64_t m;
+
+	if (!art->free) {
+		m = (CLASSES + 1) * sizeof (art->free[0]);
+		if (!(art->free = s__malloc(m))) {
+			S__TRACE(0);
+			return -1;
+		}
+		memset(art->free, 0, m);
+	}
+	if (!art->chunk || (CHUNK_SIZE < (art->size + n))) {
+		if (!(chunk = s__malloc(CHUNK_SIZE))) {
+			S__TRACE(0);
+			return -1;
+		}
+		(*((void **)chunk)) = art->chunk; /* link */
+		art->size = sizeof (void *);
+		art->chunk = chunk;
+	}
+	return 0;
+}
+
+static void *
+alloc(struct s__index_art *art, uint64_t n)
+{
+	void *p;
+
+	p = (char *)art->chunk + art->size;
+	art->size += n;
+	art->used += n;
+	return p;
+}
+
+static void *
+link_(struct node *node)
+{
+	return node->prefix + PREFIX - sizeof (void *);
+}
+
+static struct node *
+new_node(struct s__index_art *art, int type)
+{
+	const uint64_t N = node_size(type);
+	struct node *node;
+
+	if (!(node = art->nodes[type])) {
+		node = alloc(art, N);
+		memset(node, 0, (size_t)N);
+		node->type = (uint8_t)type;
+		return node;
+	}
+	memcpy(&art->nodes[type], link_(node), sizeof (void *));
+	art->used += N;
+	node->prefix_len = 0;
+	node->count = 0;
+	memset(node->prefix, 0, PREFIX);
+	memset(node + 1, 0, (size_t)(N - sizeof (struct node)));
+	return node;
+}
+
+static void
+release_node(struct s__index_art *art, struct node *node)
+{
+	memcpy(link_(node), &art->nodes[node->type], sizeof (void *));
+	art->nodes[node->type] = node;
+	art->used -= node_size(node->type);
+}
+
+static struct leaf *
+new_leaf(struct s__index_art *art, const char *key)
+{
+	const uint64_t N = leaf_size(art, key);
+	struct leaf *leaf;
+	char *p;
+
+	if ((p = art->free[N / ALIGN])) {
+		art->free[N / ALIGN] = (*((void **)p));
+		art->used += N;
+	}
+	else {
+		p = alloc(art, N);
+	}
+	p[N - 1] = '\0';
+	memset(p, 0, (size_t)art->record_size);
+	leaf = (struct leaf *)(p + art->record_size);
+	memcpy(leaf->key, key, s__strlen(key) + 1);
+	return leaf;
+}
+
+static void
+release_leaf(struct s__index_art *art, struct leaf *leaf)
+{
+	const uint64_t N = leaf_size(art, get_key(leaf));
+	void *p;
+
+	p = get_record(art, leaf);
+	(*((void **)p)) = art->free[N / ALIGN];
+	art->free[N / ALIGN] = p;
+	art->used -= N;
+}
+
+static int
+count(const struct node *node, int max)
+{
+	return S__MIN((int)node->count, max);
+}
+
+static void **
+find_child(struct node *node, int c)
+{
+	struct node4 *node4;
+	struct node16 *node16;
+	struct node48 *node48;
+	struct node256 *node256;
+#ifdef __SSE2__
+	__m128i x;
+#endif
+	unsigned mask;
+	int i;
+
+	switch (node->type) {
+	case NODE4:
+		node4 = (struct node4 *)node;
+		for (i=0; i<count(node, 4); ++i) {
+			if (c == node4->keys[i]) {
+				return &node4->children[i];
+			}
+		}
+		break;
+	case NODE16:
+		node16 = (struct node16 *)node;
+#ifdef __SSE2__
+		x = _mm_loadu_si128((__m128i *)node16->keys);
+		x = _mm_cmpeq_epi8(_mm_set1_epi8((char)c), x);
+		mask = (unsigned)_mm_movemask_epi8(x);
+		mask &= (1u << count(node, 16)) - 1;
+		if (mask) {
+			return &node16->children[s__ctz(mask)];
+		}
+#else
+		mask = 0;
+		for (i=0; i<count(node, 16); ++i) {
+			if (c == node16->keys[i]) {
+				return &node16->children[i];
+			}
+		}
+		(void)mask;
+#endif
+		break;
+	case NODE48:
+		node48 = (struct node48 *)node;
+		if ((i = node48->index[c]) && (48 >= i)) {
+			return &node48->children[i - 1];
+		}
+		break;
+	case NODE256:
+		node256 = (struct node256 *)node;
+		if (node256->children[c]) {
+			return &node256->children[c];
+		}
+		break;
+	}
+	return NULL;
+}
+
+/**
+ * Returns the child with the smallest key byte above c, or NULL, setting
+ * b to its byte. Sorted node kinds scan their keys, the others their
+ * byte range.
+ */
+
+static void *
+next_child(struct node *node, int c, int *b)
+{
+	struct node4 *node4;
+	struct node16 *node16;
+	struct node48 *node48;
+	struct node256 *node256;
+	int i;
+
+	switch (node->type) {
+	case NODE4:
+		node4 = (struct node4 *)node;
+		for (i=0; i<count(node, 4); ++i) {
+			if (c < node4->keys[i]) {
+				(*b) = node4->keys[i];
+				return node4->children[i];
+			}
+		}
+		break;
+	case NODE16:
+		node16 = (struct node16 *)node;
+		for (i=0; i<count(node, 16); ++i) {
+			if (c < node16->keys[i]) {
+				(*b) = node16->keys[i];
+				return node16->children[i];
+			}
+		}
+		break;
+	case NODE48:
+		node48 = (struct node48 *)node;
+		for (i=c+1; i<256; ++i) {
+			if (node48->index[i] && (48 >= node48->index[i])) {
+				(*b) = i;
+				return node48->children[node48->index[i] - 1];
+			}
+		}
+		break;
+	case NODE256:
+		node256 = (struct node256 *)node;
+		for (i=c+1; i<256; ++i) {
+			if (node256->children[i]) {
+				(*b) = i;
+				return node256->children[i];
+			}
+		}
+		break;
+	}
+	return NULL;
+}
+
+static void *
+prev_child(struct node *node, int c, int *b)
+{
+	struct node4 *node4;
+	struct node16 *node16;
+	struct node48 *node48;
+	struct node256 *node256;
+	int i;
+
+	switch (node->type) {
+	case NODE4:
+		node4 = (struct node4 *)node;
+		for (i=count(node, 4)-1; i>=0; --i) {
+			if (c > node4->keys[i]) {
+				(*b) = node4->keys[i];
+				return node4->children[i];
+			}
+		}
+		break;
+	case NODE16:
+		node16 = (struct node16 *)node;
+		for (i=count(node, 16)-1; i>=0; --i) {
+			if (c > node16->keys[i]) {
+				(*b) = node16->keys[i];
+				return node16->children[i];
+			}
+		}
+		break;
+	case NODE48:
+		node48 = (struct node48 *)node;
+		for (i=c-1; i>=0; --i) {
+			if (node48->index[i] && (48 >= node48->index[i])) {
+				(*b) = i;
+				return node48->children[node48->index[i] - 1];
+			}
+		}
+		break;
+	case NODE256:
+		node256 = (struct node256 *)node;
+		for (i=c-1; i>=0; --i) {
+			if (node256->children[i]) {
+				(*b) = i;
+				return node256->children[i];
+			}
+		}
+		break;
+	}
+	return NULL;
+}
+
+static struct leaf *
+min_leaf(void *p)
+{
+	uint64_t i;
+	int b;
+
+	for (i=0; p && !is_leaf(p) && (i<S__INDEX_ART_MAX_KEY_LEN); ++i) {
+		p = next_child((struct node *)p, -1, &b);
+	}
+	return (p && is_leaf(p)) ? get_leaf(p) : NULL;
+}
+
+static struct leaf *
+max_leaf(void *p)
+{
+	uint64_t i;
+	int b;
+
+	for (i=0; p && !is_leaf(p) && (i<S__INDEX_ART_MAX_KEY_LEN); ++i) {
+		p = prev_child((struct node *)p, 256, &b);
+	}
+	return (p && is_leaf(p)) ? get_leaf(p) : NULL;
+}
+
+/**
+ * Compares the prefix of node, at depth, with key, returning the number
+ * of matching bytes and setting d to the sign of the first mismatch, from
+ * the viewpoint of the prefix. Bytes past PREFIX come from the smallest
+ * leaf below the node.
+ */
+
+static uint64_t
+match(struct node *node, const char *key, uint64_t len, uint64_t depth, int *d)
+{
+	const unsigned char *k, *l;
+	struct leaf *leaf;
+	uint64_t i, n;
+
+	(*d) = 0;
+	k = (const unsigned char *)key;
+	for (i=0; i<S__MIN(node->prefix_len, PREFIX); ++i) {
+		if (depth + i > len) {
+			(*d) = 1;
+			return i;
+		}
+		if (node->prefix[i] != k[depth + i]) {
+			(*d) = (node->prefix[i] > k[depth + i]) ? 1 : -1;
+			return i;
+		}
+	}
+	if (node->prefix_len <= PREFIX) {
+		return i;
+	}
+	if (!(leaf = min_leaf(node))) {
+		(*d) = -1;
+		return 0;
+	}
+	l = (const unsigned char *)get_key(leaf);
+	n = s__strlen(get_key(leaf));
+	for (; i<node->prefix_len; ++i) {
+		if ((depth + i > len) || (depth + i > n)) {
+			(*d) = -1;
+			return i;
+		}
+		if (l[depth + i] != k[depth + i]) {
+			(*d) = (l[depth + i] > k[depth + i]) ? 1 : -1;
+			return i;
+		}
+	}
+	return i;
+}
+
+/**
+ * Writer side. s__index_art_update() and s__index_art_remove() reserve
+ * chunk space for one leaf and the largest node up front, so that none
+ * of the allocations below can fail midway. A node replacing another is
+ * fully initialized before a release fence and its publication.
+ */
+
+static void
+add_sorted(uint8_t *keys, void **children, int n, int c, void *child)
+{
+	int i;
+
+	for (i=n; (0 < i) && (c < keys[i - 1]); --i) {
+		keys[i] = keys[i - 1];
+		children[i] = children[i - 1];
+	}
+	keys[i] = (uint8_t)c;
+	children[i] = child;
+}
+
+static void
+add_child(struct s__index_art *art,
+	  void **ref,
+	  struct node *node,
+	  int c,
+	  void *child)
+{
+	struct node4 *node4;
+	struct node16 *node16, *new16;
+	struct node48 *node48, *new48;
+	struct node256 *node256, *new256;
+	void *replacement;
+	int i;
+
+	switch (node->type) {
+	case NODE4:
+		node4 = (struct node4 *)node;
+		if (4 > node->count) {
+			add_sorted(node4->keys,
+				   node4->children,
+				   node->count,
+				   c,
+				   child);
+			node->count += 1;
+			return;
+		}
+		new16 = (struct node16 *)new_node(art, NODE16);
+		memcpy(&new16->node, node, sizeof (struct node));
+		new16->node.type = NODE16;
+		memcpy(new16->keys, node4->keys, 4);
+		memcpy(new16->children, node4->children, 4 * sizeof (void *));
+		add_sorted(new16->keys, new16->children, 4, c, child);
+		new16->node.count = 5;
+		replacement = new16;
+		break;
+	case NODE16:
+		node16 = (struct node16 *)node;
+		if (16 > node->count) {
+			add_sorted(node16->keys,
+				   node16->children,
+				   node->count,
+				   c,
+				   child);
+			node->count += 1;
+			return;
+		}
+		new48 = (struct node48 *)new_node(art, NODE48);
+		memcpy(&new48->node, node, sizeof (struct node));
+		new48->node.type = NODE48;
+		for (i=0; i<16; ++i) {
+			new48->children[i] = node16->children[i];
+			new48->index[node16->keys[i]] = (uint8_t)(i + 1);
+		}
+		new48->children[16] = child;
+		new48->index[c] = 17;
+		new48->node.count = 17;
+		replacement = new48;
+		break;
+	case NODE48:
+		node48 = (struct node48 *)node;
+		if (48 > node->count) {
+			for (i=0; node48->children[i]; ++i);
+			node48->children[i] = child;
+			s__fence_release();
+			node48->index[c] = (uint8_t)(i + 1);
+			node->count += 1;
+			return;
+		}
+		new256 = (struct node256 *)new_node(art, NODE256);
+		memcpy(&new256->node, node, sizeof (struct node));
+		new256->node.type = NODE256;
+		for (i=0; i<256; ++i) {
+			if (node48->index[i]) {
+				new256->children[i] =
+					node48->children[node48->index[i] - 1];
+			}
+		}
+		new256->children[c] = child;
+		new256->node.count = 49;
+		replacement = new256;
+		break;
+	default:
+		node256 = (struct node256 *)node;
+		s__fence_release();
+		node256->children[c] = child;
+		node->count += 1;
+		return;
+	}
+	s__fence_release();
+	(*ref) = replacement;
+	release_node(art, node);
+}
+
+static void
+collapse(struct s__index_art *art, void **ref, struct node4 *node4)
+{
+	uint8_t prefix[PREFIX];
+	struct node *child;
+	uint64_t n;
+
+	child = node4->children[0];
+	if (!is_leaf(child)) {
+		n = S__MIN(node4->node.prefix_len, PREFIX);
+		memcpy(prefix, node4->node.prefix, (size_t)n);
+		if (PREFIX > n) {
+			prefix[n++] = node4->keys[0];
+		}
+		if (PREFIX > n) {
+			memcpy(prefix + n,
+			       child->prefix,
+			       (size_t)S__MIN(child->prefix_len, PREFIX - n));
+		}
+		memcpy(child->prefix, prefix, PREFIX);
+		child->prefix_len += node4->node.prefix_len + 1;
+	}
+	s__fence_release();
+	(*ref) = child;
+	release_node(art, &node4->node);
+}
+
+static void
+remove_child(struct s__index_art *art,
+	     void **ref,
+	     struct node *node,
+	     int c,
+	     void **slot)
+{
+	struct node4 *node4, *new4;
+	struct node16 *node16, *new16;
+	struct node48 *node48, *new48;
+	struct node256 *node256;
+	void *replacement;
+	int i, j;
+
+	switch (node->type) {
+	case NODE4:
+		node4 = (struct node4 *)node;
+		for (i=(int)(slot - node4->children); i<node->count-1; ++i) {
+			node4->keys[i] = node4->keys[i + 1];
+			node4->children[i] = node4->children[i + 1];
+		}
+		if (1 == --node->count) {
+			collapse(art, ref, node4);
+		}
+		return;
+	case NODE16:
+		node16 = (struct node16 *)node;
+		for (i=(int)(slot - node16->children); i<node->count-1; ++i) {
+			node16->keys[i] = node16->keys[i + 1];
+			node16->children[i] = node16->children[i + 1];
+		}
+		if (3 < --node->count) {
+			return;
+		}
+		new4 = (struct node4 *)new_node(art, NODE4);
+		memcpy(&new4->node, node, sizeof (struct node));
+		new4->node.type = NODE4;
+		memcpy(new4->keys, node16->keys, 3);
+		memcpy(new4->children, node16->children, 3 * sizeof (void *));
+		replacement = new4;
+		break;
+	case NODE48:
+		node48 = (struct node48 *)node;
+		node48->index[c] = 0;
+		node48->children[slot - node48->children] = NULL;
+		if (12 < --node->count) {
+			return;
+		}
+		new16 = (struct node16 *)new_node(art, NODE16);
+		memcpy(&new16->node, node, sizeof (struct node));
+		new16->node.type = NODE16;
+		for (i=0, j=0; i<256; ++i) {
+			if (node48->index[i]) {
+				new16->keys[j] = (uint8_t)i;
+				new16->children[j++] =
+					node48->children[node48->index[i] - 1];
+			}
+		}
+		replacement = new16;
+		break;
+	default:
+		node256 = (struct node256 *)node;
+		node256->children[c] = NULL;
+		if (37 < --node->count) {
+			return;
+		}
+		new48 = (struct node48 *)new_node(art, NODE48);
+		memcpy(&new48->node, node, sizeof (struct node));
+		new48->node.type = NODE48;
+		for (i=0, j=0; i<256; ++i) {
+			if (node256->children[i]) {
+				new48->children[j] = node256->children[i];
+				new48->index[i] = (uint8_t)++j;
+			}
+		}
+		replacement = new48;
+		break;
+	}
+	s__fence_release();
+	(*ref) = replacement;
+	release_node(art, node);
+}
+
+static void
+set_prefix(struct node *node, const char *key, uint64_t n)
+{
+	node->prefix_len = (uint32_t)n;
+	memcpy(node->prefix, key, (size_t)S__MIN(n, PREFIX));
+}
+
+static uint64_t *
+split_leaf(struct s__index_art *art,
+	   void **ref,
+	   const char *key,
+	   uint64_t depth)
+{
+	struct node4 *node4;
+	struct leaf *leaf;
+	const char *okey;
+	uint64_t i;
+
+	okey = get_key(get_leaf(*ref));
+	for (i=depth; okey[i] == key[i]; ++i);
+	node4 = (struct node4 *)new_node(art, NODE4);
+	set_prefix(&node4->node, key + depth, i - depth);
+	leaf = new_leaf(art, key);
+	add_sorted(node4->keys, node4->children, 0, (uint8_t)okey[i], *ref);
+	add_sorted(node4->keys,
+		   node4->children,
+		   1,
+		   (uint8_t)key[i],
+		   tag(leaf));
+	node4->node.count = 2;
+	s__fence_release();
+	(*ref) = node4;
+	return get_record(art, leaf);
+}
+
+static uint64_t *
+split_node(struct s__index_art *art,
+	   void **ref,
+	   const char *key,
+	   uint64_t depth,
+	   uint64_t m)
+{
+	struct node4 *node4;
+	struct node *node;
+	struct leaf *leaf;
+	const char *l;
+	int b;
+
+	node = (struct node *)(*ref);
+	node4 = (struct node4 *)new_node(art, NODE4);
+	set_prefix(&node4->node, key + depth, m);
+	if (node->prefix_len <= PREFIX) {
+		b = node->prefix[m];
+		node->prefix_len -= (uint32_t)(m + 1);
+		memmove(node->prefix,
+			node->prefix + m + 1,
+			(size_t)node->prefix_len);
+	}
+	else {
+		l = get_key(min_leaf(node));
+		b = (uint8_t)l[depth + m];
+		node->prefix_len -= (uint32_t)(m + 1);
+		memcpy(node->prefix,
+		       l + depth + m + 1,
+		       (size_t)S__MIN(node->prefix_len, PREFIX));
+	}
+	leaf = new_leaf(art, key);
+	add_sorted(node4->keys, node4->children, 0, b, node);
+	add_sorted(node4->keys,
+		   node4->children,
+		   1,
+		   (uint8_t)key[depth + m],
+		   tag(leaf));
+	node4->node.count = 2;
+	s__fence_release();
+	(*ref) = node4;
+	return get_record(art, leaf);
+}
+
+static uint64_t *
+update(struct s__index_art *art, const char *key)
+{
+	const uint64_t LEN = s__strlen(key);
+	struct leaf *leaf;
+	struct node *node;
+	uint64_t depth, m;
+	void **ref, **slot;
+	int c, d;
+
+	depth = 0;
+	ref = &art->root;
+	for (;;) {
+		if (!(*ref)) {
+			leaf = new_leaf(art, key);
+			s__fence_release();
+			(*ref) = tag(leaf);
+			art->items += 1;
+			return get_record(art, leaf);
+		}
+		if (is_leaf(*ref)) {
+			leaf = get_leaf(*ref);
+			if (!strcmp(get_key(leaf), key)) {
+				return get_record(art, leaf);
+			}
+			art->items += 1;
+			return split_leaf(art, ref, key, depth);
+		}
+		node = (struct node *)(*ref);
+		if (node->prefix_len) {
+			m = match(node, key, LEN, depth, &d);
+			if (m < node->prefix_len) {
+				art->items += 1;
+				return split_node(art, ref, key, depth, m);
+			}
+			depth += node->prefix_len;
+		}
+		c = (uint8_t)key[depth];
+		if (!(slot = find_child(node, c))) {
+			leaf = new_leaf(art, key);
+			add_child(art, ref, node, c, tag(leaf));
+			art->items += 1;
+			return get_record(art, leaf);
+		}
+		ref = slot;
+		++depth;
+	}
+}
+
+/**
+ * Descends from ref along key, skipping the unstored part of prefixes,
+ * and returns the slot holding the only candidate leaf, or NULL. The node
+ * holding that slot, the slot referencing the node and the key byte of
+ * the leaf are left in node_, ref_ and c.
+ */
+
+static void **
+descend(void **ref,
+	const char *key,
+	struct node **node_,
+	void ***ref_,
+	int *c)
+{
+	const uint64_t LEN = s__strlen(key);
+	struct node *node;
+	uint64_t depth, i;
+	void **slot;
+
+	depth = 0;
+	(*node_) = NULL;
+	(*ref_) = NULL;
+	slot = ref;
+	while ((*slot) && !is_leaf(*slot)) {
+		node = (struct node *)(*slot);
+		for (i=0; i<S__MIN(node->prefix_len, PREFIX); ++i) {
+			if ((depth + i > LEN) ||
+			    (node->prefix[i] != (uint8_t)key[depth + i])) {
+				return NULL;
+			}
+		}
+		depth += node->prefix_len;
+		if (depth > LEN) {
+			return NULL;
+		}
+		(*ref_) = slot;
+		(*node_) = node;
+		(*c) = (uint8_t)key[depth];
+		if (!(slot = find_child(node, (*c)))) {
+			return NULL;
+		}
+		++depth;
+	}
+	return (*slot) ? slot : NULL;
+}
+
+/**
+ * Ordered search: descends along key, remembering the nearest sibling
+ * subtree on the side of the search. When the path diverges from key,
+ * the answer is the extreme leaf of the diverging subtree or of that
+ * sibling.
+ */
+
+static struct leaf *
+search(struct s__index_art *art, const char *key, int next)
+{
+	const uint64_t LEN = s__strlen(key);
+	struct leaf *leaf;
+	struct node *node;
+	uint64_t depth, m;
+	void *p, *q, *sibling, **slot;
+	int d, b;
+
+	depth = 0;
+	sibling = NULL;
+	p = art->root;
+	while (p) {
+		if (is_leaf(p)) {
+			leaf = get_leaf(p);
+			d = strcmp(get_key(leaf), key);
+			if (next ? (0 < d) : (0 > d)) {
+				return leaf;
+			}
+			break;
+		}
+		node = (struct node *)p;
+		if (node->prefix_len) {
+			m = match(node, key, LEN, depth, &d);
+			if (m < node->prefix_len) {
+				if (next ? (0 < d) : (0 > d)) {
+					return next ? min_leaf(p) : max_leaf(p);
+				}
+				break;
+			}
+			depth += node->prefix_len;
+		}
+		if (depth > LEN) {
+			return NULL;
+		}
+		if (next) {
+			q = next_child(node, (uint8_t)key[depth], &b);
+		}
+		else {
+			q = prev_child(node, (uint8_t)key[depth], &b);
+		}
+		sibling = q ? q : sibling;
+		if (!(slot = find_child(node, (uint8_t)key[depth]))) {
+			break;
+		}
+		p = (*slot);
+		++depth;
+	}
+	return next ? min_leaf(sibling) : max_leaf(sibling);
+}
+
+static uint64_t *
+copy(const struct s__index_art *art, struct leaf *leaf, char *okey)
+{
+	if (!leaf) {
+		return NULL;
+	}
+	memcpy(okey, get_key(leaf), s__strlen(get_key(leaf)) + 1);
+	return get_record(art, leaf);
+}
+
+static int
+push(struct s__index_art_cursor *cursor, struct node *node, int c)
+{
+	struct step *path;
+	uint64_t size;
+
+	if (cursor->depth == cursor->size) {
+		size = S__MAX(cursor->size * 2, 64);
+		path = s__realloc(cursor->path, size * sizeof (path[0]));
+		if (!path) {
+			S__TRACE(0);
+			return -1;
+		}
+		cursor->path = path;
+		cursor->size = size;
+	}
+	cursor->path[cursor->depth].node = node;
+	cursor->path[cursor->depth].c = c;
+	cursor->depth += 1;
+	return 0;
+}
+
+static uint64_t *
+extreme(struct s__index_art_cursor *cursor, void *p, int next)
+{
+	struct node *node;
+	int b;
+
+	b = 0;
+	while (!is_leaf(p)) {
+		node = (struct node *)p;
+		if (next) {
+			p = next_child(node, -1, &b);
+		}
+		else {
+			p = prev_child(node, 256, &b);
+		}
+		if (!p || push(cursor, node, b)) {
+			cursor->depth = 0;
+			S__TRACE(S__ERR_SOFTWARE);
+			return NULL;
+		}
+	}
+	cursor->leaf = get_leaf(p);
+	return get_record(cursor->art, cursor->leaf);
+}
+
+static uint64_t *
+step(struct s__index_art_cursor *cursor, int next)
+{
+	struct step *top;
+	void *p;
+	int b;
+
+	cursor->leaf = NULL;
+	while (cursor->depth) {
+		top = &cursor->path[cursor->depth - 1];
+		if (next) {
+			p = next_child(top->node, top->c, &b);
+		}
+		else {
+			p = prev_child(top->node, top->c, &b);
+		}
+		if (p) {
+			top->c = b;
+			return extreme(cursor, p, next);
+		}
+		--cursor->depth;
+	}
+	return NULL;
+}
+
+static void
+stats(void *p, uint64_t depth, struct s__index_art_stats *stats_)
+{
+	void *child;
+	int b;
+
+	stats_->nodes += 1;
+	if (is_leaf(p)) {
+		stats_->keys += 1;
+		stats_->depths += depth;
+		stats_->max_depth = S__MAX(stats_->max_depth, depth);
+		return;
+	}
+	b = -1;
+	while ((child = next_child((struct node *)p, b, &b))) {
+		stats(child, depth + 1, stats_);
+	}
+}
+
+int
+s__index_art_iterate(s__index_art_t art, s__index_art_fnc_t fnc, void *ctx)
+{
+	s__index_art_cursor_t cursor;
+	uint64_t *record;
+
+	assert( art );
+	assert( fnc );
+
+	if (!(cursor = s__index_art_cursor_open(art))) {
+		S__TRACE(0);
+		return -1;
+	}
+	record = s__index_art_cursor_seek(cursor, NULL);
+	while (record) {
+		if (fnc(ctx, s__index_art_cursor_key(cursor), record)) {
+			s__index_art_cursor_close(cursor);
+			S__TRACE(0);
+			return -1;
+		}
+		record = s__index_art_cursor_next(cursor);
+	}
+	s__index_art_cursor_close(cursor);
+	return 0;
+}
+
+s__index_art_t
+s__index_art_open(uint64_t record_size)
+{
+	struct s__index_art *art;
+
+	assert( record_size && !(record_size % sizeof (uint64_t)) );
+	assert( S__INDEX_ART_MAX_RECORD_SIZE >= record_size );
+
+	if (!(art = s__malloc(sizeof (struct s__index_art)))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memset(art, 0, sizeof (struct s__index_art));
+	art->record_size = record_size;
+	return art;
+}
+
+void
+s__index_art_close(s__index_art_t art)
+{
+	if (art) {
+		s__index_art_truncate(art);
+	}
+	S__FREE(art);
+}
+
+void
+s__index_art_truncate(s__index_art_t art)
+{
+	uint64_t record_size;
+	void *chunk;
+
+	if (art) {
+		record_size = art->record_size;
+		while ((chunk = art->chunk)) {
+			art->chunk = (*((void **)chunk));
+			S__FREE(chunk);
+		}
+		S__FREE(art->free);
+		memset(art, 0, sizeof (struct s__index_art));
+		art->record_size = record_size;
+	}
+}
+
+uint64_t *
+s__index_art_update(s__index_art_t art, const char *key)
+{
+	assert( art );
+	assert( s__strlen(key) );
+	assert( S__INDEX_ART_MAX_KEY_LEN > s__strlen(key) );
+
+	if (check(art, leaf_size(art, key) + node_size(NODE256))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	return update(art, key);
+}
+
+int
+s__index_art_remove(s__index_art_t art, const char *key)
+{
+	struct node *node;
+	struct leaf *leaf;
+	void **slot, **ref;
+	int c;
+
+	assert( art );
+	assert( s__strlen(key) );
+
+	if (check(art, node_size(NODE256))) {
+		S__TRACE(0);
+		return -1;
+	}
+	c = 0;
+	if (!(slot = descend(&art->root, key, &node, &ref, &c)) ||
+	    strcmp(get_key((leaf = get_leaf(*slot))), key)) {
+		return 0;
+	}
+	if (!node) {
+		art->root = NULL;
+	}
+	else {
+		remove_child(art, ref, node, c, slot);
+	}
+	art->items -= 1;
+	release_leaf(art, leaf);
+	return 1;
+}
+
+uint64_t *
+s__index_art_find(s__index_art_t art, const char *key)
+{
+	struct node *node;
+	void **slot, **ref;
+	int c;
+
+	assert( art );
+	assert( s__strlen(key) );
+
+	if ((slot = descend(&art->root, key, &node, &ref, &c)) &&
+	    !strcmp(get_key(get_leaf(*slot)), key)) {
+		return get_record(art, get_leaf(*slot));
+	}
+	return NULL;
+}
+
+/**
+ * Batch lookup: up to BATCH descents take turns, each moving one node
+ * down and prefetching the next, so that the cache misses of the batch
+ * overlap instead of following one another.
+ */
+
+static void *
+advance(const struct node *node,
+	const char *key,
+	uint64_t len,
+	uint64_t *depth)
+{
+	void **slot;
+	uint64_t i;
+
+	for (i=0; i<S__MIN(node->prefix_len, PREFIX); ++i) {
+		if ((((*depth) + i) > len) ||
+		    (node->prefix[i] != (uint8_t)key[(*depth) + i])) {
+			return NULL;
+		}
+	}
+	(*depth) += node->prefix_len;
+	if ((*depth) > len) {
+		return NULL;
+	}
+	slot = find_child((struct node *)node, (uint8_t)key[(*depth)++]);
+	return slot ? (*slot) : NULL;
+}
+
+static uint64_t *
+found(const struct s__index_art *art, void *p, const char *key)
+{
+	const struct leaf *leaf;
+
+	leaf = get_leaf(p);
+	return strcmp(get_key(leaf), key) ? NULL : get_record(art, leaf);
+}
+
+void
+s__index_art_find_batch(s__index_art_t art,
+			const char **keys,
+			uint64_t n,
+			uint64_t **records)
+{
+	uint64_t i, j, m, active, lens[BATCH], depths[BATCH];
+	void *p[BATCH];
+
+	assert( art );
+	assert( !n || (keys && records) );
+
+	for (i=0; i<n; i+=m, keys+=m, records+=m) {
+		m = S__MIN(BATCH, n - i);
+		active = 0;
+		for (j=0; j<m; ++j) {
+			records[j] = NULL;
+			lens[j] = s__strlen(keys[j]);
+			depths[j] = 0;
+			if ((p[j] = art->root)) {
+				++active;
+			}
+		}
+		while (active) {
+			for (j=0; j<m; ++j) {
+				if (!p[j]) {
+					continue;
+				}
+				if (is_leaf(p[j])) {
+					records[j] = found(art, p[j], keys[j]);
+					p[j] = NULL;
+				}
+				else {
+					p[j] = advance((struct node *)p[j],
+						       keys[j],
+						       lens[j],
+						       &depths[j]);
+				}
+				if (!p[j]) {
+					--active;
+				}
+				else if (is_leaf(p[j])) {
+					s__prefetch(get_leaf(p[j]));
+				}
+				else {
+					s__prefetch(p[j]);
+				}
+			}
+		}
+	}
+}
+
+uint64_t *
+s__index_art_next(s__index_art_t art, const char *key, char *okey)
+{
+	assert( art );
+	assert( okey );
+
+	if (s__strlen(key)) {
+		return copy(art, search(art, key, 1), okey);
+	}
+	return copy(art, min_leaf(art->root), okey);
+}
+
+uint64_t *
+s__index_art_prev(s__index_art_t art, const char *key, char *okey)
+{
+	assert( art );
+	assert( okey );
+
+	if (s__strlen(key)) {
+		return copy(art, search(art, key, 0), okey);
+	}
+	return copy(art, max_leaf(art->root), okey);
+}
+
+void
+s__index_art_stats(s__index_art_t art, struct s__index_art_stats *stats_)
+{
+	void *chunk;
+
+	assert( art );
+	assert( stats_ );
+
+	memset(stats_, 0, sizeof (struct s__index_art_stats));
+	for (chunk=art->chunk; chunk; chunk=(*((void **)chunk))) {
+		stats_->allocated += CHUNK_SIZE;
+	}
+	if (art->free) {
+		stats_->allocated += (CLASSES + 1) * sizeof (art->free[0]);
+	}
+	stats_->used = art->used;
+	if (art->root) {
+		stats(art->root, 1, stats_);
+	}
+}
+
+uint64_t
+s__index_art_items(s__index_art_t art)
+{
+	assert( art );
+
+	return art->items;
+}
+
+s__index_art_cursor_t
+s__index_art_cursor_open(s__index_art_t art)
+{
+	struct s__index_art_cursor *cursor;
+
+	assert( art );
+
+	if (!(cursor = s__malloc(sizeof (struct s__index_art_cursor)))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memset(cursor, 0, sizeof (struct s__index_art_cursor));
+	cursor->art = art;
+	return cursor;
+}
+
+void
+s__index_art_cursor_close(s__index_art_cursor_t cursor)
+{
+	if (cursor) {
+		S__FREE(cursor->path);
+		memset(cursor, 0, sizeof (struct s__index_art_cursor));
+	}
+	S__FREE(cursor);
+}
+
+uint64_t *
+s__index_art_cursor_seek(s__index_art_cursor_t cursor, const char *key)
+{
+	const uint64_t LEN = s__strlen(key);
+	struct leaf *leaf;
+	struct node *node;
+	uint64_t depth, m;
+	void *p, **slot;
+	int d, b;
+
+	assert( cursor );
+
+	cursor->leaf = NULL;
+	cursor->depth = 0;
+	if (!(p = cursor->art->root)) {
+		return NULL;
+	}
+	if (!LEN) {
+		return extreme(cursor, p, 1);
+	}
+	depth = 0;
+	for (;;) {
+		if (is_leaf(p)) {
+			leaf = get_leaf(p);
+			if (0 <= strcmp(get_key(leaf), key)) {
+				cursor->leaf = leaf;
+				return get_record(cursor->art, leaf);
+			}
+			return step(cursor, 1);
+		}
+		node = (struct node *)p;
+		if (node->prefix_len) {
+			m = match(node, key, LEN, depth, &d);
+			if (m < node->prefix_len) {
+				return (0 < d) ? extreme(cursor, p, 1) :
+					step(cursor, 1);
+			}
+			depth += node->prefix_len;
+		}
+		b = (uint8_t)key[depth];
+		if (!(slot = find_child(node, b))) {
+			if (!(p = next_child(node, b, &b))) {
+				return step(cursor, 1);
+			}
+		}
+		else {
+			p = (*slot);
+		}
+		if (push(cursor, node, b)) {
+			cursor->depth = 0;
+			S__TRACE(0);
+			return NULL;
+		}
+		if (!slot) {
+			return extreme(cursor, p, 1);
+		}
+		++depth;
+	}
+}
+
+uint64_t *
+s__index_art_cursor_next(s__index_art_cursor_t cursor)
+{
+	assert( cursor );
+
+	if (!cursor->leaf) {
+		return NULL;
+	}
+	return step(cursor, 1);
+}
+
+uint64_t *
+s__index_art_cursor_prev(s__index_art_cursor_t cursor)
+{
+	assert( cursor );
+
+	if (!cursor->leaf) {
+		return NULL;
+	}
+	return step(cursor, 0);
+}
+
+const char *
+s__index_art_cursor_key(s__index_art_cursor_t cursor)
+{
+	assert( cursor );
+	assert( cursor->leaf );
+
+	return get_key(cursor->leaf);
+}
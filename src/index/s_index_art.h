@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) Tony Givargis, 2020-2025
+ *
+ * s_index_art.h
+ */
+
+#ifndef _S_INDEX_ART_H_
+#define _S_INDEX_ART_H_
+
+#include "../utils/s_utils.h"
+
+#define S__INDEX_ART_MAX_KEY_LEN 32767 /* including '\0' */
+
+#define S__INDEX_ART_MAX_RECORD_SIZE 256 /* bytes */
+
+typedef struct s__index_art *s__index_art_t;
+
+typedef struct s__index_art_cursor *s__index_art_cursor_t;
+
+struct s__index_art_stats {
+	uint64_t used; /* bytes */
+	uint64_t allocated; /* bytes */
+	uint64_t nodes; /* including leaves */
+	uint64_t keys;
+	uint64_t depths; /* sum of key depths, in nodes */
+	uint64_t max_depth;
+};
+
+typedef int (*s__index_art_fnc_t)(void *ctx,
+				  const char *key,
+				  const uint64_t *record);
+
+int s__index_art_iterate(s__index_art_t art,
+			 s__index_art_fnc_t fnc,
+			 void *ctx);
+
+s__index_art_t s__index_art_open(uint64_t record_size);
+
+void s__index_art_close(s__index_art_t art);
+
+void s__index_art_truncate(s__index_art_t art);
+
+uint64_t *s__index_art_update(s__index_art_t art, const char *key);
+
+int s__index_art_remove(s__index_art_t art, const char *key);
+
+uint64_t *s__index_art_find(s__index_art_t art, const char *key);
+
+void s__index_art_find_batch(s__index_art_t art,
+			     const char **keys,
+			     uint64_t n,
+			     uint64_t **records);
+
+uint64_t *s__index_art_next(s__index_art_t art,
+			    const char *key,
+			    char *okey);
+
+uint64_t *s__index_art_prev(s__index_art_t art,
+			    const char *key,
+			    char *okey);
+
+void s__index_art_stats(s__index_art_t art, struct s__index_art_stats *stats);
+
+uint64_t s__index_art_items(s__index_art_t art);
+
+s__index_art_cursor_t s__index_art_cursor_open(s__index_art_t art);
+
+void s__index_art_cursor_close(s__index_art_cursor_t cursor);
+
+uint64_t *s__index_art_cursor_seek(s__index_art_cursor_t cursor,
+				   const char *key);
+
+uint64_t *s__index_art_cursor_next(s__index_art_cursor_t cursor);
+
+uint64_t *s__index_art_cursor_prev(s__index_art_cursor_t cursor);
+
+const char *s__index_art_cursor_key(s__index_art_cursor_t cursor);
+
+#endif /* _S_INDEX_ART_H_ */
@@ -0,0 +1,534 @@
+/**
+ * Copyright (c) Tony Givargis, 2020-2025
+ *
+ * s_index_bench.c
+ */
+
+#include "s_index.h"
+
+#define SUB 16 /* histogram buckets per power of two */
+#define BUCKETS (64 * SUB)
+#define MAX_THREADS 256
+
+/**
+ * Latency histogram: values below SUB have a bucket each, and every power
+ * of two above is split into SUB buckets, bounding the relative error of
+ * a reported percentile by 1 / SUB. Latencies are measured per operation
+ * with a monotonic nanosecond clock, whose overhead (tens of nanoseconds)
+ * they include.
+ */
+
+struct histogram {
+	uint64_t counts[BUCKETS];
+	uint64_t n;
+	uint64_t sum;
+	uint64_t max;
+};
+
+enum op { INSERT, FIND_HIT, FIND_MISS, NEXT, PREV };
+
+struct bench {
+	const struct s__index_bench *config;
+	s__index_t index;
+	char **keys;
+	char **misses;
+	uint64_t n;
+	FILE *file;
+	int phases;
+};
+
+struct worker {
+	struct bench *bench;
+	struct histogram histogram;
+	enum op op;
+	int k; /* of n workers */
+	int n;
+	int error;
+};
+
+static uint64_t
+xorshift(uint64_t *seed)
+{
+	(*seed) ^= (*seed) << 13;
+	(*seed) ^= (*seed) >> 7;
+	(*seed) ^= (*seed) << 17;
+	return (*seed);
+}
+
+static int
+bucket(uint64_t ns)
+{
+	int e;
+
+	if (SUB > ns) {
+		return (int)ns;
+	}
+	e = 63 - __builtin_clzll(ns);
+	return (e - 3) * SUB + (int)((ns >> (e - 4)) - SUB);
+}
+
+static uint64_t
+ceiling(int i)
+{
+	int e;
+
+	if (SUB > i) {
+		return (uint64_t)i;
+	}
+	e = i / SUB + 3;
+	return (((uint64_t)(SUB + i % SUB + 1)) << (e - 4)) - 1;
+}
+
+static void
+sample(struct histogram *histogram, uint64_t ns)
+{
+	histogram->counts[bucket(ns)] += 1;
+	histogram->n += 1;
+	histogram->sum += ns;
+	histogram->max = S__MAX(histogram->max, ns);
+}
+
+static void
+merge(struct histogram *a, const struct histogram *b)
+{
+	int i;
+
+	for (i=0; i<BUCKETS; ++i) {
+		a->counts[i] += b->counts[i];
+	}
+	a->n += b->n;
+	a->sum += b->sum;
+	a->max = S__MAX(a->max, b->max);
+}
+
+static uint64_t
+percentile(const struct histogram *histogram, double p)
+{
+	uint64_t n, rank;
+	int i;
+
+	if (!histogram->n) {
+		return 0;
+	}
+	rank = (uint64_t)(p * (double)histogram->n);
+	rank = S__MAX(rank, 1);
+	for (i=0, n=0; i<BUCKETS; ++i) {
+		if (rank <= (n += histogram->counts[i])) {
+			return S__MIN(ceiling(i), histogram->max);
+		}
+	}
+	return histogram->max;
+}
+
+static const char *
+tree_name(const struct s__index_bench *config)
+{
+	if (config->open == s__index_open_art) {
+		return "art";
+	}
+	if (config->open == s__index_open_coded) {
+		return "coded";
+	}
+	return "avl";
+}
+
+static void
+report(struct bench *bench,
+       const char *phase,
+       const char *layer,
+       int threads,
+       uint64_t ns,
+       const struct histogram *histogram)
+{
+	double seconds;
+
+	seconds = 1e-9 * (double)ns;
+	fprintf(bench->file,
+		"%s\n    {\"phase\": \"%s\", \"layer\": \"%s\", "
+		"\"threads\": %d, \"ops\": %lu, \"seconds\": %.6f, "
+		"\"ops_per_sec\": %.1f,\n"
+		"     \"latency_ns\": {\"mean\": %.1f, \"p50\": %lu, "
+		"\"p99\": %lu, \"p999\": %lu, \"max\": %lu}}",
+		bench->phases++ ? "," : "",
+		phase,
+		layer,
+		threads,
+		(unsigned long)histogram->n,
+		seconds,
+		(0.0 < seconds) ? (double)histogram->n / seconds : 0.0,
+		histogram->n ? (double)histogram->sum / histogram->n : 0.0,
+		(unsigned long)percentile(histogram, 0.50),
+		(unsigned long)percentile(histogram, 0.99),
+		(unsigned long)percentile(histogram, 0.999),
+		(unsigned long)histogram->max);
+}
+
+/**
+ * Key lengths: uniform over [min_len, max_len], or Zipf with s = 1, the
+ * k-th shortest length drawn with a probability proportional to 1 / k,
+ * by a search of the cumulative distribution.
+ */
+
+static double
+uniform(uint64_t *seed)
+{
+	return (double)(xorshift(seed) >> 11) / 9007199254740992.0; /* 2^53 */
+}
+
+static uint64_t
+length(const struct s__index_bench *config, const double *cdf, uint64_t *seed)
+{
+	uint64_t k, m;
+	double u;
+
+	m = config->max_len - config->min_len + 1;
+	if (!config->zipf) {
+		return config->min_len + xorshift(seed) % m;
+	}
+	u = uniform(seed) * cdf[m - 1];
+	for (k=0; (k<(m - 1)) && (cdf[k] <= u); ++k);
+	return config->min_len + k;
+}
+
+static int
+generate(struct bench *bench)
+{
+	const struct s__index_bench *config;
+	uint64_t i, j, m, n, seed;
+	char prefix[64];
+	double *cdf;
+
+	config = bench->config;
+	seed = config->seed ? config->seed : 1;
+	m = config->max_len - config->min_len + 1;
+	if (!(cdf = s__malloc(m * sizeof (cdf[0])))) {
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0; i<m; ++i) {
+		cdf[i] = (i ? cdf[i - 1] : 0.0) + 1.0 / (double)(i + 1);
+	}
+	n = config->keys * sizeof (bench->keys[0]);
+	if (!(bench->keys = s__malloc(n)) ||
+	    !(bench->misses = s__malloc(n))) {
+		S__FREE(cdf);
+		S__TRACE(0);
+		return -1;
+	}
+	memset(bench->keys, 0, n);
+	memset(bench->misses, 0, n);
+	for (i=0; i<config->prefix; ++i) {
+		prefix[i] = (char)('a' + xorshift(&seed) % 26);
+	}
+	for (i=0; i<config->keys; ++i) {
+		n = length(config, cdf, &seed);
+		n = S__MAX(n, config->prefix + 1);
+		if (!(bench->keys[i] = s__malloc(n + 1)) ||
+		    !(bench->misses[i] = s__malloc(n + 1))) {
+			S__FREE(cdf);
+			S__TRACE(0);
+			return -1;
+		}
+		memcpy(bench->keys[i], prefix, (size_t)config->prefix);
+		for (j=config->prefix; j<n; ++j) {
+			bench->keys[i][j] = 'a' + (char)(xorshift(&seed) % 26);
+		}
+		bench->keys[i][n] = '\0';
+		memcpy(bench->misses[i], bench->keys[i], (size_t)n + 1);
+		bench->misses[i][n - 1] = '{'; /* never generated */
+	}
+	S__FREE(cdf);
+	bench->n = config->keys;
+	return 0;
+}
+
+static void
+_worker_(void *ctx)
+{
+	char okey[S__INDEX_MAX_KEY_LEN];
+	struct worker *worker;
+	s__index_t index;
+	uint64_t i, t, *record;
+	char **keys, **misses;
+
+	worker = (struct worker *)ctx;
+	index = worker->bench->index;
+	keys = worker->bench->keys;
+	misses = worker->bench->misses;
+	for (i=worker->k; i<worker->bench->n; i+=worker->n) {
+		t = s__time_ns();
+		switch (worker->op) {
+		case INSERT:
+			if (worker->bench->config->log) {
+				record = s__index_put(index, keys[i], &i)
+					? NULL
+					: &t;
+			}
+			else if ((record = s__index_update(index, keys[i]))) {
+				(*record) = i;
+			}
+			break;
+		case FIND_HIT:
+			record = s__index_find(index, keys[i]);
+			break;
+		case FIND_MISS:
+			record = s__index_find(index, misses[i]) ? NULL : &t;
+			break;
+		case NEXT:
+			record = s__index_next(index, misses[i], okey);
+			record = record ? record : &t; /* past the largest */
+			break;
+		default:
+			record = s__index_prev(index, misses[i], okey);
+			break;
+		}
+		sample(&worker->histogram, s__time_ns() - t);
+		if (!record) {
+			worker->error = -1;
+			S__TRACE(S__ERR_SOFTWARE);
+			return;
+		}
+	}
+}
+
+static int
+run(struct bench *bench, const char *phase, const char *layer, enum op op)
+{
+	s__thread_t threads[MAX_THREADS];
+	struct histogram *histogram;
+	struct worker *workers;
+	uint64_t t;
+	int k, n, e;
+
+	n = (INSERT == op) ? 1 : bench->config->threads;
+	if (!(workers = s__malloc(n * sizeof (workers[0])))) {
+		S__TRACE(0);
+		return -1;
+	}
+	memset(workers, 0, n * sizeof (workers[0]));
+	memset(threads, 0, sizeof (threads));
+	e = 0;
+	t = s__time_ns();
+	for (k=0; k<n; ++k) {
+		workers[k].bench = bench;
+		workers[k].op = op;
+		workers[k].k = k;
+		workers[k].n = n;
+		if (1 == n) {
+			_worker_(&workers[k]);
+		}
+		else if (!(threads[k] = s__thread_open(_worker_,
+							&workers[k]))) {
+			e = -1;
+		}
+	}
+	for (k=0; k<n; ++k) {
+		s__thread_close(threads[k]);
+		e |= workers[k].error;
+	}
+	t = s__time_ns() - t;
+	histogram = &workers[0].histogram;
+	for (k=1; k<n; ++k) {
+		merge(histogram, &workers[k].histogram);
+	}
+	if (!e) {
+		report(bench, phase, layer, n, t, histogram);
+	}
+	S__FREE(workers);
+	if (e) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+lookups(struct bench *bench, const char *layer)
+{
+	if (run(bench, "find-hit", layer, FIND_HIT) ||
+	    run(bench, "find-miss", layer, FIND_MISS) ||
+	    run(bench, "next", layer, NEXT) ||
+	    run(bench, "prev", layer, PREV)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+memory(struct bench *bench, const char *layer)
+{
+	struct s__index_stats stats;
+
+	if (s__index_stats(bench->index, &stats)) {
+		S__TRACE(0);
+		return -1;
+	}
+	fprintf(bench->file,
+		"%s\n    {\"phase\": \"memory\", \"layer\": \"%s\", "
+		"\"items\": %lu, \"allocated\": %lu, \"bytes_per_key\": %.1f}",
+		bench->phases++ ? "," : "",
+		layer,
+		(unsigned long)stats.items,
+		(unsigned long)stats.allocated,
+		stats.bytes_per_key);
+	return 0;
+}
+
+static int
+commit(struct bench *bench)
+{
+	struct histogram histogram;
+	uint64_t t;
+
+	memset(&histogram, 0, sizeof (struct histogram));
+	t = s__time_ns();
+	if (s__index_commit(bench->index)) {
+		S__TRACE(0);
+		return -1;
+	}
+	t = s__time_ns() - t;
+	sample(&histogram, t);
+	report(bench, "commit", "log", 1, t, &histogram);
+	return 0;
+}
+
+static int
+compress(struct bench *bench)
+{
+	struct histogram histogram;
+	uint64_t t;
+
+	memset(&histogram, 0, sizeof (struct histogram));
+	t = s__time_ns();
+	if ((bench->config->collapse && s__index_collapse(bench->index)) ||
+	    (bench->config->filter &&
+	     s__index_filter(bench->index, bench->config->filter)) ||
+	    s__index_compress(bench->index)) { /* laid out as built */
+		S__TRACE(0);
+		return -1;
+	}
+	t = s__time_ns() - t;
+	sample(&histogram, t);
+	report(bench, "compress", "succinct", 1, t, &histogram);
+	return 0;
+}
+
+static int
+exists(const char *pathname, const char *extension)
+{
+	uint64_t len;
+	FILE *file;
+	char *s;
+	int e;
+
+	len = s__strlen(pathname) + s__strlen(extension) + 1;
+	if (!(s = s__malloc(len))) {
+		S__TRACE(0);
+		return -1;
+	}
+	s__sprintf(s, len, "%s%s", pathname, extension);
+	e = 0;
+	if ((file = fopen(s, "rb"))) {
+		fclose(file);
+		e = 1;
+	}
+	S__FREE(s);
+	return e;
+}
+
+static int
+fresh(const char *pathname)
+{
+	if (exists(pathname, "") || exists(pathname, ".snap")) {
+		S__TRACE(S__ERR_ARGUMENT); /* never replay or delete a real log */
+		return 0;
+	}
+	return 1;
+}
+
+int
+s__index_bench(const struct s__index_bench *config, FILE *file)
+{
+	struct bench bench;
+	uint64_t i;
+	int e;
+
+	assert( config );
+	assert( config->open );
+	assert( config->keys );
+	assert( config->min_len );
+	assert( config->min_len <= config->max_len );
+	assert( S__INDEX_MAX_KEY_LEN > config->max_len );
+	assert( 64 > config->prefix );
+	assert( (0 < config->threads) && (MAX_THREADS >= config->threads) );
+	assert( file );
+
+	if (config->log && !fresh(config->log)) {
+		S__TRACE(0);
+		return -1;
+	}
+	memset(&bench, 0, sizeof (struct bench));
+	bench.config = config;
+	bench.file = file;
+	if (generate(&bench) || !(bench.index = config->open())) {
+		e = -1;
+		goto out;
+	}
+	if (config->log && s__index_log(bench.index, config->log, 0)) {
+		e = -1;
+		goto out;
+	}
+	fprintf(file,
+		"{\n  \"config\": {\"keys\": %lu, \"min_len\": %lu, "
+		"\"max_len\": %lu, \"lengths\": \"%s\", \"prefix\": %lu, "
+		"\"threads\": %d, "
+		"\"tree\": \"%s\", \"seed\": %lu, "
+		"\"collapse\": %s, \"filter\": %lu, \"log\": %s},\n"
+		"  \"phases\": [",
+		(unsigned long)config->keys,
+		(unsigned long)config->min_len,
+		(unsigned long)config->max_len,
+		config->zipf ? "zipf" : "uniform",
+		(unsigned long)config->prefix,
+		config->threads,
+		tree_name(config),
+		(unsigned long)config->seed,
+		config->collapse ? "true" : "false",
+		(unsigned long)config->filter,
+		config->log ? "true" : "false");
+	e = 0;
+	if (run(&bench, "insert", "tree", INSERT) ||
+	    (config->log && commit(&bench)) ||
+	    memory(&bench, "tree") ||
+	    lookups(&bench, "tree") ||
+	    compress(&bench) ||
+	    memory(&bench, "succinct") ||
+	    lookups(&bench, "succinct")) {
+		e = -1;
+	}
+	fprintf(file, "\n  ]\n}\n");
+ out:
+	if (bench.index && config->log) {
+		s__index_truncate(bench.index);
+	}
+	s__index_close(bench.index);
+	if (config->log) {
+		s__unlink(config->log);
+	}
+	for (i=0; i<config->keys; ++i) {
+		if (bench.keys) {
+			S__FREE(bench.keys[i]);
+		}
+		if (bench.misses) {
+			S__FREE(bench.misses[i]);
+		}
+	}
+	S__FREE(bench.keys);
+	S__FREE(bench.misses);
+	if (e) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
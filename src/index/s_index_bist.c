@@ -4,45 +4,2939 @@
  * s_index_bist.c
  */
 
+#include "s_index_succinct.h"
+#include "s_index_bitmap.h"
+#include "s_index_sharded.h"
 #include "s_index.h"
 #include "s_index_bist.h"
 
 #define N 1000000
 
+#define PATHNAME "/tmp/s_index_bist.idx"
+#define PATHNAME2 "/tmp/s_index_bist.idx2"
+#define LOG "/tmp/s_index_bist.log"
+
 #define UL(x) ( (unsigned long)(x) )
 
-#define TEST(m,e)						\
-	do {							\
-		if ((e)) {					\
-			t = s__time() - t;			\
-			s__term_color(S__TERM_COLOR_RED);       \
-			s__term_bold();				\
-			printf("\t [FAIL] ");			\
-			s__term_reset();			\
-			printf("%20s %6.1fs\n", (m), 1e-6*t);   \
-			t = s__time();				\
-		}						\
-		else {						\
-			t = s__time() - t;			\
-			s__term_color(S__TERM_COLOR_GREEN);     \
-			s__term_bold();				\
-			printf("\t [PASS] ");			\
-			s__term_reset();			\
-			printf("%20s %6.1fs\n", (m), 1e-6*t);   \
-			t = s__time();				\
-		}						\
-	} while (0)
+#define M 10000000
+
+#define RECORD 40 /* bytes per record, of the records test */
+#define TAIL "c:%06lu.tail.%lu#" /* keys of the collapse test */
+
+#define TEST(m,e)						\
+	do {							\
+		if ((e)) {					\
+			t = s__time() - t;			\
+			s__term_color(S__TERM_COLOR_RED);       \
+			s__term_bold();				\
+			printf("\t [FAIL] ");			\
+			s__term_reset();			\
+			printf("%20s %6.1fs\n", (m), 1e-6*t);   \
+			t = s__time();				\
+		}						\
+		else {						\
+			t = s__time() - t;			\
+			s__term_color(S__TERM_COLOR_GREEN);     \
+			s__term_bold();				\
+			printf("\t [PASS] ");			\
+			s__term_reset();			\
+			printf("%20s %6.1fs\n", (m), 1e-6*t);   \
+			t = s__time();				\
+		}						\
+	} while (0)
+
+static int
+bitmap(void)
+{
+	const uint64_t SIZE = 16 * N;
+	uint64_t t, i, j, k, sum, *pos;
+	s__index_bitmap_t bitmap;
+
+	if (!(bitmap = s__index_bitmap_open(SIZE)) ||
+	    !(pos = s__malloc(M * sizeof (pos[0])))) {
+		s__index_bitmap_close(bitmap);
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0; i<SIZE; ++i) {
+		if (0 == (rand() % 3)) {
+			s__index_bitmap_set(bitmap, i);
+		}
+	}
+	if (s__index_bitmap_prepare(bitmap)) {
+		s__index_bitmap_close(bitmap);
+		S__FREE(pos);
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0, k=0; i<SIZE; ++i) {
+		if (s__index_bitmap_get(bitmap, i)) {
+			++k;
+			if (k != s__index_bitmap_rank(bitmap, i) ||
+			    i != s__index_bitmap_select(bitmap, k)) {
+				s__index_bitmap_close(bitmap);
+				S__FREE(pos);
+				S__TRACE(S__ERR_SOFTWARE);
+				return -1;
+			}
+		}
+		else if (k != s__index_bitmap_rank(bitmap, i)) {
+			s__index_bitmap_close(bitmap);
+			S__FREE(pos);
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+	}
+	if (k != s__index_bitmap_ones(bitmap)) {
+		s__index_bitmap_close(bitmap);
+		S__FREE(pos);
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	for (i=0; i<M; ++i) {
+		j = ((uint64_t)rand() << 31) ^ (uint64_t)rand();
+		pos[i] = j % SIZE;
+	}
+	sum = 0;
+	t = s__time();
+	for (i=0; i<M; ++i) {
+		sum += s__index_bitmap_rank(bitmap, pos[i]);
+	}
+	t = s__time() - t;
+	printf("\t        %20s %6.1fns\n", "rank", 1e3 * t / M);
+	for (i=0; i<M; ++i) {
+		pos[i] = pos[i] % k + 1;
+	}
+	t = s__time();
+	for (i=0; i<M; ++i) {
+		sum += s__index_bitmap_select(bitmap, pos[i]);
+	}
+	t = s__time() - t;
+	printf("\t        %20s %6.1fns\n", "select", 1e3 * t / M);
+	s__index_bitmap_close(bitmap);
+	S__FREE(pos);
+	return sum ? 0 : -1;
+}
+
+static int
+batch(s__index_t index)
+{
+	uint64_t t1, t2, i, j, *record, **records;
+	const char **keys;
+	char *buf;
+
+	keys = NULL;
+	records = NULL;
+	if (!(buf = s__malloc(N * 16)) ||
+	    !(keys = s__malloc(N * sizeof (keys[0]))) ||
+	    !(records = s__malloc(N * sizeof (records[0])))) {
+		S__FREE(buf);
+		S__FREE(keys);
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0; i<N; ++i) {
+		j = (uint64_t)rand() % (N + N / 4);
+		s__sprintf(buf + i * 16, 16, "k:%012lu", UL(j));
+		keys[i] = buf + i * 16;
+	}
+	t1 = s__time();
+	for (i=0; i<N; ++i) {
+		records[i] = s__index_find(index, keys[i]);
+	}
+	t1 = s__time() - t1;
+	t2 = s__time();
+	s__index_find_batch(index, keys, N, records);
+	t2 = s__time() - t2;
+	for (i=0; i<N; ++i) {
+		record = s__index_find(index, keys[i]);
+		if (record != records[i]) {
+			S__FREE(buf);
+			S__FREE(keys);
+			S__FREE(records);
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+	}
+	printf("\t        %20s %6.1fns\n", "find", 1e3 * t1 / N);
+	printf("\t        %20s %6.1fns\n", "find-batch", 1e3 * t2 / N);
+	S__FREE(buf);
+	S__FREE(keys);
+	S__FREE(records);
+	return 0;
+}
+
+static int
+cursor(s__index_t index)
+{
+	char key[64], lo[64], hi[64];
+	s__index_cursor_t cursor;
+	uint64_t i, j, k, *record;
+
+	if (!(cursor = s__index_cursor_open(index))) {
+		S__TRACE(0);
+		return -1;
+	}
+	i = 0;
+	record = s__index_cursor_seek(cursor, NULL, NULL);
+	while (record) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (((i + 1) != (*record)) ||
+		    strcmp(key, s__index_cursor_key(cursor))) {
+			s__index_cursor_close(cursor);
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+		record = s__index_cursor_next(cursor);
+		++i;
+	}
+	if (N != i) {
+		s__index_cursor_close(cursor);
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	for (i=0; i<1000; ++i) {
+		j = (uint64_t)rand() % (N - 100);
+		s__sprintf(lo, sizeof (lo), "k:%012lu0", UL(j));
+		s__sprintf(hi, sizeof (hi), "k:%012lu", UL(j + 100));
+		record = s__index_cursor_seek(cursor, lo, hi);
+		while (record) {
+			++j;
+			s__sprintf(key, sizeof (key), "k:%012lu", UL(j));
+			if (((j + 1) != (*record)) ||
+			    strcmp(key, s__index_cursor_key(cursor))) {
+				s__index_cursor_close(cursor);
+				S__TRACE(S__ERR_SOFTWARE);
+				return -1;
+			}
+			record = s__index_cursor_next(cursor);
+		}
+		if (!(record = s__index_cursor_seek(cursor, hi, NULL)) ||
+		    strcmp(hi, s__index_cursor_key(cursor))) {
+			s__index_cursor_close(cursor);
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+		for (k=0; (k<200) && --j; ++k) {
+			record = s__index_cursor_prev(cursor);
+			s__sprintf(key, sizeof (key), "k:%012lu", UL(j));
+			if (!record || ((j + 1) != (*record)) ||
+			    strcmp(key, s__index_cursor_key(cursor))) {
+				s__index_cursor_close(cursor);
+				S__TRACE(S__ERR_SOFTWARE);
+				return -1;
+			}
+			if ((j % 7) && (!s__index_cursor_next(cursor) ||
+					!s__index_cursor_prev(cursor))) {
+				s__index_cursor_close(cursor);
+				S__TRACE(S__ERR_SOFTWARE);
+				return -1;
+			}
+		}
+	}
+	if (s__index_cursor_seek(cursor, "k:999999999999", NULL) ||
+	    s__index_cursor_seek(cursor, "a", "b") ||
+	    !s__index_cursor_seek(cursor, "a", NULL) ||
+	    s__index_cursor_prev(cursor) ||
+	    s__index_cursor_next(cursor) ||
+	    !s__index_cursor_seek(cursor, "k:000000999999", NULL) ||
+	    !s__index_cursor_prev(cursor) ||
+	    strcmp("k:000000999998", s__index_cursor_key(cursor)) ||
+	    !s__index_cursor_next(cursor) ||
+	    s__index_cursor_next(cursor)) {
+		s__index_cursor_close(cursor);
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	s__index_cursor_close(cursor);
+	return 0;
+}
+
+struct reader {
+	s__index_t index;
+	volatile uint64_t *items; /* keys published by the writer */
+	volatile uint64_t *active; /* readers still running */
+	uint64_t seed;
+	int error;
+};
+
+static uint64_t
+xorshift(uint64_t *seed)
+{
+	(*seed) ^= (*seed) << 13;
+	(*seed) ^= (*seed) >> 7;
+	(*seed) ^= (*seed) << 17;
+	return (*seed);
+}
+
+static void
+reader(void *ctx)
+{
+	struct reader *reader;
+	char key[64], okey[64], pkey[64];
+	uint64_t i, j, n, value;
+
+	reader = (struct reader *)ctx;
+	for (i=0; i<(N / 4); ++i) {
+		n = (*reader->items);
+		s__fence_acquire();
+		if (!n) {
+			continue;
+		}
+		j = xorshift(&reader->seed) % n;
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(j));
+		if (!s__index_find_value(reader->index, key, &value) ||
+		    ((j + 1) != value)) {
+			reader->error = -1;
+			break;
+		}
+		s__sprintf(pkey, sizeof (pkey), "k:%012lu", UL(j - 1));
+		if (j && (!s__index_prev(reader->index, key, okey) ||
+			  strcmp(pkey, okey) ||
+			  !s__index_find_value(reader->index, okey, &value) ||
+			  (j != value))) {
+			reader->error = -1;
+			break;
+		}
+		s__sprintf(pkey, sizeof (pkey), "k:%012lu", UL(j + 1));
+		if (!s__index_next(reader->index, key, okey)) {
+			if ((j + 1) < n) {
+				reader->error = -1;
+				break;
+			}
+		}
+		else if (strcmp(pkey, okey) ||
+			 (((j + 1) < n) &&
+			  (!s__index_find_value(reader->index, okey, &value) ||
+			   ((j + 2) != value)))) {
+			reader->error = -1;
+			break;
+		}
+	}
+	s__atomic_add(reader->active, -1);
+}
+
+static int
+concurrent(s__index_t index, int readers, uint64_t *ops)
+{
+	struct reader ctx[64];
+	s__thread_t threads[64];
+	volatile uint64_t items, active;
+	uint64_t i, *record;
+	char key[64];
+	int k, error;
+
+	error = 0;
+	items = s__index_items(index);
+	active = (uint64_t)readers;
+	memset(threads, 0, sizeof (threads));
+	for (k=0; k<readers; ++k) {
+		ctx[k].index = index;
+		ctx[k].items = &items;
+		ctx[k].active = &active;
+		ctx[k].seed = (uint64_t)k + 1;
+		ctx[k].error = 0;
+		if (!(threads[k] = s__thread_open(reader, &ctx[k]))) {
+			s__atomic_add(&active, -1);
+			error = -1;
+		}
+	}
+	for (i=items; active && (i<N); ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (!(record = s__index_update(index, key))) {
+			error = -1;
+			break;
+		}
+		(*record) = i + 1;
+		s__fence_release();
+		items = i + 1;
+	}
+	for (k=0; k<readers; ++k) {
+		s__thread_close(threads[k]);
+		error |= ctx[k].error;
+	}
+	(*ops) = (uint64_t)readers * (N / 4);
+	return error ? -1 : 0;
+}
+
+static int
+scaling(void)
+{
+	uint64_t t, ops;
+	s__index_t index;
+	int readers, cores;
+	char label[64];
+
+	if (!(index = s__index_open())) {
+		S__TRACE(0);
+		return -1;
+	}
+	cores = (int)S__MIN(s__cores(), 64);
+	for (readers=1; readers<=S__MAX(cores, 4); readers*=2) {
+		t = s__time();
+		if (concurrent(index, readers, &ops)) {
+			s__index_close(index);
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+		t = s__time() - t;
+		s__sprintf(label, sizeof (label), "readers=%d", readers);
+		printf("\t        %20s %6.1fMops\n", label, (double)ops / t);
+	}
+	s__index_close(index);
+	return 0;
+}
+
+static int
+delta(void)
+{
+	uint64_t i, ops, *record;
+	s__index_cursor_t cursor;
+	s__index_t index;
+	char key[64];
+	int e;
+
+	e = 0;
+	if (!(index = s__index_open())) {
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0; !e && (i<(N / 2)); ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (!(record = s__index_update(index, key))) {
+			e = -1;
+			break;
+		}
+		(*record) = i + 1;
+	}
+	if (e ||
+	    s__index_compress(index) ||
+	    s__index_delta(index, N / 1000) || /* merges install under readers */
+	    concurrent(index, 2, &ops)) {
+		e = -1;
+	}
+	for (i=0; !e && (i<N); ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (!(record = s__index_update(index, key)) ||
+		    ((i + 1) != (*record))) {
+			e = -1;
+			break;
+		}
+		(*record) = i + 2;
+		if (!(i % (N / 8)) && s__index_merge(index)) {
+			e = -1;
+		}
+	}
+	if (e || (N != s__index_items(index)) || s__index_merge(index)) {
+		e = -1;
+	}
+	cursor = NULL;
+	if (!e && !(cursor = s__index_cursor_open(index))) {
+		e = -1;
+	}
+	record = e ? NULL : s__index_cursor_seek(cursor, NULL, NULL);
+	for (i=0; record; ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (((i + 2) != (*record)) ||
+		    strcmp(key, s__index_cursor_key(cursor))) {
+			e = -1;
+			break;
+		}
+		record = s__index_cursor_next(cursor);
+	}
+	if (!e && (N != i)) {
+		e = -1;
+	}
+	s__index_cursor_close(cursor);
+	s__index_close(index);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Walks a cursor forward and then backward, turning around at every third
+ * key, and checks each position against s__index_next() and
+ * s__index_prev().
+ */
+
+static int
+steps(s__index_t index)
+{
+	char key[64], okey[64];
+	s__index_cursor_t cursor;
+	uint64_t i, *record, *expect;
+	int d;
+
+	if (!(cursor = s__index_cursor_open(index))) {
+		S__TRACE(0);
+		return -1;
+	}
+	for (d=1; -1<=d; d-=2) {
+		record = NULL;
+		if (1 == d) {
+			record = s__index_cursor_seek(cursor, NULL, NULL);
+		}
+		else if (s__index_prev(index, NULL, okey)) {
+			record = s__index_cursor_seek(cursor, okey, NULL);
+		}
+		key[0] = '\0';
+		for (i=0; record; ++i) {
+			expect = (1 == d) ?
+				s__index_next(index, key, okey) :
+				s__index_prev(index, key, okey);
+			if ((record != expect) ||
+			    strcmp(okey, s__index_cursor_key(cursor))) {
+				s__index_cursor_close(cursor);
+				S__TRACE(S__ERR_SOFTWARE);
+				return -1;
+			}
+			memcpy(key, okey, s__strlen(okey) + 1);
+			if (i && !(i % 3) &&
+			    (!((1 == d) ?
+			       s__index_cursor_prev(cursor) :
+			       s__index_cursor_next(cursor)) ||
+			     (record != ((1 == d) ?
+					 s__index_cursor_next(cursor) :
+					 s__index_cursor_prev(cursor))) ||
+			     strcmp(key, s__index_cursor_key(cursor)))) {
+				s__index_cursor_close(cursor);
+				S__TRACE(S__ERR_SOFTWARE);
+				return -1;
+			}
+			record = (1 == d) ?
+				s__index_cursor_next(cursor) :
+				s__index_cursor_prev(cursor);
+		}
+		if (s__index_items(index) != i) {
+			s__index_cursor_close(cursor);
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+	}
+	s__index_cursor_close(cursor);
+	return 0;
+}
+
+static int
+writes(void)
+{
+	uint64_t i, r, value, *record;
+	s__index_t index;
+	char key[64];
+	int e;
+
+	e = 0;
+	if (!(index = s__index_open())) {
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0; !e && (i<2000); ++i) { /* x: keys merge after w: keys */
+		s__sprintf(key,
+			   sizeof (key),
+			   "%c:%06lu",
+			   (i & 1) ? 'w' : 'x',
+			   UL(i / 2));
+		if (!(record = s__index_update(index, key))) {
+			e = -1;
+			break;
+		}
+		(*record) = 1;
+	}
+	if (e ||
+	    s__index_compress(index) ||
+	    s__index_delta(index, 100)) { /* merges race the stores */
+		e = -1;
+	}
+	for (r=1; !e && (r<=8); ++r) {
+		for (i=0; i<3000; ++i) {
+			s__sprintf(key, sizeof (key), "w:%06lu", UL(i));
+			if (!(record = s__index_update(index, key))) {
+				e = -1;
+				break;
+			}
+			if (!(i % 100)) {
+				s__usleep(1000); /* let a merge start */
+			}
+			(*record) = r * 3000 + i;
+			s__sprintf(key, /* new keys freeze the tree */
+				   sizeof (key),
+				   "y:%lu:%06lu",
+				   UL(r),
+				   UL(i));
+			if ((!(i % 5) && !s__index_update(index, key)) ||
+			    (!(i % 700) && s__index_merge(index)) ||
+			    (!(i % 1000) && steps(index))) { /* mid merge */
+				e = -1;
+				break;
+			}
+		}
+		for (i=0; !e && (i<3000); ++i) {
+			s__sprintf(key, sizeof (key), "w:%06lu", UL(i));
+			if (!s__index_find_value(index, key, &value) ||
+			    ((r * 3000 + i) != value)) {
+				e = -1;
+			}
+		}
+		if (!e && steps(index)) {
+			e = -1;
+		}
+	}
+	if (e || s__index_merge(index) || (8800 != s__index_items(index))) {
+		e = -1;
+	}
+	for (i=0; !e && (i<3000); ++i) {
+		s__sprintf(key, sizeof (key), "w:%06lu", UL(i));
+		if (!s__index_find_value(index, key, &value) ||
+		    ((8 * 3000 + i) != value)) {
+			e = -1;
+		}
+	}
+	s__index_close(index);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+verify(s__index_t index, uint64_t n, int mask)
+{
+	char key[64], okey[64], last[64];
+	uint64_t i, j, *record, *prev;
+	s__index_cursor_t cursor;
+
+	if (!(cursor = s__index_cursor_open(index))) {
+		S__TRACE(0);
+		return -1;
+	}
+	prev = NULL;
+	record = s__index_cursor_seek(cursor, NULL, NULL);
+	for (i=0, j=0; i<n; ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (!(mask & (1 << (i % 3)))) {
+			if (s__index_find(index, key)) {
+				break;
+			}
+			continue;
+		}
+		if (!record ||
+		    ((i + 1) != (*record)) ||
+		    strcmp(key, s__index_cursor_key(cursor)) ||
+		    (s__index_find(index, key) != record) ||
+		    (s__index_prev(index, key, okey) != prev) ||
+		    (prev && strcmp(last, okey)) ||
+		    (s__index_next(index, j ? last : NULL, okey) != record) ||
+		    strcmp(key, okey)) {
+			break;
+		}
+		prev = record;
+		memcpy(last, key, strlen(key) + 1);
+		record = s__index_cursor_next(cursor);
+		++j;
+	}
+	s__index_cursor_close(cursor);
+	if ((n != i) || record || (j != s__index_items(index))) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+removes(s__index_t index, uint64_t n, int r, int e)
+{
+	uint64_t i, *record;
+	char key[64];
+
+	for (i=n; i; --i) {
+		if (r != (int)((i - 1) % 3)) {
+			continue;
+		}
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i - 1));
+		if (0 > e) {
+			if (!(record = s__index_update(index, key))) {
+				S__TRACE(0);
+				return -1;
+			}
+			(*record) = i;
+		}
+		else if (e != s__index_remove(index, key)) {
+			S__TRACE(0);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+_ascending_(void *ctx, int rewind, const char **key, uint64_t *record)
+{
+	struct {
+		uint64_t i;
+		char key[64];
+	} *ascending;
+
+	ascending = ctx;
+	if (rewind) {
+		ascending->i = 0;
+	}
+	if ((N / 10) <= ascending->i) {
+		return 0;
+	}
+	s__sprintf(ascending->key,
+		   sizeof (ascending->key),
+		   "k:%012lu",
+		   UL(ascending->i));
+	(*key) = ascending->key;
+	(*record) = ++ascending->i;
+	return 1;
+}
+
+static int
+loading(void)
+{
+	const uint64_t n = N / 10, d = N / 100;
+	struct {
+		uint64_t i;
+		char key[64];
+	} ascending;
+	uint64_t i, j, *records;
+	s__index_t index;
+	const char **keys;
+	char *buf;
+	int e;
+
+	index = NULL;
+	records = NULL;
+	keys = NULL;
+	if (!(buf = s__malloc((n + d) * 16)) ||
+	    !(keys = s__malloc((n + d) * sizeof (keys[0]))) ||
+	    !(records = s__malloc((n + d) * sizeof (records[0]))) ||
+	    !(index = s__index_open())) {
+		S__FREE(buf);
+		S__FREE(keys);
+		S__FREE(records);
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0; i<(n + d); ++i) {
+		j = (i < d) ? (i * 31 % n) : ((i - d) * 7919 % n);
+		keys[i] = buf + i * 16;
+		s__sprintf(buf + i * 16, 16, "k:%012lu", UL(j));
+		records[i] = (i < d) ? 0 : (j + 1);
+	}
+	e = 0;
+	if (s__index_load(index, keys, records, n + d) ||
+	    verify(index, n, 7) ||
+	    removes(index, n, 1, 1) ||
+	    verify(index, n, 5) ||
+	    removes(index, n, 1, -1) ||
+	    verify(index, n, 7)) {
+		e = -1;
+	}
+	s__index_truncate(index);
+	if (e ||
+	    s__index_load_sorted(index, _ascending_, &ascending) ||
+	    verify(index, n, 7) ||
+	    removes(index, n, 2, 1) ||
+	    verify(index, n, 3)) {
+		e = -1;
+	}
+	s__index_close(index);
+	S__FREE(buf);
+	S__FREE(keys);
+	S__FREE(records);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+removal(s__index_t (*open)(void))
+{
+	const uint64_t n = N / 10;
+	s__index_t index;
+	int e;
+
+	if (!(index = open())) {
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	if (removes(index, n, 0, -1) ||
+	    removes(index, n, 1, -1) ||
+	    removes(index, n, 2, -1) ||
+	    verify(index, n, 7) ||
+	    removes(index, n, 0, 1) ||
+	    removes(index, n, 0, 0) ||
+	    verify(index, n, 6) ||
+	    removes(index, n, 0, -1) ||
+	    removes(index, n, 0, 1) ||
+	    verify(index, n, 6) ||
+	    s__index_compress(index) ||
+	    verify(index, n, 6) ||
+	    removes(index, n, 1, 1) ||
+	    removes(index, n, 1, 0) ||
+	    verify(index, n, 4) ||
+	    s__index_delta(index, n) ||
+	    removes(index, n, 0, -1) ||
+	    verify(index, n, 5) ||
+	    removes(index, n, 2, 1) ||
+	    verify(index, n, 1) ||
+	    s__index_merge(index) ||
+	    verify(index, n, 1)) {
+		e = -1;
+	}
+	s__index_close(index);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+struct prefix {
+	const char *prefix;
+	char last[64];
+	uint64_t n;
+	uint64_t stop;
+};
+
+static int
+_prefix_(void *ctx, const char *key, uint64_t *record)
+{
+	struct prefix *prefix;
+
+	prefix = (struct prefix *)ctx;
+	if (strncmp(key, prefix->prefix, strlen(prefix->prefix)) ||
+	    (0 <= strcmp(prefix->last, key)) ||
+	    ((uint64_t)atol(key + 2) + 1 != (*record))) {
+		return -1;
+	}
+	memcpy(prefix->last, key, strlen(key) + 1);
+	return (++prefix->n == prefix->stop) ? 1 : 0;
+}
+
+static int
+prefixes(s__index_t index, uint64_t removed)
+{
+	const char *PREFIXES[] = { "", "k:", "k:00000001", "k:0000000123",
+				   "k:000000012345", "k:000000012345x",
+				   "x", "k:00000009999" };
+	const uint64_t COUNTS[] = { N / 10, N / 10, N / 100, 100,
+				    1, 0, 0, 10 };
+	struct prefix prefix;
+	uint64_t i, n;
+
+	for (i=0; i<(sizeof (COUNTS) / sizeof (COUNTS[0])); ++i) {
+		memset(&prefix, 0, sizeof (struct prefix));
+		prefix.prefix = PREFIXES[i];
+		if (s__index_prefix_count(index, PREFIXES[i], &n) ||
+		    ((COUNTS[i] - (i < 2 ? removed : 0)) != n) ||
+		    s__index_prefix_iterate(index, PREFIXES[i],
+					    _prefix_, &prefix) ||
+		    (n != prefix.n)) {
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+		memset(&prefix, 0, sizeof (struct prefix));
+		prefix.prefix = PREFIXES[i];
+		prefix.stop = 3;
+		if (s__index_prefix_iterate(index, PREFIXES[i],
+					    _prefix_, &prefix) ||
+		    (S__MIN(n, 3) != prefix.n)) {
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+prefix(s__index_t (*open)(void))
+{
+	uint64_t i, *record;
+	s__index_t index;
+	char key[64];
+	int e;
+
+	if (!(index = open())) {
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	for (i=0; i<(N / 10); ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (!(record = s__index_update(index, key))) {
+			e = -1;
+			break;
+		}
+		(*record) = i + 1;
+	}
+	if (e ||
+	    prefixes(index, 0) ||
+	    s__index_compress(index) ||
+	    prefixes(index, 0) ||
+	    (1 != s__index_remove(index, "k:000000050000")) ||
+	    prefixes(index, 1) ||
+	    s__index_delta(index, N) ||
+	    prefixes(index, 1)) {
+		e = -1;
+	}
+	s__index_close(index);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+struct fuzzy {
+	char last[16];
+	uint64_t n;
+	uint64_t sum;
+};
+
+static uint64_t
+levenshtein(const char *a, const char *b)
+{
+	uint64_t i, j, m, n, v, diagonal, row[16];
+
+	m = s__strlen(a);
+	n = s__strlen(b);
+	for (j=0; j<=n; ++j) {
+		row[j] = j;
+	}
+	for (i=1; i<=m; ++i) {
+		diagonal = row[0];
+		row[0] = i;
+		for (j=1; j<=n; ++j) {
+			v = diagonal + ((a[i - 1] != b[j - 1]) ? 1 : 0);
+			v = S__MIN(v, S__MIN(row[j], row[j - 1]) + 1);
+			diagonal = row[j];
+			row[j] = v;
+		}
+	}
+	return row[n];
+}
+
+static int
+_fuzzy_(void *ctx, const char *key, uint64_t *record)
+{
+	struct fuzzy *fuzzy;
+
+	fuzzy = (struct fuzzy *)ctx;
+	if (fuzzy->n && (0 <= strcmp(fuzzy->last, key))) {
+		return -1;
+	}
+	s__sprintf(fuzzy->last, sizeof (fuzzy->last), "%s", key);
+	fuzzy->n += 1;
+	fuzzy->sum += (*record);
+	return 0;
+}
+
+static int
+fuzzies(s__index_t index, char (*keys)[16], const int *live, uint64_t n)
+{
+	struct fuzzy fuzzy, expect;
+	char query[16];
+	uint64_t i, j, k;
+
+	for (i=0; i<64; ++i) {
+		for (j=0; j<(1 + (uint64_t)rand() % 10); ++j) {
+			query[j] = "abcd"[rand() % 4];
+		}
+		query[j] = '\0';
+		k = i % 4;
+		memset(&expect, 0, sizeof (struct fuzzy));
+		for (j=0; j<n; ++j) {
+			if (live[j] && (k >= levenshtein(keys[j], query))) {
+				expect.n += 1;
+				expect.sum += j + 1;
+			}
+		}
+		memset(&fuzzy, 0, sizeof (struct fuzzy));
+		if (s__index_fuzzy(index, query, k, _fuzzy_, &fuzzy) ||
+		    (expect.n != fuzzy.n) ||
+		    (expect.sum != fuzzy.sum)) {
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+fuzzy(s__index_t (*open)(void))
+{
+	const uint64_t n = N / 50;
+	uint64_t i, j, *record;
+	char (*keys)[16];
+	s__index_t index;
+	int e, *live;
+
+	index = NULL;
+	live = NULL;
+	if (!(keys = s__malloc(n * sizeof (keys[0]))) ||
+	    !(live = s__malloc(n * sizeof (live[0]))) ||
+	    !(index = open())) {
+		S__FREE(keys);
+		S__FREE(live);
+		S__TRACE(0);
+		return -1;
+	}
+	memset(live, 0, n * sizeof (live[0]));
+	for (i=0; i<n; ++i) {
+		for (j=0; j<(1 + (uint64_t)rand() % 12); ++j) {
+			keys[i][j] = "abcd"[rand() % 4];
+		}
+		keys[i][j] = '\0';
+	}
+	e = 0;
+	for (i=0; i<n; ++i) {
+		if (i == (n / 2)) {
+			if (fuzzies(index, keys, live, n) ||
+			    s__index_compress(index) ||
+			    fuzzies(index, keys, live, n) ||
+			    s__index_delta(index, n)) {
+				e = -1;
+				break;
+			}
+		}
+		if (!(record = s__index_update(index, keys[i]))) {
+			e = -1;
+			break;
+		}
+		if (*record) {
+			live[(*record) - 1] = 0;
+		}
+		(*record) = i + 1;
+		live[i] = 1;
+	}
+	for (i=0; !e && (i<n); i+=7) {
+		if (live[i] && (1 != s__index_remove(index, keys[i]))) {
+			e = -1;
+		}
+		live[i] = 0;
+	}
+	if (e ||
+	    fuzzies(index, keys, live, n) ||
+	    s__index_merge(index) ||
+	    fuzzies(index, keys, live, n)) {
+		e = -1;
+	}
+	s__index_close(index);
+	S__FREE(keys);
+	S__FREE(live);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+filters(s__index_t index, uint64_t n, uint64_t *filtered)
+{
+	struct s__index_stats stats;
+	uint64_t i, *record, *records[2];
+	const char *keys[2];
+	char key[32], miss[32];
+
+	for (i=0; i<n; ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		s__sprintf(miss, sizeof (miss), "m:%012lu", UL(i));
+		keys[0] = key;
+		keys[1] = miss;
+		s__index_find_batch(index, keys, 2, records);
+		if (!(record = s__index_find(index, key)) ||
+		    ((i + 1) != (*record)) ||
+		    s__index_find(index, miss) ||
+		    (records[0] != record) ||
+		    records[1]) {
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+	}
+	if (s__index_stats(index, &stats)) {
+		S__TRACE(0);
+		return -1;
+	}
+	(*filtered) = stats.filtered;
+	return 0;
+}
+
+static int
+chain(s__index_t index, const char *key, uint64_t value)
+{
+	uint64_t *record, *records[1];
+	const char *keys[1];
+
+	keys[0] = key;
+	s__index_find_batch(index, keys, 1, records);
+	record = s__index_find(index, key);
+	if ((record != records[0]) ||
+	    (value ? (!record || (value != (*record))) : (NULL != record))) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+chains(s__index_t index, uint64_t n)
+{
+	char key[64], key_[64];
+	uint64_t i, len;
+
+	for (i=0; i<n; ++i) {
+		s__sprintf(key, sizeof (key), TAIL, UL(i), UL(i));
+		len = s__strlen(key);
+		s__sprintf(key_, sizeof (key_), "c:%06lu.tail", UL(i));
+		if (chain(index, key, i + 1) ||
+		    chain(index, key_, (i % 4) ? 0 : (n + i + 1))) {
+			S__TRACE(0);
+			return -1;
+		}
+		memcpy(key_, key, (size_t)len + 1);
+		key_[len - 1] = '\0';
+		if (chain(index, key_, 0)) {
+			S__TRACE(0);
+			return -1;
+		}
+		key_[len - 1] = '#';
+		key_[len - 3] = 'X';
+		if (chain(index, key_, 0)) {
+			S__TRACE(0);
+			return -1;
+		}
+		key_[len - 3] = key[len - 3];
+		key_[len - 1] = '$';
+		if (chain(index, key_, 0)) {
+			S__TRACE(0);
+			return -1;
+		}
+		key_[len - 1] = '#';
+		key_[len] = '#';
+		key_[len + 1] = '\0';
+		if (chain(index, key_, 0)) {
+			S__TRACE(0);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Walks every key of index forward and backward, in order, and finds it.
+ */
+
+static int
+walk(s__index_t index)
+{
+	char key[64], okey[64];
+	uint64_t i, *record;
+
+	i = 0;
+	key[0] = '\0';
+	while ((record = s__index_next(index, key, okey))) {
+		if ((key[0] && (0 <= strcmp(key, okey))) ||
+		    (record != s__index_find(index, okey))) {
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+		memcpy(key, okey, s__strlen(okey) + 1);
+		++i;
+	}
+	key[0] = '\0';
+	while ((record = s__index_prev(index, key, okey))) {
+		if ((key[0] && (0 <= strcmp(okey, key))) ||
+		    (record != s__index_find(index, okey))) {
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+		memcpy(key, okey, s__strlen(okey) + 1);
+		--i;
+	}
+	if (i) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+collapse(void)
+{
+	const uint64_t n = N / 10;
+	struct s__index_stats stats, collapsed, saved;
+	uint64_t i, *record;
+	s__index_t index, mapped;
+	char key[64];
+	int e;
+
+	if (!(index = s__index_open())) {
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	for (i=0; !e && (i<n); ++i) {
+		s__sprintf(key, sizeof (key), TAIL, UL(i), UL(i));
+		if (!(record = s__index_update(index, key))) {
+			e = -1;
+			break;
+		}
+		(*record) = i + 1;
+		s__sprintf(key, sizeof (key), "c:%06lu.tail", UL(i));
+		if (!(i % 4) && !(record = s__index_update(index, key))) {
+			e = -1;
+			break;
+		}
+		(*record) = (i % 4) ? (*record) : (n + i + 1);
+	}
+	mapped = NULL;
+	if (e ||
+	    s__index_compress(index) ||
+	    s__index_stats(index, &stats) ||
+	    s__index_save(index, PATHNAME) ||
+	    !(mapped = s__index_mmap(PATHNAME)) ||
+	    s__index_delta(index, n) ||
+	    s__index_collapse(index) || /* installed under the delta */
+	    s__index_stats(index, &collapsed) ||
+	    stats.chained ||
+	    (collapsed.chained < (n * 4)) ||
+	    (collapsed.succinct.avg_depth >= stats.succinct.avg_depth) ||
+	    (collapsed.allocated >= stats.allocated) || /* nodes replaced */
+	    chains(index, n) ||
+	    walk(index) ||
+	    s__index_collapse(mapped) || /* replacing the mapped index */
+	    s__index_stats(mapped, &saved) ||
+	    (saved.chained != collapsed.chained) ||
+	    s__index_save(mapped, PATHNAME2)) {
+		e = -1;
+	}
+	s__index_close(mapped);
+	mapped = NULL;
+	if (e ||
+	    !(mapped = s__index_mmap(PATHNAME2)) ||
+	    s__index_stats(mapped, &saved) ||
+	    (saved.chained != collapsed.chained) ||
+	    chains(mapped, n) ||
+	    walk(mapped)) {
+		e = -1;
+	}
+	for (i=n; !e && (i<(n + n / 10)); ++i) {
+		s__sprintf(key, sizeof (key), TAIL, UL(i), UL(i));
+		if (!(record = s__index_update(index, key))) {
+			e = -1;
+			break;
+		}
+		(*record) = i + 1;
+	}
+	if (e ||
+	    s__index_merge(index) ||
+	    s__index_stats(index, &collapsed) ||
+	    (collapsed.chained < (n * 4)) ||
+	    chains(index, n) ||
+	    walk(index)) {
+		e = -1;
+	}
+	s__index_close(index);
+	s__index_close(mapped);
+	s__unlink(PATHNAME);
+	s__unlink(PATHNAME2);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+filter(void)
+{
+	const uint64_t n = N / 10;
+	uint64_t i, filtered, *record;
+	s__index_t index, mapped;
+	char key[32];
+	int e;
+
+	mapped = NULL;
+	if (!(index = s__index_open())) {
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	for (i=0; i<n; ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (!(record = s__index_update(index, key))) {
+			e = -1;
+			break;
+		}
+		(*record) = i + 1;
+	}
+	if (e ||
+	    s__index_filter(index, 10) ||
+	    filters(index, n, &filtered) ||
+	    filtered ||
+	    s__index_compress(index) ||
+	    filters(index, n, &filtered) ||
+	    (filtered < (2 * n * 95 / 100)) ||
+	    s__index_save(index, PATHNAME) ||
+	    !(mapped = s__index_mmap(PATHNAME)) ||
+	    s__index_filter(mapped, 16) ||
+	    filters(mapped, n, &filtered) ||
+	    (filtered < (2 * n * 99 / 100)) ||
+	    s__index_delta(index, n)) {
+		e = -1;
+	}
+	for (i=n; !e && (i<(n + n / 10)); ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (!(record = s__index_update(index, key))) {
+			e = -1;
+			break;
+		}
+		(*record) = i + 1;
+	}
+	if (e ||
+	    filters(index, n + n / 10, &filtered) ||
+	    s__index_merge(index) ||
+	    filters(index, n + n / 10, &filtered) ||
+	    (filtered < (2 * (n + n / 10) * 95 / 100))) {
+		e = -1;
+	}
+	s__index_close(index);
+	s__index_close(mapped);
+	s__unlink(PATHNAME);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+values(s__index_t index, uint64_t n, uint64_t step)
+{
+	s__index_cursor_t cursor;
+	uint64_t i, value, *record;
+	char key[32];
+	int found;
+
+	for (i=0; i<n; ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		found = s__index_find_value(index, key, &value);
+		if ((step && !(i % step)) ?
+		    found :
+		    (!found || ((1000000 + i * 37) != value))) {
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+	}
+	if (!(cursor = s__index_cursor_open(index))) {
+		S__TRACE(0);
+		return -1;
+	}
+	i = 0;
+	record = s__index_cursor_seek(cursor, NULL, NULL);
+	while (record) {
+		i += (step && !(i % step)) ? 1 : 0;
+		if ((1000000 + i++ * 37) != (*record)) {
+			break;
+		}
+		record = s__index_cursor_next(cursor);
+	}
+	s__index_cursor_close(cursor);
+	if (record || (i != n)) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+pack(void)
+{
+	const uint64_t n = N / 10;
+	struct s__index_stats stats, packed;
+	s__index_t index, mapped;
+	uint64_t i, *record;
+	char key[32];
+	int e;
+
+	mapped = NULL;
+	if (!(index = s__index_open())) {
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	for (i=0; i<n; ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (!(record = s__index_update(index, key))) {
+			e = -1;
+			break;
+		}
+		(*record) = 1000000 + i * 37;
+	}
+	if (e ||
+	    s__index_compress(index) ||
+	    s__index_stats(index, &stats) ||
+	    s__index_pack(index) ||
+	    s__index_stats(index, &packed) ||
+	    ((stats.allocated - packed.allocated) < (n * 5)) ||
+	    values(index, n, 0)) {
+		e = -1;
+	}
+	for (i=0; !e && (i<n); i+=5) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (1 != s__index_remove(index, key)) {
+			e = -1;
+		}
+	}
+	if (e ||
+	    values(index, n, 5) ||
+	    s__index_save(index, PATHNAME) ||
+	    !(mapped = s__index_mmap(PATHNAME)) ||
+	    values(mapped, n, 5) ||
+	    s__index_pack(mapped) ||
+	    values(mapped, n, 5)) {
+		e = -1;
+	}
+	s__index_close(index);
+	s__index_close(mapped);
+	s__unlink(PATHNAME);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static s__index_t
+recover(uint64_t snapshot)
+{
+	s__index_t index;
+
+	if (!(index = s__index_open())) {
+		S__TRACE(0);
+		return NULL;
+	}
+	if (s__index_record_size(index, 2 * sizeof (uint64_t)) ||
+	    s__index_log(index, LOG, snapshot)) {
+		s__index_close(index);
+		S__TRACE(0);
+		return NULL;
+	}
+	return index;
+}
+
+static int
+puts_(s__index_t index, uint64_t lo, uint64_t hi)
+{
+	uint64_t i, record[2];
+	char key[32];
+
+	for (i=lo; i<hi; ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		record[0] = i * 7;
+		record[1] = ~i;
+		if (s__index_put(index, key, record)) {
+			S__TRACE(0);
+			return -1;
+		}
+	}
+	for (i=S__DUP(lo, 3) * 3; i<hi; i+=3) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (1 != s__index_remove(index, key)) {
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+recovered(s__index_t index, uint64_t n)
+{
+	uint64_t i, *record;
+	char key[32];
+
+	for (i=0; i<n; ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		record = s__index_find(index, key);
+		if ((i % 3) ?
+		    (!record || ((i * 7) != record[0]) || (~i != record[1])) :
+		    (NULL != record)) {
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+	}
+	if ((n - S__DUP(n, 3)) != s__index_items(index)) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+logs(void)
+{
+	const uint64_t n = N / 100;
+	s__index_t index;
+	FILE *file;
+	int e;
+
+	s__unlink(LOG);
+	s__unlink(LOG ".snap");
+	e = 0;
+
+	/* log, then recover into a snapshot */
+
+	if (!(index = recover(0)) ||
+	    puts_(index, 0, n) ||
+	    s__index_commit(index)) {
+		e = -1;
+	}
+	s__index_close(index);
+	index = NULL;
+	if (e ||
+	    !(index = recover(0)) ||
+	    recovered(index, n) ||
+	    puts_(index, n, 2 * n) ||
+	    s__index_commit(index)) {
+		e = -1;
+	}
+	s__index_close(index);
+	index = NULL;
+
+	/* torn tail */
+
+	if (!e && (file = fopen(LOG, "ab"))) {
+		e = (17 != fwrite("STINGWAL_partial_", 1, 17, file)) ? -1 : 0;
+		fclose(file);
+	}
+	if (e ||
+	    !(index = recover(0)) ||
+	    recovered(index, 2 * n)) {
+		e = -1;
+	}
+	s__index_close(index);
+	index = NULL;
+
+	/* snapshots taken along the way */
+
+	if (e ||
+	    !(index = recover(4096)) ||
+	    puts_(index, 2 * n, 3 * n)) {
+		e = -1;
+	}
+	s__index_close(index);
+	index = NULL;
+	if (e ||
+	    !(index = recover(0)) ||
+	    recovered(index, 3 * n)) {
+		e = -1;
+	}
+
+	/* truncation */
+
+	if (!e) {
+		s__index_truncate(index);
+	}
+	s__index_close(index);
+	index = NULL;
+	if (e ||
+	    !(index = recover(0)) ||
+	    s__index_items(index)) {
+		e = -1;
+	}
+	s__index_close(index);
+	s__unlink(LOG);
+	s__unlink(LOG ".snap");
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+art(void)
+{
+	s__index_t index;
+	uint64_t ops;
+	int e;
+
+	if (!(index = s__index_open_art())) {
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	if (concurrent(index, 2, &ops) ||
+	    removes(index, N, 0, -1) ||
+	    removes(index, N, 1, -1) ||
+	    removes(index, N, 2, -1) ||
+	    verify(index, N, 7) ||
+	    removes(index, N, 1, 1) ||
+	    verify(index, N, 5) ||
+	    removes(index, N, 1, -1) ||
+	    verify(index, N, 7) ||
+	    batch(index)) {
+		e = -1;
+	}
+	s__index_close(index);
+	if (e || removal(s__index_open_art) || prefix(s__index_open_art)) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+struct url {
+	char key[80];
+	uint64_t record;
+};
+
+static int
+_url_(const void *a, const void *b)
+{
+	const struct url *a_ = (const struct url *)a;
+	const struct url *b_ = (const struct url *)b;
+
+	return strcmp(a_->key, b_->key);
+}
+
+static int
+urls(s__index_t index)
+{
+	const uint64_t n = N / 10;
+	uint64_t i, j, *record;
+	s__index_cursor_t cursor;
+	struct url *urls, t;
+
+	if (!(urls = s__malloc(n * sizeof (urls[0])))) {
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0; i<n; ++i) {
+		s__sprintf(urls[i].key,
+			   sizeof (urls[i].key),
+			   "https://www.host%lu.example.com/%s%lu",
+			   UL(i % 7),
+			   (i % 3) ? "static/assets/images/" : "",
+			   UL(i));
+		urls[i].record = i + 1;
+	}
+	for (i=n; 1<i; --i) {
+		j = (uint64_t)rand() % i;
+		t = urls[i - 1];
+		urls[i - 1] = urls[j];
+		urls[j] = t;
+	}
+	for (i=0; i<n; ++i) {
+		if (!(record = s__index_update(index, urls[i].key))) {
+			S__FREE(urls);
+			S__TRACE(0);
+			return -1;
+		}
+		(*record) = urls[i].record;
+	}
+	for (i=0, j=0; i<n; ++i) {
+		if (i % 5) {
+			urls[j++] = urls[i];
+		}
+		else if (1 != s__index_remove(index, urls[i].key)) {
+			S__FREE(urls);
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+	}
+	qsort(urls, j, sizeof (urls[0]), _url_);
+	if (!(cursor = s__index_cursor_open(index))) {
+		S__FREE(urls);
+		S__TRACE(0);
+		return -1;
+	}
+	record = s__index_cursor_seek(cursor, NULL, NULL);
+	for (i=0; i<j; ++i) {
+		if (!record ||
+		    (urls[i].record != (*record)) ||
+		    strcmp(urls[i].key, s__index_cursor_key(cursor)) ||
+		    (s__index_find(index, urls[i].key) != record)) {
+			break;
+		}
+		record = s__index_cursor_next(cursor);
+	}
+	s__index_cursor_close(cursor);
+	S__FREE(urls);
+	if ((j != i) || record || (j != s__index_items(index))) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+struct id {
+	unsigned char key[16];
+	uint64_t len;
+};
+
+static int
+_id_(const void *a_, const void *b_)
+{
+	const struct id *a = (const struct id *)a_;
+	const struct id *b = (const struct id *)b_;
+	int d;
+
+	if ((d = memcmp(a->key, b->key, (size_t)S__MIN(a->len, b->len)))) {
+		return d;
+	}
+	return (a->len > b->len) - (a->len < b->len);
+}
+
+static int
+_u64_(const void *a_, const void *b_)
+{
+	const uint64_t a = *((const uint64_t *)a_);
+	const uint64_t b = *((const uint64_t *)b_);
+
+	return (a > b) - (a < b);
+}
+
+static int
+walk_n(s__index_t index, const struct id *ids, uint64_t n)
+{
+	unsigned char okey[S__INDEX_MAX_KEY_LEN_N];
+	uint64_t i, *record, *prev, len;
+	struct id id;
+
+	record = s__index_next_n(index, NULL, 0, okey, &len);
+	for (i=0; i<n; ++i) {
+		if (!record ||
+		    ((i + 1) != (*record)) ||
+		    (ids[i].len != len) ||
+		    memcmp(ids[i].key, okey, (size_t)len) ||
+		    (s__index_find_n(index, ids[i].key, len) != record)) {
+			break;
+		}
+		if (i &&
+		    (!(prev = s__index_prev_n(index,
+					      ids[i].key,
+					      len,
+					      id.key,
+					      &id.len)) ||
+		     (i != (*prev)) ||
+		     _id_(&id, &ids[i - 1]))) {
+			break;
+		}
+		record = s__index_next_n(index, ids[i].key, len, okey, &len);
+	}
+	if ((n != i) || record || (n != s__index_items(index))) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+walk_u64(s__index_t index, const uint64_t *keys, uint64_t n)
+{
+	uint64_t i, *record, *prev, okey;
+
+	record = s__index_next_u64(index, NULL, &okey);
+	for (i=0; i<n; ++i) {
+		if (!record ||
+		    ((i + 1) != (*record)) ||
+		    (keys[i] != okey) ||
+		    (s__index_find_u64(index, keys[i]) != record)) {
+			break;
+		}
+		if (i &&
+		    (!(prev = s__index_prev_u64(index, &keys[i], &okey)) ||
+		     (i != (*prev)) ||
+		     (keys[i - 1] != okey))) {
+			break;
+		}
+		record = s__index_next_u64(index, &keys[i], &okey);
+	}
+	if ((n != i) || record || (n != s__index_items(index))) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+binary(s__index_t (*open)(void))
+{
+	const unsigned char BYTES[] = { 0x00, 0x01, 0x02, 0xff };
+	const uint64_t n = N / 10;
+	s__index_t index, index_;
+	uint64_t i, j, *keys, *record;
+	struct id *ids;
+	int e;
+
+	index = NULL;
+	index_ = NULL;
+	keys = NULL;
+	if (!(ids = s__malloc(n * sizeof (ids[0]))) ||
+	    !(keys = s__malloc(n * sizeof (keys[0]))) ||
+	    !(index = open()) ||
+	    !(index_ = open())) {
+		s__index_close(index);
+		S__FREE(ids);
+		S__FREE(keys);
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0; i<n; ++i) {
+		ids[i].len = 1 + (uint64_t)rand() % sizeof (ids[0].key);
+		for (j=0; j<ids[i].len; ++j) {
+			ids[i].key[j] = BYTES[rand() % sizeof (BYTES)];
+		}
+		keys[i] = (i + 1 < n) ? i * 0x9e3779b97f4a7c15 : (uint64_t)-1;
+	}
+	qsort(ids, n, sizeof (ids[0]), _id_);
+	qsort(keys, n, sizeof (keys[0]), _u64_);
+	for (i=1, j=1; i<n; ++i) {
+		if (_id_(&ids[j - 1], &ids[i])) {
+			ids[j++] = ids[i];
+		}
+	}
+	e = 0;
+	for (i=0; i<j; ++i) {
+		record = s__index_update_n(index, ids[i].key, ids[i].len);
+		if (!record) {
+			e = -1;
+			break;
+		}
+		(*record) = i + 1;
+	}
+	for (i=0; i<n; ++i) {
+		if (!(record = s__index_update_u64(index_, keys[i]))) {
+			e = -1;
+			break;
+		}
+		(*record) = i + 1;
+	}
+	if (e ||
+	    walk_n(index, ids, j) ||
+	    walk_u64(index_, keys, n) ||
+	    s__index_compress(index) ||
+	    s__index_compress(index_) ||
+	    walk_n(index, ids, j) ||
+	    walk_u64(index_, keys, n) ||
+	    (1 != s__index_remove_n(index, ids[0].key, ids[0].len)) ||
+	    (0 != s__index_remove_n(index, ids[0].key, ids[0].len)) ||
+	    s__index_find_n(index, ids[0].key, ids[0].len) ||
+	    (1 != s__index_remove_u64(index_, keys[n - 1])) ||
+	    s__index_find_u64(index_, keys[n - 1]) ||
+	    (j - 1 != s__index_items(index)) ||
+	    (n - 1 != s__index_items(index_))) {
+		e = -1;
+	}
+	s__index_close(index);
+	s__index_close(index_);
+	S__FREE(ids);
+	S__FREE(keys);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+bounds(s__index_t index, s__index_t index_)
+{
+	const unsigned char BYTES[] = { 0x01, 0x7f, 0x80, 0x81, 0x82, 0xff };
+	char key[16], okey[S__INDEX_MAX_KEY_LEN], okey_[S__INDEX_MAX_KEY_LEN];
+	s__index_cursor_t cursor, cursor_;
+	uint64_t i, j, n, *a, *b;
+	int e;
+
+	cursor_ = NULL;
+	if (!(cursor = s__index_cursor_open(index)) ||
+	    !(cursor_ = s__index_cursor_open(index_))) {
+		s__index_cursor_close(cursor);
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	for (i=0; !e && (i<(N / 10)); ++i) {
+		n = 1 + (uint64_t)rand() % 12;
+		for (j=0; j<n; ++j) {
+			key[j] = (char)((rand() % 2) ?
+					BYTES[rand() % sizeof (BYTES)] :
+					(0x80 | rand()));
+		}
+		key[j] = '\0';
+		a = s__index_next(index, key, okey);
+		b = s__index_next(index_, key, okey_);
+		e |= (!a != !b) || (a && strcmp(okey, okey_));
+		a = s__index_prev(index, key, okey);
+		b = s__index_prev(index_, key, okey_);
+		e |= (!a != !b) || (a && strcmp(okey, okey_));
+		a = s__index_cursor_seek(cursor, key, NULL);
+		b = s__index_cursor_seek(cursor_, key, NULL);
+		e |= (!a != !b) ||
+			(a && strcmp(s__index_cursor_key(cursor),
+				     s__index_cursor_key(cursor_)));
+	}
+	s__index_cursor_close(cursor);
+	s__index_cursor_close(cursor_);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+integer(void)
+{
+	const uint64_t n = N / 2;
+	s__index_t indexes[2];
+	uint64_t t, i, k, *keys, *record;
+	int e;
+
+	indexes[0] = NULL;
+	indexes[1] = NULL;
+	if (!(keys = s__malloc(n * sizeof (keys[0]))) ||
+	    !(indexes[0] = s__index_open()) ||
+	    !(indexes[1] = s__index_open_u64())) {
+		s__index_close(indexes[0]);
+		S__FREE(keys);
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0; i<n; ++i) {
+		keys[i] = (i + 1 < n) ? (i + 1) * 0x9e3779b97f4a7c15 : 0;
+	}
+	e = 0;
+	for (k=0; (k<2) && !e; ++k) {
+		for (i=0; i<n; ++i) {
+			if (!(record = s__index_update_u64(indexes[k], keys[i]))) {
+				e = -1;
+				break;
+			}
+			(*record) = i + 1;
+		}
+		t = s__time();
+		for (i=0; i<n; ++i) {
+			record = s__index_find_u64(indexes[k], keys[i]);
+			if (!record || ((i + 1) != (*record))) {
+				e = -1;
+				break;
+			}
+		}
+		t = s__time() - t;
+		printf("\t        %20s %6.1fns\n",
+		       k ? "find-u64-fixed" : "find-u64-string",
+		       1e3 * t / n);
+	}
+	qsort(keys, n, sizeof (keys[0]), _u64_);
+	for (i=0; !e && (i<n); ++i) {
+		if (!(record = s__index_find_u64(indexes[1], keys[i]))) {
+			e = -1;
+			break;
+		}
+		(*record) = i + 1;
+	}
+	if (e ||
+	    s__index_update(indexes[1], "k:0") || /* not an integer key */
+	    s__index_find(indexes[1], "k:0") ||
+	    walk_u64(indexes[1], keys, n) ||
+	    bounds(indexes[0], indexes[1]) ||
+	    (1 != s__index_remove_u64(indexes[1], keys[0])) ||
+	    s__index_find_u64(indexes[1], keys[0]) ||
+	    !(record = s__index_update_u64(indexes[1], keys[0]))) {
+		e = -1;
+	}
+	else {
+		(*record) = 1;
+		if (s__index_compress(indexes[1]) ||
+		    walk_u64(indexes[1], keys, n)) {
+			e = -1;
+		}
+	}
+	s__index_close(indexes[0]);
+	s__index_close(indexes[1]);
+	S__FREE(keys);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static void
+fill(uint64_t *record, uint64_t i)
+{
+	uint64_t j;
+
+	for (j=0; j<RECORD / sizeof (record[0]); ++j) {
+		record[j] = i * RECORD + j;
+	}
+}
+
+static int
+payload(const uint64_t *record, uint64_t i)
+{
+	uint64_t j;
+
+	for (j=0; j<RECORD / sizeof (record[0]); ++j) {
+		if ((i * RECORD + j) != record[j]) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+payloads(s__index_t index, uint64_t n)
+{
+	s__index_cursor_t cursor;
+	uint64_t i, *record;
+	char key[32];
+
+	for (i=0; i<n; ++i) {
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+		if (!(record = s__index_find(index, key)) ||
+		    payload(record, i)) {
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+	}
+	if (!(cursor = s__index_cursor_open(index))) {
+		S__TRACE(0);
+		return -1;
+	}
+	i = 0;
+	record = s__index_cursor_seek(cursor, NULL, NULL);
+	while (record) {
+		if (payload(record, i++)) {
+			break;
+		}
+		record = s__index_cursor_next(cursor);
+	}
+	s__index_cursor_close(cursor);
+	if (record || (i != n)) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+wide(s__index_t (*open)(void))
+{
+	const uint64_t n = N / 10;
+	const uint64_t WORDS = RECORD / sizeof (uint64_t);
+	s__index_t index, index_, mapped;
+	uint64_t i, *record, *records;
+	const char **keys;
+	char *buf;
+	int e;
+
+	index = index_ = mapped = NULL;
+	keys = NULL;
+	buf = NULL;
+	if (!(records = s__malloc(n * RECORD)) ||
+	    !(keys = s__malloc(n * sizeof (keys[0]))) ||
+	    !(buf = s__malloc(n * 16)) ||
+	    !(index = open()) ||
+	    !(index_ = open()) ||
+	    s__index_record_size(index, RECORD) ||
+	    s__index_record_size(index_, RECORD)) {
+		s__index_close(index);
+		s__index_close(index_);
+		S__FREE(records);
+		S__FREE(keys);
+		S__FREE(buf);
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	for (i=0; i<n; ++i) {
+		s__sprintf(buf + i * 16, 16, "k:%012lu", UL(i));
+		keys[i] = buf + i * 16;
+		fill(records + i * WORDS, i);
+		if (!(record = s__index_update(index, keys[i]))) {
+			e = -1;
+			break;
+		}
+		fill(record, i);
+	}
+	if (e ||
+	    payloads(index, n) ||
+	    s__index_load(index_, keys, records, n) ||
+	    payloads(index_, n) ||
+	    s__index_compress(index) ||
+	    payloads(index, n) ||
+	    s__index_save(index, PATHNAME) ||
+	    !(mapped = s__index_mmap(PATHNAME)) ||
+	    payloads(mapped, n) ||
+	    s__index_delta(index, n)) {
+		e = -1;
+	}
+	for (i=n; !e && (i<2 * n); ++i) {
+		s__sprintf(buf, 16, "k:%012lu", UL(i));
+		if (!(record = s__index_update(index, buf))) {
+			e = -1;
+			break;
+		}
+		fill(record, i);
+	}
+	if (e ||
+	    payloads(index, 2 * n) ||
+	    s__index_merge(index) ||
+	    payloads(index, 2 * n)) {
+		e = -1;
+	}
+	s__index_close(index);
+	s__index_close(index_);
+	s__index_close(mapped);
+	s__unlink(PATHNAME);
+	S__FREE(records);
+	S__FREE(keys);
+	S__FREE(buf);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+coded(void)
+{
+	s__index_t index;
+	uint64_t ops;
+	int e;
+
+	if (!(index = s__index_open_coded())) {
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	if (concurrent(index, 2, &ops) ||
+	    removes(index, N, 0, -1) ||
+	    removes(index, N, 1, -1) ||
+	    removes(index, N, 2, -1) ||
+	    verify(index, N, 7) ||
+	    removes(index, N, 1, 1) ||
+	    verify(index, N, 5) ||
+	    removes(index, N, 1, -1) ||
+	    verify(index, N, 7)) {
+		e = -1;
+	}
+	s__index_close(index);
+	if (e || !(index = s__index_open_coded())) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	e = urls(index);
+	s__index_close(index);
+	if (e ||
+	    removal(s__index_open_coded) ||
+	    prefix(s__index_open_coded)) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+shape(s__index_t index,
+      uint64_t tree,
+      uint64_t succinct,
+      uint64_t lens3,
+      uint64_t lens4)
+{
+	struct s__index_stats stats;
+	uint64_t i, n;
+
+	if (s__index_stats(index, &stats)) {
+		S__TRACE(0);
+		return -1;
+	}
+	for (i=0, n=0; i<S__INDEX_STATS_LENS; ++i) {
+		n += stats.lens[i];
+	}
+	if ((tree != stats.tree.keys) ||
+	    (succinct != stats.succinct.keys) ||
+	    ((tree + succinct) != stats.items) ||
+	    (lens3 != stats.lens[3]) ||
+	    (lens4 != stats.lens[4]) ||
+	    (stats.items != n) ||
+	    (stats.tree.used > stats.tree.allocated) ||
+	    (stats.succinct.used > stats.succinct.allocated) ||
+	    ((stats.tree.used + stats.succinct.used) != stats.used) ||
+	    (tree && !stats.tree.used) ||
+	    (tree && (1.0 > stats.tree.avg_depth)) ||
+	    (succinct && (1.0 > stats.succinct.avg_depth)) ||
+	    (stats.avg_depth > stats.max_depth) ||
+	    (stats.tree.nodes < stats.tree.keys) ||
+	    (stats.succinct.nodes < stats.succinct.keys)) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+statistics(s__index_t (*open)(void))
+{
+	const uint64_t n = N / 10;
+	uint64_t *record;
+	s__index_t index;
+	int e;
+
+	if (!(index = open())) {
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	if (shape(index, 0, 0, 0, 0) ||
+	    removes(index, n, 0, -1) ||
+	    removes(index, n, 1, -1) ||
+	    removes(index, n, 2, -1) ||
+	    shape(index, n, 0, n, 0) ||
+	    s__index_compress(index) ||
+	    shape(index, 0, n, n, 0) ||
+	    s__index_delta(index, N) ||
+	    !(record = s__index_update(index, "k:000000000001:x")) ||
+	    (1 != s__index_remove(index, "k:000000000002")) ||
+	    shape(index, 1, n - 1, n - 1, 1)) {
+		e = -1;
+	}
+	s__index_close(index);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+bench(void)
+{
+	const struct s__json_node *node;
+	struct s__index_bench config;
+	s__json_t json;
+	FILE *file;
+	char *buf;
+	long n;
+	int e;
+
+	memset(&config, 0, sizeof (struct s__index_bench));
+	config.open = s__index_open_coded;
+	config.keys = N / 100;
+	config.min_len = 4;
+	config.max_len = 40;
+	config.zipf = 1;
+	config.prefix = 12;
+	config.threads = 2;
+	if (!(file = tmpfile())) {
+		S__TRACE(S__ERR_FILE_OPEN);
+		return -1;
+	}
+	buf = NULL;
+	if (s__index_bench(&config, file) ||
+	    (0 > (n = ftell(file))) ||
+	    fseek(file, 0, SEEK_SET) ||
+	    !(buf = s__malloc((uint64_t)n + 1)) ||
+	    (n && (1 != fread(buf, (size_t)n, 1, file)))) {
+		fclose(file);
+		S__FREE(buf);
+		S__TRACE(0);
+		return -1;
+	}
+	fclose(file);
+	buf[n] = '\0';
+	e = -1;
+	if ((json = s__json_open(buf))) {
+		node = s__json_root(json);
+		if ((S__JSON_NODE_OP_OBJECT == node->op) &&
+		    !strcmp("config", node->u.object.key) &&
+		    (node = node->u.object.link) &&
+		    !strcmp("phases", node->u.object.key) &&
+		    (S__JSON_NODE_OP_ARRAY == node->u.object.node->op)) {
+			e = 0;
+		}
+		s__json_close(json);
+	}
+	S__FREE(buf);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+save(s__index_succinct_t succinct, const char *pathname)
+{
+	FILE *file;
+
+	if (!(file = fopen(pathname, "wb"))) {
+		S__TRACE(S__ERR_FILE_OPEN);
+		return -1;
+	}
+	if (s__index_succinct_save(succinct, file)) {
+		fclose(file);
+		S__TRACE(0);
+		return -1;
+	}
+	if (fclose(file)) {
+		S__TRACE(S__ERR_FILE_WRITE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+compare(s__index_succinct_t a, s__index_succinct_t b)
+{
+	uint64_t n1, n2;
+	void *map1, *map2;
+	int e;
+
+	e = -1;
+	n1 = n2 = 0;
+	map1 = map2 = NULL;
+	if (!save(a, PATHNAME) &&
+	    !save(b, PATHNAME2) &&
+	    (map1 = s__file_map(PATHNAME, &n1)) &&
+	    (map2 = s__file_map(PATHNAME2, &n2)) &&
+	    (n1 == n2) && !memcmp(map1, map2, n1)) {
+		e = 0;
+	}
+	s__file_unmap(map1, n1);
+	s__file_unmap(map2, n2);
+	s__unlink(PATHNAME);
+	s__unlink(PATHNAME2);
+	return e;
+}
+
+struct scanned {
+	char first[32];
+	char last[32];
+	uint64_t n;
+	uint64_t sum;
+	int error;
+};
+
+static int
+_scanned_(void *ctx, const char *key, const uint64_t *record)
+{
+	struct scanned *scanned;
+
+	scanned = (struct scanned *)ctx;
+	if (scanned->n && (0 <= strcmp(scanned->last, key))) {
+		scanned->error = -1;
+	}
+	if (!scanned->n) {
+		s__sprintf(scanned->first, sizeof (scanned->first), "%s", key);
+	}
+	s__sprintf(scanned->last, sizeof (scanned->last), "%s", key);
+	scanned->n += 1;
+	scanned->sum += (*record);
+	return 0;
+}
+
+static int
+scans(s__index_tree_t tree, uint64_t n, int threads)
+{
+	struct scanned scanned[8];
+	const char *last;
+	void *ctxs[8];
+	uint64_t m, sum;
+	int k;
+
+	memset(scanned, 0, sizeof (scanned));
+	for (k=0; k<threads; ++k) {
+		ctxs[k] = &scanned[k];
+	}
+	if ((1 == threads) ?
+	    s__index_tree_iterate_sorted(tree, _scanned_, ctxs[0]) :
+	    s__index_tree_iterate_parallel(tree, threads, _scanned_, ctxs)) {
+		S__TRACE(0);
+		return -1;
+	}
+	m = 0;
+	sum = 0;
+	last = NULL;
+	for (k=0; k<threads; ++k) {
+		if (scanned[k].error ||
+		    (last && scanned[k].n &&
+		     (0 <= strcmp(last, scanned[k].first)))) {
+			S__TRACE(S__ERR_SOFTWARE);
+			return -1;
+		}
+		last = scanned[k].n ? scanned[k].last : last;
+		m += scanned[k].n;
+		sum += scanned[k].sum;
+	}
+	if ((n != m) || ((n * (n + 1) / 2) != sum)) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+iterate(s__index_tree_t (*open)(uint64_t record_size))
+{
+	const int THREADS[] = { 1, 2, 3, 8 };
+	uint64_t i, j, n, *record;
+	s__index_tree_t tree;
+	char key[32];
+	int k, e;
+
+	if (!(tree = open(8))) {
+		S__TRACE(0);
+		return -1;
+	}
+	e = 0;
+	for (n=0; !e && (n<=N / 10); n=(n ? (n * 10) : 1)) {
+		s__index_tree_truncate(tree);
+		for (i=0; i<n; ++i) {
+			j = (i * 7919) % n; /* n is a power of ten */
+			s__sprintf(key, sizeof (key), "k:%012lu", UL(j));
+			if (!(record = s__index_tree_update(tree, key))) {
+				e = -1;
+				break;
+			}
+			(*record) = j + 1;
+		}
+		for (k=0; !e && (k<(int)S__ARRAY_SIZE(THREADS)); ++k) {
+			e = scans(tree, n, THREADS[k]);
+		}
+	}
+	s__index_tree_close(tree);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+_sorted_(void *ctx, int rewind, const char **key, uint64_t *record)
+{
+	s__index_tree_cursor_t cursor;
+	uint64_t *record_;
+
+	cursor = (s__index_tree_cursor_t)ctx;
+	if (rewind) {
+		record_ = s__index_tree_cursor_seek(cursor, NULL);
+	}
+	else {
+		record_ = s__index_tree_cursor_next(cursor);
+	}
+	if (!record_) {
+		return 0;
+	}
+	(*key) = s__index_tree_cursor_key(cursor);
+	(*record) = (*record_);
+	return 1;
+}
+
+static int
+sorted(s__index_tree_t tree, s__index_tree_cursor_t cursor)
+{
+	uint64_t *record, *record_;
+	s__index_t index;
+	const char *key;
+	int e;
+
+	if (!(index = s__index_open()) ||
+	    s__index_compress_sorted(index, _sorted_, cursor)) {
+		s__index_close(index);
+		S__TRACE(0);
+		return -1;
+	}
+	e = (s__index_tree_items(tree) != s__index_items(index)) ? -1 : 0;
+	record = s__index_tree_cursor_seek(cursor, NULL);
+	while (!e && record) {
+		key = s__index_tree_cursor_key(cursor);
+		record_ = s__index_find(index, key);
+		if (!record_ || ((*record_) != (*record))) {
+			e = -1;
+		}
+		record = s__index_tree_cursor_next(cursor);
+	}
+	s__index_close(index);
+	return e;
+}
+
+static int
+parallel(void)
+{
+	const char *ALPHABET[] = { "ab", "abcdefgh", "\x01\x7f\x80\xff" };
+	s__index_tree_cursor_t cursor;
+	s__index_succinct_t a, b;
+	uint64_t i, j, k, n, *record;
+	s__index_tree_t tree;
+	char key[64];
+	int e;
+
+	e = 0;
+	cursor = NULL;
+	if (!(tree = s__index_tree_open(8)) ||
+	    !(cursor = s__index_tree_cursor_open(tree))) {
+		s__index_tree_close(tree);
+		S__TRACE(0);
+		return -1;
+	}
+	for (k=0; !e && (k<12); ++k) {
+		s__index_tree_truncate(tree);
+		n = (k < 3) ? k : (uint64_t)rand() % (N / 10);
+		for (i=0; i<n; ++i) {
+			j = 0;
+			if (k % 2) {
+				memcpy(key, "common/", 7);
+				j = 7;
+			}
+			while ((j < 16) && (!j || (rand() % 8))) {
+				key[j++] = ALPHABET[k % 3][rand() %
+					(int)strlen(ALPHABET[k % 3])];
+			}
+			key[j] = '\0';
+			if (!(record = s__index_tree_update(tree, key))) {
+				e = -1;
+				break;
+			}
+			(*record) = i;
+		}
+		a = b = NULL;
+		n = s__index_tree_items(tree);
+		if (e ||
+		    !(a = s__index_succinct_stream(_sorted_, cursor, 8)) ||
+		    !(b = s__index_succinct_build(tree, 4)) ||
+		    (n != s__index_succinct_items(b)) ||
+		    (n && compare(a, b)) ||
+		    sorted(tree, cursor)) {
+			e = -1;
+		}
+		s__index_succinct_close(a);
+		s__index_succinct_close(b);
+	}
+	s__index_tree_cursor_close(cursor);
+	s__index_tree_close(tree);
+	if (e) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+sharded(void)
+{
+	uint64_t t, i, j, *order, *records, *record;
+	char *buf, key[64], okey[64];
+	s__index_sharded_t sharded;
+	const char **keys;
+	int k;
+
+	sharded = NULL;
+	keys = NULL;
+	order = NULL;
+	records = NULL;
+	if (!(buf = s__malloc(N * 16)) ||
+	    !(keys = s__malloc(N * sizeof (keys[0]))) ||
+	    !(records = s__malloc(N * sizeof (records[0]))) ||
+	    !(sharded = s__index_sharded_open(8))) {
+		S__FREE(buf);
+		S__FREE(keys);
+		S__FREE(records);
+		S__TRACE(0);
+		return -1;
+	}
+	order = records;
+	for (i=0; i<N; ++i) {
+		order[i] = i;
+	}
+	for (i=N-1; i; --i) {
+		j = (uint64_t)rand() % (i + 1);
+		t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+	for (i=0; i<N; ++i) {
+		s__sprintf(buf + i * 16, 16, "k:%012lu", UL(order[i]));
+		keys[i] = buf + i * 16;
+		records[i] = order[i] + 1;
+	}
+	t = s__time();
+	if (s__index_sharded_ingest(sharded, keys, records, N)) {
+		s__index_sharded_close(sharded);
+		S__FREE(buf);
+		S__FREE(keys);
+		S__FREE(records);
+		S__TRACE(0);
+		return -1;
+	}
+	t = s__time() - t;
+	printf("\t        %20s %6.1fs\n", "ingest", 1e-6 * t);
+	for (k=0; k<2; ++k) {
+		if (k && s__index_sharded_compress(sharded)) {
+			break;
+		}
+		if (N != s__index_sharded_items(sharded)) {
+			break;
+		}
+		for (i=0; i<N; ++i) {
+			record = s__index_sharded_find(sharded, keys[i]);
+			if (!record || (records[i] != (*record))) {
+				break;
+			}
+		}
+		if (N != i) {
+			break;
+		}
+		i = 0;
+		record = s__index_sharded_next(sharded, NULL, okey);
+		while (record && (i < (N / 8))) {
+			s__sprintf(key, sizeof (key), "k:%012lu", UL(i));
+			if (((i + 1) != (*record)) || strcmp(key, okey)) {
+				break;
+			}
+			record = s__index_sharded_next(sharded, okey, okey);
+			++i;
+		}
+		if ((N / 8) != i) {
+			break;
+		}
+		i = N;
+		record = s__index_sharded_prev(sharded, NULL, okey);
+		while (record && ((N - N / 8) < i)) {
+			s__sprintf(key, sizeof (key), "k:%012lu", UL(i - 1));
+			if ((i != (*record)) || strcmp(key, okey)) {
+				break;
+			}
+			record = s__index_sharded_prev(sharded, okey, okey);
+			--i;
+		}
+		if ((N - N / 8) != i) {
+			break;
+		}
+	}
+	s__index_sharded_close(sharded);
+	S__FREE(buf);
+	S__FREE(keys);
+	S__FREE(records);
+	if (2 != k) {
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+corrupt(const char *content, uint64_t size)
+{
+	s__index_t mapped;
+	FILE *file;
+
+	if (!(file = fopen(PATHNAME, "wb")) ||
+	    (size && (1 != fwrite(content, (size_t)size, 1, file)))) {
+		if (file) {
+			fclose(file);
+		}
+		S__TRACE(S__ERR_FILE_WRITE);
+		return -1;
+	}
+	fclose(file);
+	if ((mapped = s__index_mmap(PATHNAME))) {
+		s__index_close(mapped);
+		S__TRACE(S__ERR_SOFTWARE);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+corrupts(s__index_t index)
+{
+	uint64_t i, size, *header;
+	char *content;
+	void *map;
+	int e;
+
+	if (s__index_save(index, PATHNAME) ||
+	    !(map = s__file_map(PATHNAME, &size))) {
+		s__unlink(PATHNAME);
+		S__TRACE(0);
+		return -1;
+	}
+	if (!(content = s__malloc(size))) {
+		s__file_unmap(map, size);
+		s__unlink(PATHNAME);
+		S__TRACE(0);
+		return -1;
+	}
+	memcpy(content, map, size);
+	s__file_unmap(map, size);
+	e = 0;
+	for (i=1; !e && (i<16); ++i) {
+		e = corrupt(content, size * i / 16);
+	}
+	header = (uint64_t *)content;
+	for (i=3; !e && (i<5); ++i) {
+		header[i] = ~header[i];
+		e = corrupt(content, size);
+		header[i] = ~header[i];
+	}
+	S__FREE(content);
+	s__unlink(PATHNAME);
+	if (e) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
 
 int
 s__index_bist(void)
 {
 	uint64_t t, i, j, *record;
 	char key[64], okey[64];
-	s__index_t index;
+	s__index_t index, mapped;
+
+	printf("---=== INDEX BIST ===---\n");
+
+	/* bitmap rank & select */
+
+	t = s__time();
+	if (bitmap()) {
+		S__TRACE(0);
+		TEST("bitmap", -1);
+		return -1;
+	}
+	TEST("bitmap", 0);
+
+	/* concurrent readers & writer */
+
+	t = s__time();
+	if (scaling()) {
+		S__TRACE(0);
+		TEST("concurrent", -1);
+		return -1;
+	}
+	TEST("concurrent", 0);
+
+	/* sharded ingest */
+
+	t = s__time();
+	if (sharded()) {
+		S__TRACE(0);
+		TEST("sharded", -1);
+		return -1;
+	}
+	TEST("sharded", 0);
+
+	/* parallel compress */
+
+	t = s__time();
+	if (parallel()) {
+		S__TRACE(0);
+		TEST("parallel-compress", -1);
+		return -1;
+	}
+	TEST("parallel-compress", 0);
+
+	/* sorted and parallel iteration */
+
+	t = s__time();
+	if (iterate(s__index_tree_open) ||
+	    iterate(s__index_tree_open_art) ||
+	    iterate(s__index_tree_open_coded)) {
+		S__TRACE(0);
+		TEST("iterate", -1);
+		return -1;
+	}
+	TEST("iterate", 0);
+
+	/* delta merge */
+
+	t = s__time();
+	if (delta()) {
+		S__TRACE(0);
+		TEST("delta-merge", -1);
+		return -1;
+	}
+	TEST("delta-merge", 0);
+
+	/* delta stores racing merges */
+
+	t = s__time();
+	if (writes()) {
+		S__TRACE(0);
+		TEST("delta-writes", -1);
+		return -1;
+	}
+	TEST("delta-writes", 0);
+
+	/* removal */
+
+	t = s__time();
+	if (removal(s__index_open)) {
+		S__TRACE(0);
+		TEST("removal", -1);
+		return -1;
+	}
+	TEST("removal", 0);
+
+	/* bulk load */
+
+	t = s__time();
+	if (loading()) {
+		S__TRACE(0);
+		TEST("load", -1);
+		return -1;
+	}
+	TEST("load", 0);
+
+	/* adaptive radix tree */
+
+	t = s__time();
+	if (art()) {
+		S__TRACE(0);
+		TEST("art", -1);
+		return -1;
+	}
+	TEST("art", 0);
+
+	/* front coded tree */
+
+	t = s__time();
+	if (coded()) {
+		S__TRACE(0);
+		TEST("coded", -1);
+		return -1;
+	}
+	TEST("coded", 0);
+
+	/* binary & integer keys */
+
+	t = s__time();
+	if (binary(s__index_open) ||
+	    binary(s__index_open_art) ||
+	    integer()) {
+		S__TRACE(0);
+		TEST("binary", -1);
+		return -1;
+	}
+	TEST("binary", 0);
+
+	/* wide records */
+
+	t = s__time();
+	if (wide(s__index_open) ||
+	    wide(s__index_open_art) ||
+	    wide(s__index_open_coded)) {
+		S__TRACE(0);
+		TEST("records", -1);
+		return -1;
+	}
+	TEST("records", 0);
+
+	/* fuzzy search */
+
+	t = s__time();
+	if (fuzzy(s__index_open) ||
+	    fuzzy(s__index_open_art) ||
+	    fuzzy(s__index_open_coded)) {
+		S__TRACE(0);
+		TEST("fuzzy", -1);
+		return -1;
+	}
+	TEST("fuzzy", 0);
+
+	/* negative lookup filter */
+
+	t = s__time();
+	if (filter()) {
+		S__TRACE(0);
+		TEST("filter", -1);
+		return -1;
+	}
+	TEST("filter", 0);
+
+	/* collapsed chains */
+
+	t = s__time();
+	if (collapse()) {
+		S__TRACE(0);
+		TEST("collapse", -1);
+		return -1;
+	}
+	TEST("collapse", 0);
+
+	/* packed records */
+
+	t = s__time();
+	if (pack()) {
+		S__TRACE(0);
+		TEST("pack", -1);
+		return -1;
+	}
+	TEST("pack", 0);
+
+	/* durability log */
+
+	t = s__time();
+	if (logs()) {
+		S__TRACE(0);
+		TEST("log", -1);
+		return -1;
+	}
+	TEST("log", 0);
+
+	/* statistics */
+
+	t = s__time();
+	if (statistics(s__index_open) ||
+	    statistics(s__index_open_art) ||
+	    statistics(s__index_open_coded)) {
+		S__TRACE(0);
+		TEST("stats", -1);
+		return -1;
+	}
+	TEST("stats", 0);
+
+	/* benchmark */
+
+	t = s__time();
+	if (bench()) {
+		S__TRACE(0);
+		TEST("bench", -1);
+		return -1;
+	}
+	TEST("bench", 0);
+
+	/* prefix iterate & count */
+
+	t = s__time();
+	if (prefix(s__index_open)) {
+		S__TRACE(0);
+		TEST("prefix", -1);
+		return -1;
+	}
+	TEST("prefix", 0);
 
 	/* initialize */
 
-	printf("---=== INDEX BIST ===---\n");
 	t = s__time();
 	if (!(index = s__index_open())) {
 		S__TRACE(0);
@@ -223,6 +3117,26 @@ s__index_bist(void)
 	}
 	TEST("random-find", 0);
 
+	/* cursor */
+
+	if (cursor(index)) {
+		s__index_close(index);
+		S__TRACE(0);
+		TEST("cursor", -1);
+		return -1;
+	}
+	TEST("cursor", 0);
+
+	/* batch find */
+
+	if (batch(index)) {
+		s__index_close(index);
+		S__TRACE(0);
+		TEST("batch-find", -1);
+		return -1;
+	}
+	TEST("batch-find", 0);
+
 	/* compress */
 
 	if (s__index_compress(index) || (N != s__index_items(index))) {
@@ -296,6 +3210,70 @@ s__index_bist(void)
 	}
 	TEST("prev-find", 0);
 
+	/* cursor */
+
+	if (cursor(index)) {
+		s__index_close(index);
+		S__TRACE(0);
+		TEST("cursor", -1);
+		return -1;
+	}
+	TEST("cursor", 0);
+
+	/* batch find */
+
+	if (batch(index)) {
+		s__index_close(index);
+		S__TRACE(0);
+		TEST("batch-find", -1);
+		return -1;
+	}
+	TEST("batch-find", 0);
+
+	/* save & mmap */
+
+	if (s__index_save(index, PATHNAME) ||
+	    !(mapped = s__index_mmap(PATHNAME))) {
+		s__index_close(index);
+		s__unlink(PATHNAME);
+		S__TRACE(0);
+		TEST("save-mmap", -1);
+		return -1;
+	}
+	s__unlink(PATHNAME);
+	if ((N != s__index_items(mapped)) ||
+	    !(record = s__index_next(mapped, NULL, okey)) ||
+	    (1 != (*record)) || strcmp("k:000000000000", okey) ||
+	    !(record = s__index_prev(mapped, NULL, okey)) ||
+	    (N != (*record))) {
+		s__index_close(index);
+		s__index_close(mapped);
+		S__TRACE(S__ERR_SOFTWARE);
+		TEST("save-mmap", -1);
+		return -1;
+	}
+	for (i=0; i<N; ++i) {
+		j = (uint64_t)rand() % N;
+		s__sprintf(key, sizeof (key), "k:%012lu", UL(j));
+		if (!(record = s__index_find(mapped, key)) ||
+		    ((j + 1) != (*record)) ||
+		    (record == s__index_find(index, key))) {
+			s__index_close(index);
+			s__index_close(mapped);
+			S__TRACE(S__ERR_SOFTWARE);
+			TEST("save-mmap", -1);
+			return -1;
+		}
+	}
+	s__index_close(mapped);
+	if (corrupts(index)) {
+		s__index_close(index);
+		S__TRACE(0);
+		TEST("save-mmap", -1);
+		return -1;
+	}
+	TEST("save-mmap", 0);
+
 	/* done */
 
 	s__index_close(index);
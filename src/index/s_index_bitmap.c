@@ -6,12 +6,66 @@
 
 #include "s_index_bitmap.h"
 
+#define ALIGN 64
+#define SAMPLE 512 /* ones per select sample */
+
+/**
+ * Rank directory (rank9): for every superblock of eight words, counts[2k]
+ * holds the number of ones preceding the superblock and counts[2k + 1]
+ * packs seven 9-bit counts of the ones preceding words 1..7 within the
+ * superblock. A trailing superblock holds the total number of ones.
+ *
+ * Select directory: samples[j] holds the superblock containing the
+ * (j * SAMPLE + 1)-th one, narrowing the superblock search.
+ */
+
 struct s__index_bitmap {
+	int mapped;
 	uint64_t size;
+	uint64_t ones;
 	uint64_t *memory;
-	uint32_t *popcount;
+	uint64_t *counts;
+	uint64_t *samples;
 };
 
+static uint64_t
+supers(const struct s__index_bitmap *bitmap)
+{
+	return S__DUP(bitmap->size, 8) + 1;
+}
+
+static uint64_t
+nsamples(const struct s__index_bitmap *bitmap)
+{
+	return S__DUP(bitmap->ones, SAMPLE) + 1;
+}
+
+#define L8 0x0101010101010101
+#define H8 0x8080808080808080
+
+/**
+ * Broadword select: after a bytewise popcount, a multiply leaves in byte b
+ * the ones in bytes 0..b, one subtraction compares all eight sums with k,
+ * and the byte holding the k-th one is found without a loop.
+ */
+
+static uint64_t
+word_select(uint64_t x, uint64_t k)
+{
+	uint64_t s, i;
+
+	s = x - ((x >> 1) & 0x5555555555555555);
+	s = (s & 0x3333333333333333) + ((s >> 2) & 0x3333333333333333);
+	s = (((s + (s >> 4)) & 0x0f0f0f0f0f0f0f0f) * L8);
+	i = ((((((((k - 1) * L8) | H8) - s) & H8) >> 7) * L8) >> 53) & 0x78;
+	k -= ((s << 8) >> i) & 0xff;
+	x = (x >> i) & 0xff;
+	while (--k) {
+		x &= x - 1;
+	}
+	return i + s__ctz(x);
+}
+
 s__index_bitmap_t
 s__index_bitmap_open(uint64_t size)
 {
@@ -27,15 +81,15 @@ s__index_bitmap_open(uint64_t size)
 	memset(bitmap, 0, sizeof (struct s__index_bitmap));
 	bitmap->size = S__DUP(size, 64);
 	n1 = bitmap->size * sizeof (bitmap->memory[0]);
-	n2 = bitmap->size * sizeof (bitmap->popcount[0]);
+	n2 = supers(bitmap) * 2 * sizeof (bitmap->counts[0]);
 	if (!(bitmap->memory = s__malloc(n1)) ||
-	    !(bitmap->popcount = s__malloc(n2))) {
+	    !(bitmap->counts = s__malloc(n2))) {
 		s__index_bitmap_close(bitmap);
 		S__TRACE(0);
 		return NULL;
 	}
 	memset(bitmap->memory, 0, n1);
-	memset(bitmap->popcount, 0, n2);
+	memset(bitmap->counts, 0, n2);
 	return bitmap;
 }
 
@@ -43,54 +97,228 @@ void
 s__index_bitmap_close(s__index_bitmap_t bitmap)
 {
 	if (bitmap) {
-		S__FREE(bitmap->memory);
-		S__FREE(bitmap->popcount);
+		if (!bitmap->mapped) {
+			S__FREE(bitmap->memory);
+			S__FREE(bitmap->counts);
+			S__FREE(bitmap->samples);
+		}
 		memset(bitmap, 0, sizeof (struct s__index_bitmap));
 	}
 	S__FREE(bitmap);
 }
 
-void
+int
+s__index_bitmap_save(s__index_bitmap_t bitmap, FILE *file)
+{
+	uint64_t header[2], n1, n2, n3;
+
+	assert( bitmap );
+	assert( bitmap->samples );
+	assert( file );
+
+	header[0] = bitmap->size;
+	header[1] = bitmap->ones;
+	n1 = bitmap->size * sizeof (bitmap->memory[0]);
+	n2 = supers(bitmap) * 2 * sizeof (bitmap->counts[0]);
+	n3 = nsamples(bitmap) * sizeof (bitmap->samples[0]);
+	if (s__file_write_aligned(file, header, sizeof (header), ALIGN) ||
+	    s__file_write_aligned(file, bitmap->memory, n1, ALIGN) ||
+	    s__file_write_aligned(file, bitmap->counts, n2, ALIGN) ||
+	    s__file_write_aligned(file, bitmap->samples, n3, ALIGN)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+s__index_bitmap_t
+s__index_bitmap_map(void *map, uint64_t size, uint64_t bits, uint64_t *n)
+{
+	struct s__index_bitmap *bitmap, probe;
+	uint64_t i, n1, n2, n3;
+	char *p;
+
+	assert( map );
+	assert( n );
+
+	p = (char *)map;
+	if (ALIGN > size) {
+		S__TRACE(S__ERR_FILE_READ);
+		return NULL;
+	}
+	memset(&probe, 0, sizeof (struct s__index_bitmap));
+	probe.size = ((uint64_t *)p)[0];
+	probe.ones = ((uint64_t *)p)[1];
+	if ((S__DUP(bits, 64) != probe.size) ||
+	    ((size / sizeof (probe.memory[0])) < probe.size) ||
+	    ((probe.size * 64) < probe.ones)) {
+		S__TRACE(S__ERR_CHECKSUM);
+		return NULL;
+	}
+	n1 = probe.size * sizeof (probe.memory[0]);
+	n2 = supers(&probe) * 2 * sizeof (probe.counts[0]);
+	n3 = nsamples(&probe) * sizeof (probe.samples[0]);
+	n1 = S__DUP(n1, ALIGN) * ALIGN;
+	n2 = S__DUP(n2, ALIGN) * ALIGN;
+	n3 = S__DUP(n3, ALIGN) * ALIGN;
+	if ((size - ALIGN) < (n1 + n2 + n3)) {
+		S__TRACE(S__ERR_FILE_READ);
+		return NULL;
+	}
+	probe.counts = (uint64_t *)(p + ALIGN + n1);
+	probe.samples = (uint64_t *)(p + ALIGN + n1 + n2);
+	if (probe.ones != probe.counts[2 * (supers(&probe) - 1)]) {
+		S__TRACE(S__ERR_CHECKSUM);
+		return NULL;
+	}
+	for (i=0; i<nsamples(&probe); ++i) {
+		if (supers(&probe) <= probe.samples[i]) {
+			S__TRACE(S__ERR_CHECKSUM);
+			return NULL;
+		}
+	}
+	if (!(bitmap = s__malloc(sizeof (struct s__index_bitmap)))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memcpy(bitmap, &probe, sizeof (struct s__index_bitmap));
+	bitmap->mapped = 1;
+	bitmap->memory = (uint64_t *)(p + ALIGN);
+	(*n) = ALIGN + n1 + n2 + n3;
+	return bitmap;
+}
+
+int
 s__index_bitmap_prepare(s__index_bitmap_t bitmap)
 {
-	uint64_t i, popcount;
+	uint64_t i, j, k, ones, local, n, *counts;
 
 	assert( bitmap );
+	assert( !bitmap->mapped );
 
-	popcount = 0;
-	for (i=0; i<bitmap->size; ++i) {
-		popcount += s__popcount(bitmap->memory[i]);
-		bitmap->popcount[i] = (uint32_t)popcount;
+	ones = 0;
+	for (i=0; i<supers(bitmap); ++i) {
+		local = 0;
+		counts = &bitmap->counts[2 * i];
+		counts[0] = ones;
+		counts[1] = 0;
+		for (j=0; j<8; ++j) {
+			if (j) {
+				counts[1] |= local << (9 * (j - 1));
+			}
+			if ((i * 8 + j) < bitmap->size) {
+				local += s__popcount(bitmap->memory[i * 8 + j]);
+			}
+		}
+		ones += local;
+	}
+	bitmap->ones = ones;
+	S__FREE(bitmap->samples);
+	n = nsamples(bitmap) * sizeof (bitmap->samples[0]);
+	if (!(bitmap->samples = s__malloc(n))) {
+		S__TRACE(0);
+		return -1;
 	}
+	for (i=0, k=0; i<(nsamples(bitmap) - 1); ++i) {
+		while (bitmap->counts[2 * (k + 1)] < (i * SAMPLE + 1)) {
+			++k;
+		}
+		bitmap->samples[i] = k;
+	}
+	bitmap->samples[i] = supers(bitmap) - 1;
+	return 0;
 }
 
 uint64_t
 s__index_bitmap_rank(s__index_bitmap_t bitmap, uint64_t i)
 {
-	union { uint64_t *p64; uint32_t *p32; uint16_t *p16; } u;
-	uint64_t q = i / 64;
-	uint64_t r = i % 64;
-	uint64_t popcount;
+	const uint64_t Q = i / 64;
+	const uint64_t R = i % 64;
+	const uint64_t S = Q / 8;
+	const uint64_t W = Q % 8;
+	uint64_t rank;
+
+	assert( bitmap );
+	assert( Q < bitmap->size );
+
+	rank = bitmap->counts[2 * S];
+	if (W) {
+		rank += (bitmap->counts[2 * S + 1] >> (9 * (W - 1))) & 0x1ff;
+	}
+	return rank + s__popcount(bitmap->memory[Q] &
+				  ((((uint64_t)2) << R) - 1));
+}
+
+void
+s__index_bitmap_prefetch(s__index_bitmap_t bitmap, uint64_t i)
+{
+	const uint64_t Q = i / 64;
+
+	assert( bitmap );
+	assert( Q < bitmap->size );
+
+	s__prefetch(&bitmap->memory[Q]);
+	s__prefetch(&bitmap->counts[2 * (Q / 8)]);
+}
+
+uint64_t
+s__index_bitmap_select(s__index_bitmap_t bitmap, uint64_t k)
+{
+	uint64_t lo, hi, mid, w, i, base, local, next;
 
 	assert( bitmap );
-	assert( q < bitmap->size );
+	assert( bitmap->samples );
+	assert( k && (k <= bitmap->ones) );
 
-	u.p64 = &bitmap->memory[q];
-	popcount = (q ? bitmap->popcount[q - 1] : 0);
-	if (32 <= r) {
-		popcount += s__popcount(*u.p32);
-		u.p32 += 1;
-		r -= 32;
+	lo = bitmap->samples[(k - 1) / SAMPLE];
+	hi = bitmap->samples[(k - 1) / SAMPLE + 1];
+	/* the superblock words load while the search waits on counts */
+	for (mid=lo; (mid<=hi) && (mid<(lo + 4)); ++mid) {
+		if ((mid * 8) < bitmap->size) {
+			s__prefetch(&bitmap->memory[mid * 8]);
+		}
 	}
-	if (16 <= r) {
-		popcount += s__popcount(*u.p16);
-		u.p16 += 1;
-		r -= 16;
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		if (bitmap->counts[2 * mid] < k) {
+			lo = mid;
+		}
+		else {
+			hi = mid - 1;
+		}
 	}
-	for (i=0; i<=r; ++i) {
-		popcount += (*u.p16 & (1 << i)) ? 1 : 0;
+	base = bitmap->counts[2 * lo];
+	next = bitmap->counts[2 * lo + 1];
+	/* words preceding the k-th one, counted without a branch */
+	for (w=0, i=0; i<7; ++i) {
+		w += ((next >> (9 * i)) & 0x1ff) < (k - base);
 	}
-	return popcount;
+	local = w ? ((next >> (9 * (w - 1))) & 0x1ff) : 0;
+	w = lo * 8 + w;
+	return w * 64 + word_select(bitmap->memory[w], k - base - local);
+}
+
+uint64_t
+s__index_bitmap_ones(s__index_bitmap_t bitmap)
+{
+	assert( bitmap );
+
+	return bitmap->ones;
+}
+
+uint64_t
+s__index_bitmap_bytes(s__index_bitmap_t bitmap)
+{
+	uint64_t n;
+
+	assert( bitmap );
+
+	n = bitmap->size * sizeof (bitmap->memory[0]);
+	n += supers(bitmap) * 2 * sizeof (bitmap->counts[0]);
+	if (bitmap->samples) {
+		n += nsamples(bitmap) * sizeof (bitmap->samples[0]);
+	}
+	return n;
 }
 
 void
@@ -105,6 +333,18 @@ s__index_bitmap_set(s__index_bitmap_t bitmap, uint64_t i)
 	bitmap->memory[Q] |= ((uint64_t)1 << R);
 }
 
+void
+s__index_bitmap_set_atomic(s__index_bitmap_t bitmap, uint64_t i)
+{
+	const uint64_t Q = i / 64;
+	const uint64_t R = i % 64;
+
+	assert( bitmap );
+	assert( Q < bitmap->size );
+
+	__sync_fetch_and_or(&bitmap->memory[Q], ((uint64_t)1 << R));
+}
+
 void
 s__index_bitmap_clr(s__index_bitmap_t bitmap, uint64_t i)
 {
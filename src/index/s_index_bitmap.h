@@ -15,12 +15,29 @@ s__index_bitmap_t s__index_bitmap_open(uint64_t size);
 
 void s__index_bitmap_close(s__index_bitmap_t bitmap);
 
-void s__index_bitmap_prepare(s__index_bitmap_t bitmap);
+int s__index_bitmap_save(s__index_bitmap_t bitmap, FILE *file);
+
+s__index_bitmap_t s__index_bitmap_map(void *map,
+				     uint64_t size,
+				     uint64_t bits,
+				     uint64_t *n);
+
+int s__index_bitmap_prepare(s__index_bitmap_t bitmap);
 
 uint64_t s__index_bitmap_rank(s__index_bitmap_t bitmap, uint64_t i);
 
+void s__index_bitmap_prefetch(s__index_bitmap_t bitmap, uint64_t i);
+
+uint64_t s__index_bitmap_select(s__index_bitmap_t bitmap, uint64_t k);
+
+uint64_t s__index_bitmap_ones(s__index_bitmap_t bitmap);
+
+uint64_t s__index_bitmap_bytes(s__index_bitmap_t bitmap);
+
 void s__index_bitmap_set(s__index_bitmap_t bitmap, uint64_t i);
 
+void s__index_bitmap_set_atomic(s__index_bitmap_t bitmap, uint64_t i);
+
 void s__index_bitmap_clr(s__index_bitmap_t bitmap, uint64_t i);
 
 int s__index_bitmap_get(s__index_bitmap_t bitmap, uint64_t i);
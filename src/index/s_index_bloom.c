@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) Tony Givargis, 2020-2025
+ *
+ * s_index_bloom.c
+ */
+
+#include "s_index_bloom.h"
+
+#define WORDS 8 /* per block, one cache line */
+#define BITS (WORDS * 64)
+#define MAX_PROBES 16
+#define MIX 0x9e3779b97f4a7c15
+
+/**
+ * Blocked Bloom filter: the hash of a key selects one 64 byte block, and
+ * probes bits within that block only, so a test touches one cache line.
+ * Successive probes step a multiplicative sequence seeded by the hash and
+ * take its top nine bits, the best mixed ones. Probes per key follow
+ * bits_per_key * ln(2), the count minimizing false positives.
+ */
+
+struct s__index_bloom {
+	uint64_t (*blocks)[WORDS];
+	uint64_t n; /* blocks */
+	int probes;
+	void *memory;
+};
+
+s__index_bloom_t
+s__index_bloom_open(uint64_t keys, uint64_t bits_per_key)
+{
+	struct s__index_bloom *bloom;
+	uint64_t n;
+
+	assert( bits_per_key );
+	assert( S__INDEX_BLOOM_MAX_BITS_PER_KEY >= bits_per_key );
+
+	if (!(bloom = s__malloc(sizeof (struct s__index_bloom)))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memset(bloom, 0, sizeof (struct s__index_bloom));
+	bloom->n = S__MAX(S__DUP(keys * bits_per_key, BITS), 1);
+	bloom->probes = (int)((double)bits_per_key * 0.6931 + 0.5);
+	bloom->probes = S__MIN(S__MAX(bloom->probes, 1), MAX_PROBES);
+	n = (bloom->n + 1) * sizeof (bloom->blocks[0]);
+	if (!(bloom->memory = s__malloc(n))) {
+		s__index_bloom_close(bloom);
+		S__TRACE(0);
+		return NULL;
+	}
+	bloom->blocks = (uint64_t (*)[WORDS])
+		(S__DUP((size_t)bloom->memory, sizeof (bloom->blocks[0])) *
+		 sizeof (bloom->blocks[0]));
+	memset(bloom->blocks, 0, bloom->n * sizeof (bloom->blocks[0]));
+	return bloom;
+}
+
+void
+s__index_bloom_close(s__index_bloom_t bloom)
+{
+	if (bloom) {
+		S__FREE(bloom->memory);
+		memset(bloom, 0, sizeof (struct s__index_bloom));
+	}
+	S__FREE(bloom);
+}
+
+void
+s__index_bloom_add(s__index_bloom_t bloom, uint64_t hash)
+{
+	uint64_t *block, bit;
+	int i;
+
+	assert( bloom );
+
+	block = bloom->blocks[hash % bloom->n];
+	for (i=0; i<bloom->probes; ++i) {
+		hash = hash * MIX + 1;
+		bit = hash >> 55;
+		block[bit / 64] |= (uint64_t)1 << (bit % 64);
+	}
+}
+
+int
+s__index_bloom_test(s__index_bloom_t bloom, uint64_t hash)
+{
+	const uint64_t *block;
+	uint64_t bit;
+	int i;
+
+	assert( bloom );
+
+	block = bloom->blocks[hash % bloom->n];
+	for (i=0; i<bloom->probes; ++i) {
+		hash = hash * MIX + 1;
+		bit = hash >> 55;
+		if (!(block[bit / 64] & ((uint64_t)1 << (bit % 64)))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+uint64_t
+s__index_bloom_bytes(s__index_bloom_t bloom)
+{
+	assert( bloom );
+
+	return bloom->n * sizeof (bloom->blocks[0]) +
+		sizeof (struct s__index_bloom);
+}
@@ -0,0 +1,26 @@
+/**
+ * Copyright (c) Tony Givargis, 2020-2025
+ *
+ * s_index_bloom.h
+ */
+
+#ifndef _S_INDEX_BLOOM_H_
+#define _S_INDEX_BLOOM_H_
+
+#include "../utils/s_utils.h"
+
+#define S__INDEX_BLOOM_MAX_BITS_PER_KEY 64
+
+typedef struct s__index_bloom *s__index_bloom_t;
+
+s__index_bloom_t s__index_bloom_open(uint64_t keys, uint64_t bits_per_key);
+
+void s__index_bloom_close(s__index_bloom_t bloom);
+
+void s__index_bloom_add(s__index_bloom_t bloom, uint64_t hash);
+
+int s__index_bloom_test(s__index_bloom_t bloom, uint64_t hash);
+
+uint64_t s__index_bloom_bytes(s__index_bloom_t bloom);
+
+#endif /* _S_INDEX_BLOOM_H_ */
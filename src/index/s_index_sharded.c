@@ -0,0 +1,337 @@
+/**
+ * Copyright (c) Tony Givargis, 2020-2025
+ *
+ * s_index_sharded.c
+ */
+
+#include "s_index_sharded.h"
+
+struct s__index_sharded {
+	int shards;
+	s__index_t indexes[S__INDEX_SHARDED_MAX_SHARDS];
+};
+
+struct job {
+	s__index_t index;
+	const char **keys;
+	const uint64_t *records;
+	uint64_t *order; /* positions of this shard's keys */
+	uint64_t n;
+	int error;
+};
+
+static int
+shard(const struct s__index_sharded *sharded, const char *key)
+{
+	return (int)(s__hash(key, s__strlen(key)) % (uint64_t)sharded->shards);
+}
+
+static void
+_ingest_(void *ctx)
+{
+	struct job *job;
+	uint64_t i, *record;
+
+	job = (struct job *)ctx;
+	for (i=0; i<job->n; ++i) {
+		if (!(record = s__index_update(job->index,
+					       job->keys[job->order[i]]))) {
+			job->error = -1;
+			S__TRACE(0);
+			return;
+		}
+		(*record) = job->records[job->order[i]];
+	}
+}
+
+static void
+_compress_(void *ctx)
+{
+	struct job *job;
+
+	job = (struct job *)ctx;
+	if (s__index_compress(job->index)) {
+		job->error = -1;
+		S__TRACE(0);
+	}
+}
+
+static int
+run(struct s__index_sharded *sharded, s__thread_fnc_t fnc, struct job *jobs)
+{
+	s__thread_t threads[S__INDEX_SHARDED_MAX_SHARDS];
+	int i, error;
+
+	error = 0;
+	memset(threads, 0, sizeof (threads));
+	for (i=0; i<sharded->shards; ++i) {
+		jobs[i].index = sharded->indexes[i];
+		jobs[i].error = 0;
+		if (!(threads[i] = s__thread_open(fnc, &jobs[i]))) {
+			error = -1;
+			break;
+		}
+	}
+	for (i=0; i<sharded->shards; ++i) {
+		s__thread_close(threads[i]);
+		error |= jobs[i].error;
+	}
+	if (error) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+s__index_sharded_t
+s__index_sharded_open(int shards)
+{
+	struct s__index_sharded *sharded;
+	int i;
+
+	assert( (0 < shards) && (S__INDEX_SHARDED_MAX_SHARDS >= shards) );
+
+	if (!(sharded = s__malloc(sizeof (struct s__index_sharded)))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memset(sharded, 0, sizeof (struct s__index_sharded));
+	sharded->shards = shards;
+	for (i=0; i<shards; ++i) {
+		if (!(sharded->indexes[i] = s__index_open())) {
+			s__index_sharded_close(sharded);
+			S__TRACE(0);
+			return NULL;
+		}
+	}
+	return sharded;
+}
+
+void
+s__index_sharded_close(s__index_sharded_t sharded)
+{
+	int i;
+
+	if (sharded) {
+		for (i=0; i<sharded->shards; ++i) {
+			s__index_close(sharded->indexes[i]);
+		}
+		memset(sharded, 0, sizeof (struct s__index_sharded));
+	}
+	S__FREE(sharded);
+}
+
+int
+s__index_sharded_compress(s__index_sharded_t sharded)
+{
+	struct job *jobs;
+	uint64_t n;
+
+	assert( sharded );
+
+	n = sharded->shards * sizeof (jobs[0]);
+	if (!(jobs = s__malloc(n))) {
+		S__TRACE(0);
+		return -1;
+	}
+	memset(jobs, 0, n);
+	if (run(sharded, _compress_, jobs)) {
+		S__FREE(jobs);
+		S__TRACE(0);
+		return -1;
+	}
+	S__FREE(jobs);
+	return 0;
+}
+
+uint64_t *
+s__index_sharded_update(s__index_sharded_t sharded, const char *key)
+{
+	assert( sharded );
+	assert( s__strlen(key) );
+
+	return s__index_update(sharded->indexes[shard(sharded, key)], key);
+}
+
+int
+s__index_sharded_ingest(s__index_sharded_t sharded,
+			const char **keys,
+			const uint64_t *records,
+			uint64_t n)
+{
+	uint64_t i, m, *order;
+	struct job *jobs;
+	int j, *shards;
+
+	assert( sharded );
+	assert( !n || (keys && records) );
+
+	order = NULL;
+	shards = NULL;
+	m = sharded->shards * sizeof (jobs[0]);
+	if (!(jobs = s__malloc(m)) ||
+	    !(order = s__malloc(S__MAX(n, 1) * sizeof (order[0]))) ||
+	    !(shards = s__malloc(S__MAX(n, 1) * sizeof (shards[0])))) {
+		S__FREE(jobs);
+		S__FREE(order);
+		S__TRACE(0);
+		return -1;
+	}
+	memset(jobs, 0, m);
+	for (i=0; i<n; ++i) {
+		shards[i] = shard(sharded, keys[i]);
+		jobs[shards[i]].n += 1;
+	}
+	for (j=0, m=0; j<sharded->shards; ++j) {
+		jobs[j].keys = keys;
+		jobs[j].records = records;
+		jobs[j].order = order + m;
+		m += jobs[j].n;
+		jobs[j].n = 0;
+	}
+	for (i=0; i<n; ++i) {
+		j = shards[i];
+		jobs[j].order[jobs[j].n++] = i;
+	}
+	S__FREE(shards);
+	if (run(sharded, _ingest_, jobs)) {
+		S__FREE(jobs);
+		S__FREE(order);
+		S__TRACE(0);
+		return -1;
+	}
+	S__FREE(jobs);
+	S__FREE(order);
+	return 0;
+}
+
+uint64_t *
+s__index_sharded_find(s__index_sharded_t sharded, const char *key)
+{
+	assert( sharded );
+	assert( s__strlen(key) );
+
+	return s__index_find(sharded->indexes[shard(sharded, key)], key);
+}
+
+uint64_t *
+s__index_sharded_next(s__index_sharded_t sharded,
+		      const char *key,
+		      char *okey)
+{
+	char buf[S__INDEX_MAX_KEY_LEN], probe[S__INDEX_MAX_KEY_LEN];
+	uint64_t *record, *best;
+	int i;
+
+	assert( sharded );
+	assert( okey );
+
+	if (key) {
+		memcpy(probe, key, s__strlen(key) + 1); /* key may alias okey */
+		key = probe;
+	}
+	best = NULL;
+	for (i=0; i<sharded->shards; ++i) {
+		record = s__index_next(sharded->indexes[i], key, buf);
+		if (record && (!best || (0 > strcmp(buf, okey)))) {
+			memcpy(okey, buf, s__strlen(buf) + 1);
+			best = record;
+		}
+	}
+	return best;
+}
+
+uint64_t *
+s__index_sharded_prev(s__index_sharded_t sharded,
+		      const char *key,
+		      char *okey)
+{
+	char buf[S__INDEX_MAX_KEY_LEN], probe[S__INDEX_MAX_KEY_LEN];
+	uint64_t *record, *best;
+	int i;
+
+	assert( sharded );
+	assert( okey );
+
+	if (key) {
+		memcpy(probe, key, s__strlen(key) + 1); /* key may alias okey */
+		key = probe;
+	}
+	best = NULL;
+	for (i=0; i<sharded->shards; ++i) {
+		record = s__index_prev(sharded->indexes[i], key, buf);
+		if (record && (!best || (0 < strcmp(buf, okey)))) {
+			memcpy(okey, buf, s__strlen(buf) + 1);
+			best = record;
+		}
+	}
+	return best;
+}
+
+uint64_t
+s__index_sharded_items(s__index_sharded_t sharded)
+{
+	uint64_t items;
+	int i;
+
+	assert( sharded );
+
+	items = 0;
+	for (i=0; i<sharded->shards; ++i) {
+		items += s__index_items(sharded->indexes[i]);
+	}
+	return items;
+}
+
+static void
+part(struct s__index_stats_part *a, const struct s__index_stats_part *b)
+{
+	double depths;
+
+	depths = a->avg_depth * a->keys + b->avg_depth * b->keys;
+	a->used += b->used;
+	a->allocated += b->allocated;
+	a->nodes += b->nodes;
+	a->keys += b->keys;
+	a->avg_depth = a->keys ? (depths / a->keys) : 0.0;
+	a->max_depth = S__MAX(a->max_depth, b->max_depth);
+}
+
+int
+s__index_sharded_stats(s__index_sharded_t sharded,
+		       struct s__index_stats *stats)
+{
+	struct s__index_stats shard;
+	uint64_t keys;
+	int i, j;
+
+	assert( sharded );
+	assert( stats );
+
+	memset(stats, 0, sizeof (struct s__index_stats));
+	for (i=0; i<sharded->shards; ++i) {
+		if (s__index_stats(sharded->indexes[i], &shard)) {
+			S__TRACE(0);
+			return -1;
+		}
+		part(&stats->tree, &shard.tree);
+		part(&stats->succinct, &shard.succinct);
+		stats->items += shard.items;
+		stats->used += shard.used;
+		stats->allocated += shard.allocated;
+		stats->max_depth = S__MAX(stats->max_depth, shard.max_depth);
+		for (j=0; j<S__INDEX_STATS_LENS; ++j) {
+			stats->lens[j] += shard.lens[j];
+		}
+	}
+	if (stats->items) {
+		stats->bytes_per_key = (double)stats->allocated / stats->items;
+	}
+	keys = stats->tree.keys + stats->succinct.keys;
+	if (keys) {
+		stats->avg_depth = (stats->tree.avg_depth * stats->tree.keys +
+				    stats->succinct.avg_depth *
+				    stats->succinct.keys) / keys;
+	}
+	return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) Tony Givargis, 2020-2025
+ *
+ * s_index_sharded.h
+ */
+
+#ifndef _S_INDEX_SHARDED_H_
+#define _S_INDEX_SHARDED_H_
+
+#include "s_index.h"
+
+#define S__INDEX_SHARDED_MAX_SHARDS 256
+
+typedef struct s__index_sharded *s__index_sharded_t;
+
+/**
+ * Opens an empty index, hash-partitioned into independent s__index_t
+ * shards, and returns an s__index_sharded_t handle for subsequent use.
+ *
+ * @shards  The number of shards, between 1 and S__INDEX_SHARDED_MAX_SHARDS
+ * @return  An s__index_sharded_t handle or NULL on error
+ */
+
+s__index_sharded_t s__index_sharded_open(int shards);
+
+/**
+ * Closes the index and frees resources associated with it.
+ *
+ * @sharded  A valid sharded index handle or NULL
+ */
+
+void s__index_sharded_close(s__index_sharded_t sharded);
+
+/**
+ * Compresses all shards in parallel, one thread per shard.
+ *
+ * @sharded  A valid sharded index handle
+ * @return   0 on success or -1 on error
+ *
+ * NOTES: See s__index_compress().
+ */
+
+int s__index_sharded_compress(s__index_sharded_t sharded);
+
+/**
+ * Updates the index by adding a new key or returning the record associated
+ * with an existing key.
+ *
+ * @sharded  A valid sharded index handle
+ * @key      A non-empty key
+ * @return   A pointer to a record, which can be modified by the caller,
+ *           or NULL in case of an error
+ */
+
+uint64_t *s__index_sharded_update(s__index_sharded_t sharded,
+				  const char *key);
+
+/**
+ * Adds a batch of keys in parallel, one thread per shard, and sets their
+ * records. When a key repeats, its last record in the batch wins.
+ *
+ * @sharded  A valid sharded index handle
+ * @keys     An array of n non-empty keys
+ * @records  An array of n records
+ * @n        The number of keys
+ * @return   0 on success or -1 on error
+ */
+
+int s__index_sharded_ingest(s__index_sharded_t sharded,
+			    const char **keys,
+			    const uint64_t *records,
+			    uint64_t n);
+
+/**
+ * Finds and returns the record associated with the key.
+ *
+ * @sharded  A valid sharded index handle
+ * @key      A non-empty key
+ * @return   A pointer to a record, which can be modified by the caller,
+ *           or NULL if the key does not exist
+ */
+
+uint64_t *s__index_sharded_find(s__index_sharded_t sharded, const char *key);
+
+/**
+ * Finds and returns the record associated with the lexicographical
+ * successor of key, merging the successors of all shards.
+ *
+ * @sharded  A valid sharded index handle
+ * @key      A non-empty key, or NULL for the smallest key
+ * @okey     A buffer of S__INDEX_MAX_KEY_LEN bytes receiving the successor
+ * @return   A pointer to a record, which can be modified by the caller,
+ *           or NULL if the key does not exist
+ */
+
+uint64_t *s__index_sharded_next(s__index_sharded_t sharded,
+				const char *key,
+				char *okey);
+
+/**
+ * Finds and returns the record associated with the lexicographical
+ * predecessor of key, merging the predecessors of all shards.
+ *
+ * @sharded  A valid sharded index handle
+ * @key      A non-empty key, or NULL for the largest key
+ * @okey     A buffer of S__INDEX_MAX_KEY_LEN bytes receiving the predecessor
+ * @return   A pointer to a record, which can be modified by the caller,
+ *           or NULL if the key does not exist
+ */
+
+uint64_t *s__index_sharded_prev(s__index_sharded_t sharded,
+				const char *key,
+				char *okey);
+
+/**
+ * Returns the number of indexed items across all shards.
+ *
+ * @sharded  A valid sharded index handle
+ * @return   The number of indexed items
+ */
+
+uint64_t s__index_sharded_items(s__index_sharded_t sharded);
+
+/**
+ * Reports the memory and shape of all shards combined, as s__index_stats().
+ *
+ * @sharded  A valid sharded index handle
+ * @stats    Receives the statistics
+ * @return   0 on success or -1 on error
+ */
+
+int s__index_sharded_stats(s__index_sharded_t sharded,
+			   struct s__index_stats *stats);
+
+#endif /* _S_INDEX_SHARDED_H_ */
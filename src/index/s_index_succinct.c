@@ -5,22 +5,241 @@
  */
 
 #include "s_index_bitmap.h"
+#include "s_index_bloom.h"
 #include "s_index_succinct.h"
 
 #define CHAR2INT(c) ( (int)((unsigned char)(c)) )
 
+#define BATCH 16 /* lookups interleaved by s__index_succinct_find_batch() */
+#define PARTS 256 /* partitions of s__index_succinct_build(), by byte */
+#define ALIGN 64
+#define CHAIN 4 /* minimum nodes of a collapsed chain */
+#define VIRTUAL 40 /* node bits of a virtual node, below its fragment byte */
+#define SHARDS 16 /* filtered lookup counters, one cache line each */
+#define MAGIC "STINGRAY"
+#define VERSION 4
+
+#define REAL(i) ( (i) & (((uint64_t)1 << VIRTUAL) - 1) )
+
+struct header {
+	char magic[8];
+	uint64_t version;
+	uint64_t endian;
+	uint64_t size;
+	uint64_t items;
+	uint64_t record_size;
+	uint64_t collapsed;
+	uint64_t chains;
+	uint64_t bytes; /* of fragments, terminated */
+};
+
+struct shard {
+	volatile uint64_t n;
+	char pad[ALIGN - sizeof (uint64_t)];
+};
+
 struct s__index_succinct {
+	int mapped;
 	char *keys;
-	uint64_t *records;
+	uint64_t *records; /* of record_size bytes each */
+	uint64_t record_size;
 	/*-*/
 	uint64_t size;
 	uint64_t items;
 	s__index_bitmap_t nodes;
 	s__index_bitmap_t valids;
+	/*-*/
+	s__index_bitmap_t tombs; /* removed records, or NULL */
+	uint64_t removed;
+	uint64_t * volatile sizes; /* keys per subtree, or NULL */
+	/*-*/
+	struct s__index_bloom * volatile bloom; /* of every key, or NULL */
+	/*-*/
+	uint64_t *packed; /* bit packed records, replacing records, or NULL */
+	uint64_t base;
+	uint64_t bits;
+	/*-*/
+	struct chains *chains; /* fragments of collapsed chains, or NULL */
+	/*-*/
+	char pad[ALIGN];
+	struct shard filtered[SHARDS]; /* lookups the filter answered */
+};
+
+/**
+ * Filtered lookups are counted in SHARDS counters, picked by the key's
+ * hash and each alone in its cache line, so concurrent readers answered
+ * by the filter rarely write the same line, and never one the lookup
+ * itself reads. s__index_succinct_filtered() sums them.
+ */
+
+/**
+ * Packed records: frame of reference bit packing stores each record as
+ * its offset from the smallest record, in the fewest bits holding the
+ * largest offset, back to back in 64 bit words. Record i starts at bit
+ * i * bits and spans at most two words, so it is read in constant time.
+ * Lookups of a packed index return record values rather than pointers,
+ * and cursors return a pointer to their own copy.
+ */
+
+/**
+ * Chains: a chain is a run of center children without siblings, such as
+ * the unique tail of a key, where a lookup spends a rank call per byte.
+ * Collapsing rebuilds the trie with every run of at least CHAIN nodes
+ * replaced by its first node, the head, which takes the valid bit and
+ * the center child of the last node of the run. The key bytes of the
+ * other nodes of the run follow the head as a fragment, terminated by a
+ * null byte no key holds, and found by the rank of the head among heads
+ * and by select among fragment starts. A lookup that matches the head
+ * compares the rest of the key with the fragment in one step, so its
+ * steps follow the branching nodes rather than the key length, and the
+ * run costs a byte per node instead of a node.
+ *
+ * Every other traversal walks the fragment byte by byte, as the virtual
+ * nodes i + (k << VIRTUAL) for its k-th byte, each with only a center
+ * child and no key, but the last, which stands for the head itself.
+ */
+
+struct chains {
+	s__index_bitmap_t heads; /* nodes followed by a fragment */
+	s__index_bitmap_t starts; /* of every fragment */
+	char *fragments;
+	uint64_t n;
+	uint64_t bytes; /* of fragments, terminated */
+};
+
+enum { LEFT, CENTER, RIGHT, SELF, UP };
+
+enum { TOKEN_CHAIN, TOKEN_TOP, TOKEN_PART };
+
+struct sibling {
+	uint64_t group;
+	uint64_t base; /* level of the group's BST root */
+	uint64_t level;
+	uint64_t node;
+	int k; /* group size */
+	int j; /* rank within the group */
+};
+
+struct stream {
+	s__index_succinct_fnc_t fnc;
+	void *ctx;
+	uint64_t record_size;
+	int shared; /* bitmap words are shared with other streams */
+	/*-*/
+	unsigned char *groups; /* group size - 1, in order of creation */
+	uint64_t ngroups;
+	uint64_t gcapacity;
+	uint64_t *levels; /* nodes per level, then next node position */
+	uint64_t *valids; /* valid nodes per level, then next record */
+	uint64_t depth;
+	uint64_t capacity;
+	uint64_t size;
+	uint64_t items;
+};
+
+struct part {
+	char *prefix; /* LCP and split byte */
+	uint64_t len;
+	uint64_t *valid;
+	s__index_tree_cursor_t cursor;
+	struct stream stream;
+};
+
+struct token {
+	int kind;
+	int lo; /* range of split bytes, or partition */
+	int hi;
+	uint64_t level;
+};
+
+struct build {
+	s__index_tree_t tree;
+	struct s__index_succinct *succinct;
+	char *prefix;
+	char *last;
+	uint64_t lcp;
+	uint64_t *chain;
+	/*-*/
+	int nparts;
+	struct part parts[PARTS];
+	struct token tokens[2][2 * PARTS];
+	/*-*/
+	int pass;
+	volatile uint64_t next;
+	volatile int error;
+};
+
+struct frame {
+	int edge;
+	uint64_t len;
+	uint64_t root;
+};
+
+struct s__index_succinct_cursor {
+	struct s__index_succinct *succinct;
+	uint64_t depth;
+	uint64_t capacity;
+	struct frame *path;
+	uint64_t value; /* copy of a packed record */
+	char key[S__INDEX_TREE_MAX_KEY_LEN + 1];
 };
 
+static uint64_t *
+get_record(const struct s__index_succinct *succinct, uint64_t i)
+{
+	return (uint64_t *)((char *)succinct->records +
+			    i * succinct->record_size);
+}
+
 static uint64_t
-get_node(const struct s__index_succinct *succinct, uint64_t i)
+get_value(const struct s__index_succinct *succinct, uint64_t i)
+{
+	uint64_t q, r, v;
+
+	if (!succinct->packed) {
+		return *get_record(succinct, i);
+	}
+	if (!succinct->bits) {
+		return succinct->base;
+	}
+	q = i * succinct->bits / 64;
+	r = i * succinct->bits % 64;
+	v = succinct->packed[q] >> r;
+	if (64 < (r + succinct->bits)) {
+		v |= succinct->packed[q + 1] << (64 - r);
+	}
+	if (64 > succinct->bits) {
+		v &= ((uint64_t)1 << succinct->bits) - 1;
+	}
+	return succinct->base + v;
+}
+
+/**
+ * Returns the fragment following node, or NULL if node heads no chain.
+ */
+
+static const char *
+fragment(const struct s__index_succinct *succinct, uint64_t node)
+{
+	const struct chains *chains;
+	uint64_t r;
+
+	if (!(chains = succinct->chains) ||
+	    !chains->n ||
+	    !s__index_bitmap_get(chains->heads, node)) {
+		return NULL;
+	}
+	r = s__index_bitmap_rank(chains->heads, node);
+	return chains->fragments + s__index_bitmap_select(chains->starts, r);
+}
+
+/**
+ * Node accessors: get_node_() and get_valid_() take real nodes, the rest
+ * real or virtual ones.
+ */
+
+static uint64_t
+get_node_(const struct s__index_succinct *succinct, uint64_t i)
 {
 	if (s__index_bitmap_get(succinct->nodes, i)) {
 		return (3 * s__index_bitmap_rank(succinct->nodes, i));
@@ -28,15 +247,109 @@ get_node(const struct s__index_succinct *succinct, uint64_t i)
 	return 0;
 }
 
+/**
+ * Returns the record position of node i, or 0 if no key ends at it.
+ */
+
 static uint64_t
-find(const struct s__index_succinct *succinct, const char *key)
+get_valid_(const struct s__index_succinct *succinct, uint64_t i)
+{
+	if (s__index_bitmap_get(succinct->valids, i)) {
+		return s__index_bitmap_rank(succinct->valids, i);
+	}
+	return 0;
+}
+
+static char
+get_key(const struct s__index_succinct *succinct, uint64_t i)
+{
+	uint64_t k;
+
+	if (!(k = (i >> VIRTUAL))) {
+		return succinct->keys[i];
+	}
+	return fragment(succinct, REAL(i))[k - 1];
+}
+
+static uint64_t
+get_node(const struct s__index_succinct *succinct, uint64_t i)
+{
+	const char *bytes;
+	uint64_t node;
+
+	node = i / 3;
+	if ((bytes = fragment(succinct, REAL(node))) &&
+	    bytes[node >> VIRTUAL]) {
+		if (CENTER == (i % 3)) {
+			return 3 * (node + ((uint64_t)1 << VIRTUAL));
+		}
+		return 0;
+	}
+	return get_node_(succinct, 3 * REAL(node) + (i % 3));
+}
+
+static uint64_t
+get_valid(const struct s__index_succinct *succinct, uint64_t i)
+{
+	const char *bytes;
+
+	if ((bytes = fragment(succinct, REAL(i))) && bytes[i >> VIRTUAL]) {
+		return 0;
+	}
+	return get_valid_(succinct, REAL(i));
+}
+
+static int
+dead(const struct s__index_succinct *succinct, uint64_t i)
+{
+	return succinct->tombs && s__index_bitmap_get(succinct->tombs, i);
+}
+
+static int
+live_(const struct s__index_succinct *succinct, uint64_t node)
+{
+	uint64_t i;
+
+	if ((i = get_valid_(succinct, node))) {
+		return !dead(succinct, i);
+	}
+	return 0;
+}
+
+static int
+live(const struct s__index_succinct *succinct, uint64_t node)
+{
+	uint64_t i;
+
+	if ((i = get_valid(succinct, node))) {
+		return !dead(succinct, i);
+	}
+	return 0;
+}
+
+static void
+chains_close(struct chains *chains, int mapped)
+{
+	if (chains) {
+		s__index_bitmap_close(chains->heads);
+		s__index_bitmap_close(chains->starts);
+		if (!mapped) {
+			S__FREE(chains->fragments);
+		}
+		memset(chains, 0, sizeof (struct chains));
+	}
+	S__FREE(chains);
+}
+
+static uint64_t
+find_node(const struct s__index_succinct *succinct, const char *key)
 {
 	uint64_t root;
 	int d;
 
 	root = 3;
 	while (root) {
-		d = CHAR2INT(*key) - CHAR2INT(succinct->keys[root / 3]);
+		d = CHAR2INT(*key) - CHAR2INT(get_key(succinct, root / 3));
 		if (!d) {
 			if ('\0' == (*(++key))) {
 				break;
@@ -50,28 +363,109 @@ find(const struct s__index_succinct *succinct, const char *key)
 			root = get_node(succinct, root + 2);
 		}
 	}
-	if (root) {
-		if (s__index_bitmap_get(succinct->valids, root / 3)) {
-			return s__index_bitmap_rank(succinct->valids,
-						    root / 3);
+	return root / 3;
+}
+
+/**
+ * Returns node, the key advanced past the fragment following it, or 0 if
+ * the key leaves the fragment.
+ */
+
+static uint64_t
+chain(const struct s__index_succinct *succinct, uint64_t node, const char **key)
+{
+	const char *bytes;
+
+	if ((bytes = fragment(succinct, node))) {
+		while (*bytes) {
+			if ((*bytes++) != (*(*key)++)) {
+				return 0;
+			}
+		}
+	}
+	return node;
+}
+
+static uint64_t
+find(const struct s__index_succinct *succinct, const char *key)
+{
+	uint64_t node, root;
+	int d;
+
+	if (!succinct->chains) {
+		if ((node = find_node(succinct, key))) {
+			return get_valid(succinct, node);
+		}
+		return 0;
+	}
+	root = 3;
+	while (root) {
+		d = CHAR2INT(*key) - CHAR2INT(get_key(succinct, root / 3));
+		if (!d) {
+			++key;
+			if (!(node = chain(succinct, root / 3, &key))) {
+				return 0;
+			}
+			if ('\0' == (*key)) {
+				return get_valid_(succinct, node);
+			}
+			root = get_node_(succinct, node * 3 + 1);
+		}
+		else if (0 > d) {
+			root = get_node_(succinct, root + 0);
+		}
+		else {
+			root = get_node_(succinct, root + 2);
 		}
 	}
 	return 0;
 }
 
 static uint64_t
-min(const struct s__index_succinct *succinct, uint64_t root, char *okey)
+step(const struct s__index_succinct *succinct,
+     uint64_t root,
+     const char **key,
+     uint64_t **record)
 {
 	uint64_t i, node;
+	int d;
+
+	d = CHAR2INT(**key) - CHAR2INT(get_key(succinct, root / 3));
+	if (!d) {
+		++(*key);
+		if (!(node = chain(succinct, root / 3, key))) {
+			return 0;
+		}
+		if ('\0' != (**key)) {
+			return get_node_(succinct, node * 3 + 1);
+		}
+		if ((i = get_valid_(succinct, node))) {
+			(*record) = get_record(succinct, i);
+		}
+		return 0;
+	}
+	return get_node_(succinct, root + ((0 > d) ? 0 : 2));
+}
+
+static void
+prefetch(const struct s__index_succinct *succinct, uint64_t root)
+{
+	s__prefetch(&succinct->keys[root / 3]);
+	s__index_bitmap_prefetch(succinct->nodes, root);
+}
+
+static uint64_t
+min(const struct s__index_succinct *succinct, uint64_t root, char *okey)
+{
+	uint64_t i, j, node;
 
 	i = 0;
 	while (root) {
 		if (!(node = get_node(succinct, root + 0))) {
-			okey[i++] = succinct->keys[root / 3];
+			okey[i++] = get_key(succinct, root / 3);
 			okey[i] = '\0';
-			if (s__index_bitmap_get(succinct->valids, root / 3)) {
-				return s__index_bitmap_rank(succinct->valids,
-							    root / 3);
+			if ((j = get_valid(succinct, root / 3))) {
+				return j;
 			}
 			node = get_node(succinct, root + 1);
 		}
@@ -83,18 +477,17 @@ min(const struct s__index_succinct *succinct, uint64_t root, char *okey)
 static uint64_t
 max(const struct s__index_succinct *succinct, uint64_t root, char *okey)
 {
-	uint64_t i, node;
+	uint64_t i, j, node;
 
 	i = 0;
 	while (root) {
 		if (!(node = get_node(succinct, root + 2))) {
-			okey[i++] = succinct->keys[root / 3];
+			okey[i++] = get_key(succinct, root / 3);
 			okey[i] = '\0';
-			if (s__index_bitmap_get(succinct->valids, root / 3)) {
-				return s__index_bitmap_rank(succinct->valids,
-							    root / 3);
+			if (!(node = get_node(succinct, root + 1)) &&
+			    (j = get_valid(succinct, root / 3))) {
+				return j;
 			}
-			node = get_node(succinct, root + 1);
 		}
 		root = node;
 	}
@@ -113,8 +506,9 @@ next(const struct s__index_succinct *succinct, const char *key, char *okey)
 	hold = 0;
 	flag = 0;
 	while (root) {
-		if (0 > (d = (int)(*key) - (int)succinct->keys[root / 3])) {
-			if (s__index_bitmap_get(succinct->valids, root / 3) ||
+		d = CHAR2INT(*key) - CHAR2INT(get_key(succinct, root / 3));
+		if (0 > d) {
+			if (get_valid(succinct, root / 3) ||
 			    get_node(succinct, root + 1)) {
 				up = root;
 				hold = i;
@@ -152,13 +546,13 @@ next(const struct s__index_succinct *succinct, const char *key, char *okey)
 	}
 	i = hold;
 	if (flag) {
-		if (s__index_bitmap_get(succinct->valids, up / 3)) {
-			okey[i++] = succinct->keys[up / 3];
+		if ((node = get_valid(succinct, up / 3))) {
+			okey[i++] = get_key(succinct, up / 3);
 			okey[i] = '\0';
-			return s__index_bitmap_rank(succinct->valids, up / 3);
+			return node;
 		}
 		if ((root = get_node(succinct, up + 1))) {
-			okey[i++] = succinct->keys[up / 3];
+			okey[i++] = get_key(succinct, up / 3);
 			okey[i] = '\0';
 			return min(succinct, root, okey + i);
 		}
@@ -184,54 +578,54 @@ prev(const struct s__index_succinct *succinct, const char *key, char *okey)
 	hold = 0;
 	flag = 0;
 	while (root) {
-		if (0 < (d = (int)(*key) - (int)succinct->keys[root / 3])) {
-			if (s__index_bitmap_get(succinct->valids, root / 3) ||
-			    get_node(succinct, root + 1)) {
+		d = CHAR2INT(*key) - CHAR2INT(get_key(succinct, root / 3));
+		if (0 < d) {
+			up = root;
+			hold = i;
+			flag = 1;
+			root = get_node(succinct, root + 2);
+		}
+		else if (!d) {
+			if ('\0' == key[1]) {
+				if ((node = get_node(succinct, root + 0))) {
+					up = node;
+					hold = i;
+					flag = 0;
+				}
+				break;
+			}
+			if (get_valid(succinct, root / 3)) {
 				up = root;
 				hold = i;
-				flag = 1;
+				flag = 2;
 			}
 			else if ((node = get_node(succinct, root + 0))) {
 				up = node;
 				hold = i;
 				flag = 0;
 			}
-			root = get_node(succinct, root + 2);
-		}
-		else if (!d) {
-			if ((node = get_node(succinct, root + 0))) {
-				up = node;
-				hold = i;
-				flag = 0;
-			}
 			root = get_node(succinct, root + 1);
-			okey[i++] = (*key);
+			okey[i++] = (*key++);
 			okey[i] = '\0';
-			if ('\0' == (*(++key))) {
-				break;
-			}
 		}
 		else {
 			root = get_node(succinct, root + 0);
 		}
 	}
-	if (root) {
-		return max(succinct, root, okey + i);
-	}
 	if (!up) {
 		return 0;
 	}
 	i = hold;
 	if (flag) {
-		if (s__index_bitmap_get(succinct->valids, up / 3)) {
-			okey[i++] = succinct->keys[up / 3];
+		if ((1 == flag) && (root = get_node(succinct, up + 1))) {
+			okey[i++] = get_key(succinct, up / 3);
 			okey[i] = '\0';
-			return s__index_bitmap_rank(succinct->valids, up / 3);
+			return max(succinct, root, okey + i);
 		}
-		if ((root = get_node(succinct, up + 1))) {
-			okey[i++] = succinct->keys[up / 3];
+		if ((node = get_valid(succinct, up / 3))) {
+			okey[i++] = get_key(succinct, up / 3);
 			okey[i] = '\0';
-			return max(succinct, root, okey + i);
+			return node;
 		}
 		if ((root = get_node(succinct, up + 0))) {
 			return max(succinct, root, okey + i);
@@ -243,49 +637,19 @@ prev(const struct s__index_succinct *succinct, const char *key, char *okey)
 	return 0;
 }
 
-static void
-_encode_(void *ctx,
-	 char key,
-	 int left,
-	 int center,
-	 int right,
-	 uint64_t *record)
-{
-	struct s__index_succinct *succinct;
-
-	succinct = (struct s__index_succinct *)ctx;
-	if (left) {
-		s__index_bitmap_set(succinct->nodes, succinct->size * 3 + 0);
-	}
-	if (center) {
-		s__index_bitmap_set(succinct->nodes, succinct->size * 3 + 1);
-	}
-	if (right) {
-		s__index_bitmap_set(succinct->nodes, succinct->size * 3 + 2);
-	}
-	if (record) {
-		s__index_bitmap_set(succinct->valids, succinct->size);
-		succinct->records[succinct->items++] = (*record);
-	}
-	succinct->keys[succinct->size++] = key;
-}
-
-s__index_succinct_t
-s__index_succinct_open(s__index_ternary_t ternary)
+static struct s__index_succinct *
+create(uint64_t size, uint64_t items, uint64_t record_size)
 {
 	struct s__index_succinct *succinct;
-	uint64_t size, items, n1, n2;
-
-	assert( ternary );
+	uint64_t n1, n2;
 
 	if (!(succinct = s__malloc(sizeof (struct s__index_succinct)))) {
 		S__TRACE(0);
 		return NULL;
 	}
 	memset(succinct, 0, sizeof (struct s__index_succinct));
-	if (s__index_ternary_items(ternary)) {
-		size = s__index_ternary_nodes(ternary) + 1;
-		items = s__index_ternary_items(ternary) + 1;
+	succinct->record_size = record_size;
+	if (1 < items) {
 		if (!(succinct->nodes = s__index_bitmap_open(size * 3)) ||
 		    !(succinct->valids = s__index_bitmap_open(size * 1))) {
 			s__index_succinct_close(succinct);
@@ -293,7 +657,7 @@ s__index_succinct_open(s__index_ternary_t ternary)
 			return NULL;
 		}
 		n1 = size * sizeof (succinct->keys[0]);
-		n2 = items * sizeof (succinct->records[0]);
+		n2 = items * record_size;
 		if (!(succinct->keys = s__malloc(n1)) ||
 		    !(succinct->records = s__malloc(n2))) {
 			s__index_succinct_close(succinct);
@@ -305,95 +669,1859 @@ s__index_succinct_open(s__index_ternary_t ternary)
 		succinct->size = 1;
 		succinct->items = 1;
 		s__index_bitmap_set(succinct->nodes, 1);
-		if (s__index_ternary_iterate(ternary, _encode_, succinct)) {
-			s__index_succinct_close(succinct);
-			S__TRACE(0);
-			return NULL;
-		}
-		s__index_bitmap_prepare(succinct->nodes);
-		s__index_bitmap_prepare(succinct->valids);
-		assert( size == succinct->size );
-		assert( items == succinct->items );
 	}
 	return succinct;
 }
 
-void
-s__index_succinct_close(s__index_succinct_t succinct)
+static int
+prepare(struct s__index_succinct *succinct)
 {
-	if (succinct) {
-		s__index_bitmap_close(succinct->nodes);
-		s__index_bitmap_close(succinct->valids);
-		S__FREE(succinct->keys);
-		S__FREE(succinct->records);
-		memset(succinct, 0, sizeof (struct s__index_succinct));
+	if (succinct->items &&
+	    (s__index_bitmap_prepare(succinct->nodes) ||
+	     s__index_bitmap_prepare(succinct->valids))) {
+		S__TRACE(0);
+		return -1;
 	}
-	S__FREE(succinct);
+	return 0;
 }
 
-uint64_t *
-s__index_succinct_find(s__index_succinct_t succinct, const char *key)
-{
-	uint64_t i;
+/**
+ * Streaming construction: keys arrive in sorted order and are encoded
+ * without materializing the ternary tree, in three passes over the input.
+ *
+ * Every node of the ternary tree belongs to a sibling group, the distinct
+ * bytes following a common prefix, arranged as a balanced BST. Within a
+ * breadth-first level, nodes are ordered by their path from the root,
+ * and so are the nodes of any level as visited in key order. Hence:
+ *
+ *   pass 1 records the size of every group, in order of creation
+ *   pass 2 counts the nodes and valid nodes of every level
+ *   pass 3 writes each node at the next free position of its level
+ *
+ * Beyond the output, a stream holds one byte per group, two counters
+ * per level, and its current path.
+ */
 
-	assert( succinct );
-	assert( key );
+static uint64_t
+bst(int j, int k, int *left, int *right)
+{
+	uint64_t depth;
+	int lo, hi, mid;
 
-	i = 0;
-	if (succinct->items) {
-		i = find(succinct, key);
+	lo = 0;
+	hi = k;
+	depth = 0;
+	while (j != (mid = lo + (hi - lo) / 2)) {
+		if (j < mid) {
+			hi = mid;
+		}
+		else {
+			lo = mid + 1;
+		}
+		++depth;
 	}
-	return i ? &succinct->records[i] : NULL;
+	(*left) = (lo < mid) ? 1 : 0;
+	(*right) = ((mid + 1) < hi) ? 1 : 0;
+	return depth;
 }
 
-uint64_t *
-s__index_succinct_next(s__index_succinct_t succinct,
-		       const char *key,
+static void
+set(s__index_bitmap_t bitmap, uint64_t i, int shared)
+{
+	if (shared) {
+		s__index_bitmap_set_atomic(bitmap, i);
+	}
+	else {
+		s__index_bitmap_set(bitmap, i);
+	}
+}
+
+static void
+place(struct stream *stream, uint64_t level, uint64_t *node, uint64_t *item)
+{
+	uint64_t n;
+
+	n = stream->levels[level];
+	stream->levels[level] = (*node);
+	(*node) += n;
+	n = stream->valids[level];
+	stream->valids[level] = (*item);
+	(*item) += n;
+}
+
+static int
+grow_groups(struct stream *stream)
+{
+	unsigned char *groups;
+	uint64_t n;
+
+	if (stream->ngroups == stream->gcapacity) {
+		n = S__MAX(4096, stream->gcapacity * 2);
+		if (!(groups = s__realloc(stream->groups, n))) {
+			S__TRACE(0);
+			return -1;
+		}
+		stream->groups = groups;
+		stream->gcapacity = n;
+	}
+	return 0;
+}
+
+static int
+grow_levels(struct stream *stream, uint64_t level)
+{
+	uint64_t *levels, *valids, n;
+
+	while (level >= stream->depth) {
+		if (stream->depth == stream->capacity) {
+			n = S__MAX(64, stream->capacity * 2);
+			if (!(levels = s__realloc(stream->levels,
+						  n * sizeof (levels[0])))) {
+				S__TRACE(0);
+				return -1;
+			}
+			stream->levels = levels;
+			if (!(valids = s__realloc(stream->valids,
+						  n * sizeof (valids[0])))) {
+				S__TRACE(0);
+				return -1;
+			}
+			stream->valids = valids;
+			stream->capacity = n;
+		}
+		stream->levels[stream->depth] = 0;
+		stream->valids[stream->depth] = 0;
+		stream->depth += 1;
+	}
+	return 0;
+}
+
+static int
+node(struct s__index_succinct *succinct,
+     struct stream *stream,
+     struct sibling *path,
+     uint64_t d,
+     const char *key,
+     const uint64_t *record,
+     int pass)
+{
+	const int VALID = '\0' == key[d + 1];
+	uint64_t i, level;
+	int left, right;
+
+	if (1 == pass) {
+		return 0;
+	}
+	level = path[d].base + bst(path[d].j, path[d].k, &left, &right);
+	path[d].level = level;
+	if (2 == pass) {
+		if (grow_levels(stream, level)) {
+			S__TRACE(0);
+			return -1;
+		}
+		stream->levels[level] += 1;
+		stream->valids[level] += VALID ? 1 : 0;
+		return 0;
+	}
+	i = stream->levels[level]++;
+	path[d].node = i;
+	succinct->keys[i] = key[d];
+	if (left) {
+		set(succinct->nodes, i * 3 + 0, stream->shared);
+	}
+	if (right) {
+		set(succinct->nodes, i * 3 + 2, stream->shared);
+	}
+	if (VALID) {
+		set(succinct->valids, i, stream->shared);
+		memcpy(get_record(succinct, stream->valids[level]++),
+		       record,
+		       (size_t)succinct->record_size);
+	}
+	return 0;
+}
+
+static int
+walk(struct s__index_succinct *succinct, struct stream *stream, int pass)
+{
+	uint64_t record[S__INDEX_TREE_MAX_RECORD_SIZE / sizeof (uint64_t)];
+	const uint64_t MAX = S__INDEX_TREE_MAX_KEY_LEN;
+	uint64_t i, d, lcp, group;
+	struct sibling *path;
+	const char *key;
+	char *prev;
+	int e;
+
+	path = NULL;
+	if (!(prev = s__malloc(MAX + 1)) ||
+	    !(path = s__malloc(MAX * sizeof (path[0])))) {
+		S__FREE(prev);
+		S__TRACE(0);
+		return -1;
+	}
+	group = 0;
+	prev[0] = '\0';
+	memset(record, 0, (size_t)stream->record_size);
+	e = stream->fnc(stream->ctx, 1, &key, record);
+	while (0 < e) {
+		for (lcp=0; prev[lcp] && (prev[lcp] == key[lcp]); ++lcp);
+		if (!key[lcp] ||
+		    (prev[lcp] && (CHAR2INT(key[lcp]) < CHAR2INT(prev[lcp])))) {
+			S__TRACE(S__ERR_ARGUMENT); /* not strictly ascending */
+			e = -1;
+			break;
+		}
+		for (d=lcp; key[d]; ++d) {
+			if (MAX <= (d + 1)) {
+				S__TRACE(S__ERR_ARGUMENT);
+				e = -1;
+				break;
+			}
+			if ((d == lcp) && prev[d]) {
+				path[d].j += 1;
+				if (1 == pass) {
+					stream->groups[path[d].group] += 1;
+				}
+			}
+			else {
+				if ((1 == pass) && grow_groups(stream)) {
+					S__TRACE(0);
+					e = -1;
+					break;
+				}
+				if (1 == pass) {
+					stream->groups[stream->ngroups++] = 0;
+				}
+				if ((3 == pass) && d) {
+					i = path[d - 1].node * 3 + 1;
+					set(succinct->nodes, i, stream->shared);
+				}
+				path[d].group = group++;
+				path[d].k = 1 + stream->groups[path[d].group];
+				path[d].j = 0;
+				path[d].base = d ? (path[d - 1].level + 1) : 0;
+			}
+			if (node(succinct, stream, path, d,
+				 key, record, pass)) {
+				S__TRACE(0);
+				e = -1;
+				break;
+			}
+		}
+		if (0 > e) {
+			break;
+		}
+		if (1 == pass) {
+			stream->size += d - lcp;
+			stream->items += 1;
+		}
+		memcpy(prev + lcp, key + lcp, d - lcp + 1);
+		e = stream->fnc(stream->ctx, 0, &key, record);
+	}
+	S__FREE(prev);
+	S__FREE(path);
+	if (0 > e) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+static void
+stream_free(struct stream *stream)
+{
+	S__FREE(stream->groups);
+	S__FREE(stream->levels);
+	S__FREE(stream->valids);
+	memset(stream, 0, sizeof (struct stream));
+}
+
+s__index_succinct_t
+s__index_succinct_stream(s__index_succinct_fnc_t fnc,
+			 void *ctx,
+			 uint64_t record_size)
+{
+	struct s__index_succinct *succinct;
+	struct stream stream;
+	uint64_t i, node, item;
+
+	assert( fnc );
+	assert( record_size && !(record_size % sizeof (uint64_t)) );
+	assert( S__INDEX_TREE_MAX_RECORD_SIZE >= record_size );
+
+	memset(&stream, 0, sizeof (struct stream));
+	stream.fnc = fnc;
+	stream.ctx = ctx;
+	stream.record_size = record_size;
+	if (walk(NULL, &stream, 1)) {
+		stream_free(&stream);
+		S__TRACE(0);
+		return NULL;
+	}
+	if (!(succinct = create(stream.size + 1,
+				stream.items + 1,
+				record_size))) {
+		stream_free(&stream);
+		S__TRACE(0);
+		return NULL;
+	}
+	if (succinct->items) {
+		if (walk(succinct, &stream, 2)) {
+			s__index_succinct_close(succinct);
+			stream_free(&stream);
+			S__TRACE(0);
+			return NULL;
+		}
+		node = item = 1;
+		for (i=0; i<stream.depth; ++i) {
+			place(&stream, i, &node, &item);
+		}
+		if (walk(succinct, &stream, 3) || prepare(succinct)) {
+			s__index_succinct_close(succinct);
+			stream_free(&stream);
+			S__TRACE(0);
+			return NULL;
+		}
+		succinct->size = node;
+		succinct->items = item;
+	}
+	stream_free(&stream);
+	return succinct;
+}
+
+/**
+ * Parallel construction: keys are split by their first byte past the
+ * longest common prefix (LCP) into partitions, each streamed from its own
+ * range of the tree. In the breadth-first layout, a partition occupies
+ * one contiguous run per level, and the runs appear in the order of their
+ * parents. Partitions count their levels in parallel, a sequential walk
+ * over the LCP chain and the BST of split bytes assigns every run its
+ * position, and partitions then write their runs in parallel. The result
+ * is identical to s__index_succinct_stream() over the same keys.
+ */
+
+static int
+_range_(void *ctx, int rewind, const char **key, uint64_t *record)
+{
+	struct part *part;
+	const char *key_;
+	uint64_t *record_;
+
+	part = (struct part *)ctx;
+	if (rewind) {
+		record_ = s__index_tree_cursor_seek(part->cursor, part->prefix);
+	}
+	else {
+		record_ = s__index_tree_cursor_next(part->cursor);
+	}
+	while (record_) {
+		key_ = s__index_tree_cursor_key(part->cursor);
+		if (strncmp(key_, part->prefix, part->len)) {
+			break;
+		}
+		if (key_[part->len]) {
+			(*key) = key_ + part->len;
+			memcpy(record,
+			       record_,
+			       (size_t)part->stream.record_size);
+			return 1;
+		}
+		record_ = s__index_tree_cursor_next(part->cursor);
+	}
+	return 0;
+}
+
+static void
+_worker_(void *ctx)
+{
+	struct build *build;
+	struct part *part;
+	uint64_t i;
+
+	build = (struct build *)ctx;
+	while ((i = __sync_fetch_and_add(&build->next, 1)) <
+	       (uint64_t)build->nparts) {
+		part = &build->parts[i];
+		if (1 == build->pass) {
+			if (walk(NULL, &part->stream, 1) ||
+			    (part->stream.items &&
+			     walk(NULL, &part->stream, 2))) {
+				build->error = -1;
+			}
+		}
+		else if (part->stream.items &&
+			 walk(build->succinct, &part->stream, 3)) {
+			build->error = -1;
+		}
+	}
+}
+
+static int
+parallel(struct build *build, int pass, int threads)
+{
+	s__thread_t pool[PARTS];
+	int i, t;
+
+	build->pass = pass;
+	build->next = 0;
+	t = (int)S__MIN(threads, build->nparts);
+	memset(pool, 0, sizeof (pool));
+	for (i=1; i<t; ++i) {
+		pool[i] = s__thread_open(_worker_, build);
+	}
+	_worker_(build);
+	for (i=1; i<t; ++i) {
+		s__thread_close(pool[i]);
+	}
+	if (build->error) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+split(struct build *build)
+{
+	s__index_tree_cursor_t cursor;
+	const char *key;
+	uint64_t *record;
+	struct part *part;
+	int c;
+
+	if (!(cursor = s__index_tree_cursor_open(build->tree))) {
+		S__TRACE(0);
+		return -1;
+	}
+	if (!s__index_tree_cursor_seek(cursor, NULL)) {
+		s__index_tree_cursor_close(cursor);
+		return 0;
+	}
+	key = s__index_tree_cursor_key(cursor);
+	for (build->lcp=0;
+	     key[build->lcp] && (key[build->lcp] == build->last[build->lcp]);
+	     ++build->lcp);
+	memcpy(build->prefix, key, build->lcp);
+	if (!key[build->lcp]) {
+		build->chain = s__index_tree_cursor_seek(cursor, NULL);
+	}
+	for (c=1; c<PARTS; ++c) {
+		build->prefix[build->lcp + 0] = (char)c;
+		build->prefix[build->lcp + 1] = '\0';
+		record = s__index_tree_cursor_seek(cursor, build->prefix);
+		key = record ? s__index_tree_cursor_key(cursor) : NULL;
+		if (!key || strncmp(key, build->prefix, build->lcp)) {
+			break;
+		}
+		c = CHAR2INT(key[build->lcp]);
+		part = &build->parts[build->nparts++];
+		part->len = build->lcp + 1;
+		if (!(part->prefix = s__malloc(part->len + 1)) ||
+		    !(part->cursor = s__index_tree_cursor_open(build->tree))) {
+			s__index_tree_cursor_close(cursor);
+			S__TRACE(0);
+			return -1;
+		}
+		memcpy(part->prefix, key, part->len);
+		part->prefix[part->len] = '\0';
+		part->valid = key[part->len] ? NULL : record;
+		part->stream.fnc = _range_;
+		part->stream.ctx = part;
+		part->stream.record_size =
+			s__index_tree_record_size(build->tree);
+		part->stream.shared = 1;
+	}
+	build->prefix[build->lcp] = '\0';
+	s__index_tree_cursor_close(cursor);
+	return 0;
+}
+
+static void
+put(struct s__index_succinct *succinct,
+    uint64_t *node,
+    uint64_t *item,
+    char key,
+    int left,
+    int center,
+    int right,
+    const uint64_t *record)
+{
+	const uint64_t i = (*node)++;
+
+	succinct->keys[i] = key;
+	if (left) {
+		s__index_bitmap_set(succinct->nodes, i * 3 + 0);
+	}
+	if (center) {
+		s__index_bitmap_set(succinct->nodes, i * 3 + 1);
+	}
+	if (right) {
+		s__index_bitmap_set(succinct->nodes, i * 3 + 2);
+	}
+	if (record) {
+		s__index_bitmap_set(succinct->valids, i);
+		memcpy(get_record(succinct, (*item)++),
+		       record,
+		       (size_t)succinct->record_size);
+	}
+}
+
+static void
+stitch(struct s__index_succinct *succinct, struct build *build)
+{
+	struct token *tokens, *next, *swap, *token;
+	uint64_t i, n, m, k, node, item;
+	struct part *part;
+	int mid;
+
+	node = item = 1;
+	tokens = build->tokens[0];
+	next = build->tokens[1];
+	tokens[0].kind = build->lcp ? TOKEN_CHAIN : TOKEN_TOP;
+	tokens[0].lo = 0;
+	tokens[0].hi = build->nparts;
+	tokens[0].level = 0;
+	n = 1;
+	while (n) {
+		for (i=0, m=0; i<n; ++i) {
+			token = &tokens[i];
+			k = m;
+			if (TOKEN_CHAIN == token->kind) {
+				next[m] = (*token);
+				if ((token->level + 1) < build->lcp) {
+					next[m++].level += 1;
+				}
+				else if (build->nparts) {
+					next[m++].kind = TOKEN_TOP;
+				}
+				put(succinct, &node, &item,
+				    build->prefix[token->level],
+				    0, (int)(m - k), 0,
+				    ((token->level + 1) == build->lcp) ?
+				    build->chain : NULL);
+			}
+			else if (TOKEN_TOP == token->kind) {
+				mid = token->lo + (token->hi - token->lo) / 2;
+				part = &build->parts[mid];
+				if (token->lo < mid) {
+					next[m] = (*token);
+					next[m++].hi = mid;
+				}
+				if (part->stream.items) {
+					next[m].kind = TOKEN_PART;
+					next[m].lo = mid;
+					next[m++].level = 0;
+				}
+				if ((mid + 1) < token->hi) {
+					next[m] = (*token);
+					next[m++].lo = mid + 1;
+				}
+				put(succinct, &node, &item,
+				    part->prefix[build->lcp],
+				    token->lo < mid,
+				    0 != part->stream.items,
+				    (mid + 1) < token->hi,
+				    part->valid);
+			}
+			else {
+				part = &build->parts[token->lo];
+				if ((token->level + 1) < part->stream.depth) {
+					next[m] = (*token);
+					next[m++].level += 1;
+				}
+				place(&part->stream, token->level,
+				      &node, &item);
+			}
+		}
+		swap = tokens;
+		tokens = next;
+		next = swap;
+		n = m;
+	}
+	succinct->size = node;
+	succinct->items = item;
+}
+
+static void
+build_close(struct build *build)
+{
+	int i;
+
+	if (build) {
+		for (i=0; i<build->nparts; ++i) {
+			s__index_tree_cursor_close(build->parts[i].cursor);
+			stream_free(&build->parts[i].stream);
+			S__FREE(build->parts[i].prefix);
+		}
+		S__FREE(build->prefix);
+		S__FREE(build->last);
+		memset(build, 0, sizeof (struct build));
+	}
+	S__FREE(build);
+}
+
+s__index_succinct_t
+s__index_succinct_build(s__index_tree_t tree, int threads)
+{
+	const uint64_t MAX = S__INDEX_TREE_MAX_KEY_LEN;
+	struct s__index_succinct *succinct;
+	struct build *build;
+	uint64_t size, items;
+	int i;
+
+	assert( tree );
+	assert( 0 < threads );
+
+	if (!(build = s__malloc(sizeof (struct build)))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memset(build, 0, sizeof (struct build));
+	build->tree = tree;
+	build->last = s__malloc(MAX + 1);
+	build->prefix = s__malloc(MAX + 1);
+	if (!build->last || !build->prefix) {
+		build_close(build);
+		S__TRACE(0);
+		return NULL;
+	}
+	build->last[0] = '\0';
+	s__index_tree_prev(tree, NULL, build->last);
+	if (split(build) || parallel(build, 1, threads)) {
+		build_close(build);
+		S__TRACE(0);
+		return NULL;
+	}
+	size = build->lcp + build->nparts + 1;
+	items = (build->chain ? 1 : 0) + 1;
+	for (i=0; i<build->nparts; ++i) {
+		size += build->parts[i].stream.size;
+		items += build->parts[i].stream.items;
+		items += build->parts[i].valid ? 1 : 0;
+	}
+	if (!(succinct = create(size,
+				items,
+				s__index_tree_record_size(tree)))) {
+		build_close(build);
+		S__TRACE(0);
+		return NULL;
+	}
+	if (succinct->items) {
+		build->succinct = succinct;
+		stitch(succinct, build);
+		if (parallel(build, 3, threads) || prepare(succinct)) {
+			s__index_succinct_close(succinct);
+			build_close(build);
+			S__TRACE(0);
+			return NULL;
+		}
+		assert( size == succinct->size );
+		assert( items == succinct->items );
+	}
+	build_close(build);
+	return succinct;
+}
+
+void
+s__index_succinct_close(s__index_succinct_t succinct)
+{
+	if (succinct) {
+		s__index_bitmap_close(succinct->nodes);
+		s__index_bitmap_close(succinct->valids);
+		s__index_bitmap_close(succinct->tombs);
+		S__FREE(succinct->sizes);
+		S__FREE(succinct->packed);
+		s__index_bloom_close(succinct->bloom);
+		chains_close(succinct->chains, succinct->mapped);
+		if (!succinct->mapped) {
+			S__FREE(succinct->keys);
+			S__FREE(succinct->records);
+		}
+		memset(succinct, 0, sizeof (struct s__index_succinct));
+	}
+	S__FREE(succinct);
+}
+
+int
+s__index_succinct_save(s__index_succinct_t succinct, FILE *file)
+{
+	const struct chains *chains;
+	struct header header;
+	uint64_t i, *records;
+
+	assert( succinct );
+	assert( !succinct->removed );
+	assert( file );
+
+	memset(&header, 0, sizeof (struct header));
+	memcpy(header.magic, MAGIC, sizeof (header.magic));
+	header.version = VERSION;
+	header.endian = (uint64_t)s__endian();
+	header.size = succinct->size;
+	header.items = succinct->items;
+	header.record_size = succinct->record_size;
+	if ((chains = succinct->chains)) {
+		header.collapsed = 1;
+		header.chains = chains->n;
+		header.bytes = chains->bytes;
+	}
+	if (s__file_write_aligned(file,
+				  &header,
+				  sizeof (struct header),
+				  ALIGN)) {
+		S__TRACE(0);
+		return -1;
+	}
+	if (!succinct->items) {
+		return 0;
+	}
+	records = succinct->records;
+	if (succinct->packed) {
+		i = succinct->items * sizeof (records[0]);
+		if (!(records = s__malloc(i))) {
+			S__TRACE(0);
+			return -1;
+		}
+		for (i=0; i<succinct->items; ++i) {
+			records[i] = get_value(succinct, i);
+		}
+	}
+	if (s__file_write_aligned(file,
+				  succinct->keys,
+				  succinct->size * sizeof (succinct->keys[0]),
+				  ALIGN) ||
+	    s__file_write_aligned(file,
+				  records,
+				  succinct->items * succinct->record_size,
+				  ALIGN) ||
+	    s__index_bitmap_save(succinct->nodes, file) ||
+	    s__index_bitmap_save(succinct->valids, file) ||
+	    (chains && chains->n &&
+	     (s__index_bitmap_save(chains->heads, file) ||
+	      s__index_bitmap_save(chains->starts, file) ||
+	      s__file_write_aligned(file,
+				    chains->fragments,
+				    chains->bytes,
+				    ALIGN)))) {
+		if (records != succinct->records) {
+			S__FREE(records);
+		}
+		S__TRACE(0);
+		return -1;
+	}
+	if (records != succinct->records) {
+		S__FREE(records);
+	}
+	return 0;
+}
+
+static int
+map_chains(struct s__index_succinct *succinct,
+	   const struct header *header,
+	   char *p,
+	   uint64_t size)
+{
+	struct chains *chains;
+	uint64_t n;
+
+	if (!(chains = s__malloc(sizeof (struct chains)))) {
+		S__TRACE(0);
+		return -1;
+	}
+	memset(chains, 0, sizeof (struct chains));
+	succinct->chains = chains;
+	if (!header->chains) {
+		return 0;
+	}
+	if (!(chains->heads = s__index_bitmap_map(p,
+						  size,
+						  header->size,
+						  &n))) {
+		S__TRACE(0);
+		return -1;
+	}
+	p += n;
+	size -= n;
+	if (!(chains->starts = s__index_bitmap_map(p,
+						   size,
+						   header->bytes,
+						   &n))) {
+		S__TRACE(0);
+		return -1;
+	}
+	p += n;
+	size -= n;
+	if (size < header->bytes) {
+		S__TRACE(S__ERR_FILE_READ);
+		return -1;
+	}
+	chains->fragments = p;
+	chains->n = header->chains;
+	chains->bytes = header->bytes;
+	if ((chains->n != s__index_bitmap_ones(chains->heads)) ||
+	    (chains->n != s__index_bitmap_ones(chains->starts)) ||
+	    (chains->bytes <= s__index_bitmap_select(chains->starts,
+						     chains->n)) ||
+	    chains->fragments[chains->bytes - 1]) {
+		S__TRACE(S__ERR_CHECKSUM); /* fragments past the bytes */
+		return -1;
+	}
+	return 0;
+}
+
+s__index_succinct_t
+s__index_succinct_map(void *map, uint64_t size)
+{
+	struct s__index_succinct *succinct;
+	struct header *header;
+	uint64_t n1, n2, n;
+	char *p;
+
+	assert( map );
+
+	header = (struct header *)map;
+	if ((sizeof (struct header) > size) ||
+	    memcmp(header->magic, MAGIC, sizeof (header->magic)) ||
+	    (VERSION != header->version) ||
+	    !header->record_size ||
+	    (header->record_size % sizeof (uint64_t)) ||
+	    (S__INDEX_TREE_MAX_RECORD_SIZE < header->record_size)) {
+		S__TRACE(S__ERR_CHECKSUM);
+		return NULL;
+	}
+	if ((uint64_t)s__endian() != header->endian) {
+		S__TRACE(S__ERR_ARCHITECTURE);
+		return NULL;
+	}
+	if (!(succinct = s__malloc(sizeof (struct s__index_succinct)))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memset(succinct, 0, sizeof (struct s__index_succinct));
+	succinct->mapped = 1;
+	succinct->record_size = header->record_size;
+	if (header->items) {
+		p = (char *)map + S__DUP(sizeof (struct header), ALIGN) * ALIGN;
+		size -= S__MIN((uint64_t)(p - (char *)map), size);
+		if ((size < header->size) ||
+		    (header->size < header->items) ||
+		    ((size / header->record_size) < header->items)) {
+			s__index_succinct_close(succinct);
+			S__TRACE(S__ERR_FILE_READ);
+			return NULL;
+		}
+		n1 = header->size * sizeof (succinct->keys[0]);
+		n2 = header->items * header->record_size;
+		n1 = S__DUP(n1, ALIGN) * ALIGN;
+		n2 = S__DUP(n2, ALIGN) * ALIGN;
+		if (size < (n1 + n2)) {
+			s__index_succinct_close(succinct);
+			S__TRACE(S__ERR_FILE_READ);
+			return NULL;
+		}
+		succinct->keys = p;
+		succinct->records = (uint64_t *)(p + n1);
+		succinct->size = header->size;
+		succinct->items = header->items;
+		p += n1 + n2;
+		size -= n1 + n2;
+		if (!(succinct->nodes = s__index_bitmap_map(p,
+							   size,
+							   header->size * 3,
+							   &n))) {
+			s__index_succinct_close(succinct);
+			S__TRACE(0);
+			return NULL;
+		}
+		p += n;
+		size -= n;
+		if (!(succinct->valids = s__index_bitmap_map(p,
+							    size,
+							    header->size,
+							    &n))) {
+			s__index_succinct_close(succinct);
+			S__TRACE(0);
+			return NULL;
+		}
+		if ((header->size <= s__index_bitmap_ones(succinct->nodes)) ||
+		    (header->items <= s__index_bitmap_ones(succinct->valids))) {
+			s__index_succinct_close(succinct);
+			S__TRACE(S__ERR_CHECKSUM); /* ranks past the arrays */
+			return NULL;
+		}
+		p += n;
+		size -= n;
+		if (header->collapsed && map_chains(succinct, header, p, size)) {
+			s__index_succinct_close(succinct);
+			S__TRACE(0);
+			return NULL;
+		}
+	}
+	return succinct;
+}
+
+static int
+filtered(struct s__index_succinct *succinct, const char *key)
+{
+	s__index_bloom_t bloom;
+	uint64_t hash;
+
+	if (!(bloom = succinct->bloom) ||
+	    s__index_bloom_test(bloom, (hash = s__hash(key, s__strlen(key))))) {
+		return 0;
+	}
+	s__atomic_add(&succinct->filtered[(hash >> 60) % SHARDS].n, 1);
+	return 1;
+}
+
+uint64_t *
+s__index_succinct_find(s__index_succinct_t succinct, const char *key)
+{
+	uint64_t i;
+
+	assert( succinct );
+	assert( !succinct->packed );
+	assert( key );
+
+	i = 0;
+	if (succinct->items && !filtered(succinct, key)) {
+		i = find(succinct, key);
+	}
+	return (i && !dead(succinct, i)) ? get_record(succinct, i) : NULL;
+}
+
+int
+s__index_succinct_get(s__index_succinct_t succinct,
+		      const char *key,
+		      uint64_t *value)
+{
+	uint64_t i;
+
+	assert( succinct );
+	assert( key );
+	assert( value );
+
+	i = 0;
+	if (succinct->items && !filtered(succinct, key)) {
+		i = find(succinct, key);
+	}
+	if (!i || dead(succinct, i)) {
+		return 0;
+	}
+	(*value) = get_value(succinct, i);
+	return 1;
+}
+
+void
+s__index_succinct_find_batch(s__index_succinct_t succinct,
+			     const char **keys,
+			     uint64_t n,
+			     uint64_t **records)
+{
+	uint64_t i, j, m, root, roots[BATCH], active;
+	const char *key[BATCH];
+
+	assert( succinct );
+	assert( !succinct->packed );
+	assert( !n || (keys && records) );
+
+	for (i=0; i<n; i+=m) {
+		m = S__MIN(BATCH, n - i);
+		active = 0;
+		for (j=0; j<m; ++j) {
+			records[i + j] = NULL;
+			key[j] = keys[i + j];
+			roots[j] = 0;
+			if (succinct->items && !filtered(succinct, key[j])) {
+				roots[j] = 3;
+				++active;
+			}
+		}
+		while (active) {
+			for (j=0; j<m; ++j) {
+				if (!roots[j]) {
+					continue;
+				}
+				root = step(succinct,
+					    roots[j],
+					    &key[j],
+					    &records[i + j]);
+				if (!(roots[j] = root)) {
+					--active;
+					continue;
+				}
+				prefetch(succinct, root);
+			}
+		}
+		for (j=0; succinct->tombs && (j<m); ++j) {
+			if (records[i + j] &&
+			    dead(succinct,
+				 (uint64_t)((char *)records[i + j] -
+					    (char *)succinct->records) /
+				 succinct->record_size)) {
+				records[i + j] = NULL;
+			}
+		}
+	}
+}
+
+uint64_t *
+s__index_succinct_next(s__index_succinct_t succinct,
+		       const char *key,
+		       char *okey)
+{
+	char probe[S__INDEX_TREE_MAX_KEY_LEN];
+	uint64_t i;
+
+	assert( succinct );
+	assert( !succinct->packed );
+	assert( okey );
+
+	i = 0;
+	if (succinct->items) {
+		if (s__strlen(key)) {
+			i = next(succinct, key, okey);
+		}
+		else {
+			i = min(succinct, 3, okey);
+		}
+		while (i && dead(succinct, i)) {
+			memcpy(probe, okey, s__strlen(okey) + 1);
+			i = next(succinct, probe, okey);
+		}
+	}
+	return i ? get_record(succinct, i) : NULL;
+}
+
+uint64_t *
+s__index_succinct_prev(s__index_succinct_t succinct,
+		       const char *key,
 		       char *okey)
 {
-	uint64_t i;
+	char probe[S__INDEX_TREE_MAX_KEY_LEN];
+	uint64_t i;
+
+	assert( succinct );
+	assert( !succinct->packed );
+	assert( okey );
+
+	i = 0;
+	if (succinct->items) {
+		if (s__strlen(key)) {
+			i = prev(succinct, key, okey);
+		}
+		else {
+			i = max(succinct, 3, okey);
+		}
+		while (i && dead(succinct, i)) {
+			memcpy(probe, okey, s__strlen(okey) + 1);
+			i = prev(succinct, probe, okey);
+		}
+	}
+	return i ? get_record(succinct, i) : NULL;
+}
+
+uint64_t
+s__index_succinct_record_size(s__index_succinct_t succinct)
+{
+	assert( succinct );
+
+	return succinct->record_size;
+}
+
+uint64_t
+s__index_succinct_items(s__index_succinct_t succinct)
+{
+	assert( succinct );
+
+	return succinct->items ? (succinct->items - 1 - succinct->removed) : 0;
+}
+
+/**
+ * Returns the last node of the run of lone center children starting at
+ * node, which ends at the first node ending a key, and its length in n.
+ */
+
+static uint64_t
+run(const struct s__index_succinct *succinct, uint64_t node, uint64_t *n)
+{
+	uint64_t child;
+
+	(*n) = 0;
+	if (get_node_(succinct, node * 3 + 0) ||
+	    get_node_(succinct, node * 3 + 2)) {
+		return node;
+	}
+	(*n) = 1;
+	while (!get_valid_(succinct, node) &&
+	       (child = get_node_(succinct, node * 3 + 1) / 3) &&
+	       !get_node_(succinct, child * 3 + 0) &&
+	       !get_node_(succinct, child * 3 + 2)) {
+		node = child;
+		++(*n);
+	}
+	return node;
+}
+
+/**
+ * Collapsing walks the trie breadth first, following each head with the
+ * children of the last node of its run, which visits the collapsed trie
+ * in its own level order. Node p of the collapsed trie stands for the
+ * nodes olds[p] through bottoms[p] of the trie, one node or a run. The
+ * walk sizes the collapsed trie, and a pass over it writes the nodes.
+ */
+
+static int
+rebuild(struct s__index_succinct *succinct,
+	struct chains *chains,
+	uint64_t *olds,
+	uint64_t *bottoms,
+	uint64_t size)
+{
+	struct s__index_succinct *collapsed;
+	uint64_t p, i, e, node;
+	s__index_bitmap_t bitmap;
+	uint64_t *records;
+	char *keys;
+
+	if (!(collapsed = create(size, succinct->items, succinct->record_size)) ||
+	    !(chains->heads = s__index_bitmap_open(size)) ||
+	    !(chains->starts = s__index_bitmap_open(chains->bytes)) ||
+	    !(chains->fragments = s__malloc(chains->bytes))) {
+		s__index_succinct_close(collapsed);
+		S__TRACE(0);
+		return -1;
+	}
+	chains->n = 0;
+	chains->bytes = 0;
+	for (p=1; p<size; ++p) {
+		collapsed->keys[p] = succinct->keys[olds[p]];
+		if ((i = get_valid_(succinct, bottoms[p]))) {
+			s__index_bitmap_set(collapsed->valids, p);
+			memcpy(get_record(collapsed, collapsed->items++),
+			       get_record(succinct, i),
+			       (size_t)succinct->record_size);
+		}
+		if (olds[p] != bottoms[p]) {
+			s__index_bitmap_set(chains->heads, p);
+			s__index_bitmap_set(chains->starts, chains->bytes);
+			node = olds[p];
+			do {
+				node = get_node_(succinct, node * 3 + 1) / 3;
+				chains->fragments[chains->bytes++] =
+					succinct->keys[node];
+			} while (node != bottoms[p]);
+			chains->fragments[chains->bytes++] = '\0';
+			++chains->n;
+		}
+		for (e=0; e<3; ++e) {
+			node = (CENTER == e) ? bottoms[p] : olds[p];
+			if (get_node_(succinct, node * 3 + e)) {
+				s__index_bitmap_set(collapsed->nodes, p * 3 + e);
+			}
+		}
+	}
+	assert( collapsed->items == succinct->items );
+
+	collapsed->size = size;
+	if (prepare(collapsed) ||
+	    s__index_bitmap_prepare(chains->heads) ||
+	    s__index_bitmap_prepare(chains->starts)) {
+		s__index_succinct_close(collapsed);
+		S__TRACE(0);
+		return -1;
+	}
+	keys = succinct->keys;
+	succinct->keys = collapsed->keys;
+	collapsed->keys = keys;
+	records = succinct->records;
+	succinct->records = collapsed->records;
+	collapsed->records = records;
+	bitmap = succinct->nodes;
+	succinct->nodes = collapsed->nodes;
+	collapsed->nodes = bitmap;
+	bitmap = succinct->valids;
+	succinct->valids = collapsed->valids;
+	collapsed->valids = bitmap;
+	succinct->size = size;
+	s__index_succinct_close(collapsed);
+	return 0;
+}
+
+int
+s__index_succinct_collapse(s__index_succinct_t succinct)
+{
+	uint64_t p, e, n, node, child, size, *olds, *bottoms;
+	struct chains *chains;
+
+	assert( succinct );
+
+	if (!succinct->items || succinct->chains) {
+		return 0;
+	}
+
+	assert( !succinct->mapped );
+	assert( !succinct->tombs && !succinct->sizes );
+	assert( !succinct->bloom && !succinct->packed );
+
+	if (!(chains = s__malloc(sizeof (struct chains)))) {
+		S__TRACE(0);
+		return -1;
+	}
+	memset(chains, 0, sizeof (struct chains));
+	n = succinct->size * sizeof (olds[0]);
+	olds = bottoms = NULL;
+	if (!(olds = s__malloc(n)) || !(bottoms = s__malloc(n))) {
+		S__FREE(olds);
+		chains_close(chains, 0);
+		S__TRACE(0);
+		return -1;
+	}
+	olds[1] = bottoms[1] = 1;
+	size = 2;
+	for (p=1; p<size; ++p) {
+		for (e=0; e<3; ++e) {
+			node = (CENTER == e) ? bottoms[p] : olds[p];
+			if (!(child = get_node_(succinct, node * 3 + e) / 3)) {
+				continue;
+			}
+			olds[size] = bottoms[size] = child;
+			if ((CENTER == e) &&
+			    (node = run(succinct, child, &n)) &&
+			    (CHAIN <= n)) {
+				bottoms[size] = node;
+				chains->bytes += n; /* and a null byte */
+				++chains->n;
+			}
+			++size;
+		}
+	}
+	if (chains->n && rebuild(succinct, chains, olds, bottoms, size)) {
+		S__FREE(olds);
+		S__FREE(bottoms);
+		chains_close(chains, 0);
+		S__TRACE(0);
+		return -1;
+	}
+	S__FREE(olds);
+	S__FREE(bottoms);
+	succinct->chains = chains;
+	return 0;
+}
+
+int
+s__index_succinct_collapsed(s__index_succinct_t succinct)
+{
+	assert( succinct );
+
+	return !succinct->items || succinct->chains;
+}
 
+uint64_t
+s__index_succinct_chained(s__index_succinct_t succinct)
+{
 	assert( succinct );
-	assert( okey );
 
-	i = 0;
-	if (succinct->items) {
-		if (s__strlen(key)) {
-			i = next(succinct, key, okey);
+	if (!succinct->chains) {
+		return 0;
+	}
+	return succinct->chains->bytes - succinct->chains->n;
+}
+
+int
+s__index_succinct_filter(s__index_succinct_t succinct, uint64_t bits_per_key)
+{
+	s__index_succinct_cursor_t cursor;
+	s__index_bloom_t bloom;
+	const char *key;
+
+	assert( succinct );
+
+	if (!succinct->items || succinct->bloom) {
+		return 0;
+	}
+	cursor = NULL;
+	if (!(bloom = s__index_bloom_open(succinct->items, bits_per_key)) ||
+	    !(cursor = s__index_succinct_cursor_open(succinct))) {
+		s__index_bloom_close(bloom);
+		S__TRACE(0);
+		return -1;
+	}
+	if (s__index_succinct_cursor_seek(cursor, NULL)) {
+		do {
+			key = s__index_succinct_cursor_key(cursor);
+			s__index_bloom_add(bloom, s__hash(key, s__strlen(key)));
+		} while (s__index_succinct_cursor_next(cursor));
+	}
+	s__index_succinct_cursor_close(cursor);
+	s__fence_release();
+	succinct->bloom = bloom;
+	return 0;
+}
+
+int
+s__index_succinct_pack(s__index_succinct_t succinct)
+{
+	uint64_t i, q, r, v, min, max, bits;
+	uint64_t *packed;
+
+	assert( succinct );
+
+	if (!succinct->items || succinct->packed) {
+		return 0;
+	}
+	if (sizeof (uint64_t) != succinct->record_size) {
+		S__TRACE(S__ERR_ARGUMENT);
+		return -1;
+	}
+	min = max = succinct->records[succinct->items - 1];
+	for (i=1; i<succinct->items; ++i) {
+		min = S__MIN(min, succinct->records[i]);
+		max = S__MAX(max, succinct->records[i]);
+	}
+	for (bits=0; (64 > bits) && ((max - min) >> bits); ++bits);
+	v = S__DUP(succinct->items * bits, 64) + 1;
+	if (!(packed = s__malloc(v * sizeof (packed[0])))) {
+		S__TRACE(0);
+		return -1;
+	}
+	memset(packed, 0, v * sizeof (packed[0]));
+	for (i=1; bits && (i<succinct->items); ++i) {
+		v = succinct->records[i] - min;
+		q = i * bits / 64;
+		r = i * bits % 64;
+		packed[q] |= v << r;
+		if (64 < (r + bits)) {
+			packed[q + 1] |= v >> (64 - r);
 		}
-		else {
-			i = min(succinct, 3, okey);
+	}
+	if (!succinct->mapped) {
+		S__FREE(succinct->records);
+	}
+	succinct->records = NULL;
+	succinct->packed = packed;
+	succinct->base = min;
+	succinct->bits = bits;
+	return 0;
+}
+
+uint64_t
+s__index_succinct_filtered(s__index_succinct_t succinct)
+{
+	uint64_t i, n;
+
+	assert( succinct );
+
+	n = 0;
+	for (i=0; i<SHARDS; ++i) {
+		n += succinct->filtered[i].n;
+	}
+	return n;
+}
+
+/**
+ * Stats: children follow their parent in breadth-first order, so a single
+ * forward pass assigns every node the depth of its parent plus one. The
+ * depth of a key counts the nodes a lookup visits, siblings included, and
+ * a collapsed chain is the single node heading it.
+ */
+
+int
+s__index_succinct_stats(s__index_succinct_t succinct,
+			struct s__index_tree_stats *stats)
+{
+	const struct chains *chains;
+	uint32_t *depths;
+	uint64_t i, j, n, node;
+
+	assert( succinct );
+	assert( stats );
+
+	memset(stats, 0, sizeof (struct s__index_tree_stats));
+	if (!succinct->items) {
+		return 0;
+	}
+	n = succinct->size * sizeof (succinct->keys[0]);
+	if (succinct->packed) {
+		n += (S__DUP(succinct->items * succinct->bits, 64) + 1) *
+			sizeof (succinct->packed[0]);
+	}
+	else {
+		n += succinct->items * succinct->record_size;
+	}
+	n += s__index_bitmap_bytes(succinct->nodes);
+	n += s__index_bitmap_bytes(succinct->valids);
+	if (succinct->tombs) {
+		n += s__index_bitmap_bytes(succinct->tombs);
+	}
+	if (succinct->sizes) {
+		n += succinct->size * sizeof (succinct->sizes[0]);
+	}
+	if (succinct->bloom) {
+		n += s__index_bloom_bytes(succinct->bloom);
+	}
+	if ((chains = succinct->chains) && chains->n) {
+		n += s__index_bitmap_bytes(chains->heads);
+		n += s__index_bitmap_bytes(chains->starts);
+		n += chains->bytes;
+	}
+	stats->allocated = n;
+	stats->used = n - (succinct->packed ?
+			   succinct->removed * succinct->bits / 8 :
+			   succinct->removed * succinct->record_size);
+	stats->nodes = succinct->size - 1;
+	if (!(depths = s__malloc(succinct->size * sizeof (depths[0])))) {
+		S__TRACE(0);
+		return -1;
+	}
+	memset(depths, 0, succinct->size * sizeof (depths[0]));
+	depths[1] = 1;
+	for (i=1; i<succinct->size; ++i) {
+		for (j=0; j<3; ++j) {
+			if ((node = get_node_(succinct, i * 3 + j)) &&
+			    !depths[node / 3]) {
+				depths[node / 3] = depths[i] + 1;
+			}
+		}
+		if (live_(succinct, i)) {
+			stats->keys += 1;
+			stats->depths += depths[i];
+			stats->max_depth = S__MAX(stats->max_depth,
+						  (uint64_t)depths[i]);
 		}
 	}
-	return i ? &succinct->records[i] : NULL;
+	S__FREE(depths);
+	return 0;
 }
 
-uint64_t *
-s__index_succinct_prev(s__index_succinct_t succinct,
-		       const char *key,
-		       char *okey)
+uint64_t
+s__index_succinct_removed(s__index_succinct_t succinct)
+{
+	assert( succinct );
+
+	return succinct->removed;
+}
+
+int
+s__index_succinct_remove(s__index_succinct_t succinct, const char *key)
+{
+	s__index_bitmap_t tombs;
+	uint64_t i, node;
+
+	assert( succinct );
+	assert( s__strlen(key) );
+
+	if (!succinct->items ||
+	    !(node = find_node(succinct, key)) ||
+	    !(i = get_valid(succinct, node)) ||
+	    dead(succinct, i)) {
+		return 0;
+	}
+	if (!succinct->tombs) {
+		if (!(tombs = s__index_bitmap_open(succinct->items))) {
+			S__TRACE(0);
+			return -1;
+		}
+		s__fence_release();
+		succinct->tombs = tombs;
+	}
+	s__index_bitmap_set(succinct->tombs, i);
+	succinct->removed += 1;
+	if (succinct->sizes) {
+		node = REAL(node);
+		while (node) {
+			__sync_fetch_and_sub(succinct->sizes + node, 1);
+			node = s__index_bitmap_select(succinct->nodes, node);
+			node /= 3;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Subtree sizes: children follow their parent in breadth-first order, so
+ * a single backward pass accumulates the number of keys below every node.
+ * The sizes are computed by the first count and published atomically; a
+ * removal decrements the sizes of the node and its ancestors, found by
+ * select on the incoming edge.
+ */
+
+static uint64_t *
+sizes(struct s__index_succinct *succinct)
+{
+	uint64_t i, j, node, *sizes;
+
+	if ((sizes = succinct->sizes)) {
+		s__fence_acquire();
+		return sizes;
+	}
+	if (!(sizes = s__malloc(succinct->size * sizeof (sizes[0])))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	sizes[0] = 0;
+	for (i=succinct->size-1; i; --i) {
+		sizes[i] = live_(succinct, i) ? 1 : 0;
+		for (j=0; j<3; ++j) {
+			if ((node = get_node_(succinct, i * 3 + j))) {
+				sizes[i] += sizes[node / 3];
+			}
+		}
+	}
+	s__fence_release();
+	if (!__sync_bool_compare_and_swap(&succinct->sizes, NULL, sizes)) {
+		S__FREE(sizes);
+		sizes = succinct->sizes;
+	}
+	return sizes;
+}
+
+int
+s__index_succinct_count(s__index_succinct_t succinct,
+			const char *prefix,
+			uint64_t *n)
+{
+	uint64_t node, child, *sizes_;
+
+	assert( succinct );
+	assert( n );
+
+	(*n) = 0;
+	if (!succinct->items) {
+		return 0;
+	}
+	if (!s__strlen(prefix)) {
+		(*n) = s__index_succinct_items(succinct);
+		return 0;
+	}
+	if (!(sizes_ = sizes(succinct))) {
+		S__TRACE(0);
+		return -1;
+	}
+	if ((node = find_node(succinct, prefix))) {
+		(*n) = live(succinct, node) ? 1 : 0;
+		if ((child = get_node(succinct, node * 3 + 1))) {
+			(*n) += sizes_[REAL(child / 3)];
+		}
+	}
+	return 0;
+}
+
+static int
+push(struct s__index_succinct_cursor *cursor, uint64_t root, int edge)
+{
+	struct frame *frame;
+	uint64_t n;
+
+	if (cursor->depth == cursor->capacity) {
+		n = (cursor->capacity + 64) * sizeof (cursor->path[0]);
+		if (!(frame = s__realloc(cursor->path, n))) {
+			S__TRACE(0);
+			return -1;
+		}
+		cursor->path = frame;
+		cursor->capacity += 64;
+	}
+	frame = &cursor->path[cursor->depth];
+	frame->len = cursor->depth ? frame[-1].len : 0;
+	if (CENTER == edge) {
+		n = frame[-1].root / 3;
+		cursor->key[frame->len++] = get_key(cursor->succinct, n);
+	}
+	frame->root = root;
+	frame->edge = edge;
+	++cursor->depth;
+	return 0;
+}
+
+static int
+descend(struct s__index_succinct_cursor *cursor,
+	uint64_t root,
+	int edge,
+	int side)
+{
+	if (push(cursor, root, edge)) {
+		S__TRACE(0);
+		return -1;
+	}
+	while ((root = get_node(cursor->succinct, root + side))) {
+		if (push(cursor, root, side)) {
+			S__TRACE(0);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static uint64_t *
+emit(struct s__index_succinct_cursor *cursor)
 {
+	struct s__index_succinct *succinct;
+	struct frame *frame;
 	uint64_t i;
 
+	succinct = cursor->succinct;
+	frame = &cursor->path[cursor->depth - 1];
+	cursor->key[frame->len + 0] = get_key(succinct, frame->root / 3);
+	cursor->key[frame->len + 1] = '\0';
+	i = get_valid(succinct, frame->root / 3);
+	if (succinct->packed) {
+		cursor->value = get_value(succinct, i);
+		return &cursor->value;
+	}
+	return get_record(succinct, i);
+}
+
+static uint64_t *
+forward(struct s__index_succinct_cursor *cursor, int stage)
+{
+	struct s__index_succinct *succinct;
+	uint64_t root, node;
+	int edge;
+
+	succinct = cursor->succinct;
+	while (cursor->depth) {
+		root = cursor->path[cursor->depth - 1].root;
+		switch (stage) {
+		case SELF:
+			if (live(succinct, root / 3)) {
+				return emit(cursor);
+			}
+			stage = CENTER;
+			break;
+		case CENTER:
+		case RIGHT:
+			if ((node = get_node(succinct, root + stage))) {
+				if (descend(cursor, node, stage, LEFT)) {
+					S__TRACE(0);
+					return NULL;
+				}
+				stage = SELF;
+			}
+			else {
+				stage = (CENTER == stage) ? RIGHT : UP;
+			}
+			break;
+		default:
+			edge = cursor->path[--cursor->depth].edge;
+			if (LEFT == edge) {
+				stage = SELF;
+			}
+			else if (CENTER == edge) {
+				stage = RIGHT;
+			}
+			else {
+				stage = UP;
+			}
+			break;
+		}
+	}
+	return NULL;
+}
+
+static uint64_t *
+backward(struct s__index_succinct_cursor *cursor, int stage)
+{
+	struct s__index_succinct *succinct;
+	uint64_t root, node;
+	int edge;
+
+	succinct = cursor->succinct;
+	while (cursor->depth) {
+		root = cursor->path[cursor->depth - 1].root;
+		switch (stage) {
+		case SELF:
+			if (live(succinct, root / 3)) {
+				return emit(cursor);
+			}
+			stage = LEFT;
+			break;
+		case CENTER:
+		case LEFT:
+			if ((node = get_node(succinct, root + stage))) {
+				if (descend(cursor, node, stage, RIGHT)) {
+					S__TRACE(0);
+					return NULL;
+				}
+				stage = CENTER;
+			}
+			else {
+				stage = (CENTER == stage) ? SELF : UP;
+			}
+			break;
+		default:
+			edge = cursor->path[--cursor->depth].edge;
+			if (RIGHT == edge) {
+				stage = CENTER;
+			}
+			else if (CENTER == edge) {
+				stage = SELF;
+			}
+			else {
+				stage = UP;
+			}
+			break;
+		}
+	}
+	return NULL;
+}
+
+s__index_succinct_cursor_t
+s__index_succinct_cursor_open(s__index_succinct_t succinct)
+{
+	struct s__index_succinct_cursor *cursor;
+	uint64_t n;
+
 	assert( succinct );
-	assert( okey );
 
-	i = 0;
-	if (succinct->items) {
-		if (s__strlen(key)) {
-			i = prev(succinct, key, okey);
+	n = sizeof (struct s__index_succinct_cursor);
+	if (!(cursor = s__malloc(n))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memset(cursor, 0, n);
+	cursor->succinct = succinct;
+	return cursor;
+}
+
+void
+s__index_succinct_cursor_close(s__index_succinct_cursor_t cursor)
+{
+	if (cursor) {
+		S__FREE(cursor->path);
+		memset(cursor, 0, sizeof (struct s__index_succinct_cursor));
+	}
+	S__FREE(cursor);
+}
+
+uint64_t *
+s__index_succinct_cursor_seek(s__index_succinct_cursor_t cursor,
+			      const char *key)
+{
+	struct s__index_succinct *succinct;
+	uint64_t root, node;
+	int d;
+
+	assert( cursor );
+
+	succinct = cursor->succinct;
+	cursor->depth = 0;
+	if (!succinct->items) {
+		return NULL;
+	}
+	if (!s__strlen(key)) {
+		if (descend(cursor, 3, UP, LEFT)) {
+			S__TRACE(0);
+			return NULL;
+		}
+		return forward(cursor, SELF);
+	}
+	if (push(cursor, 3, UP)) {
+		S__TRACE(0);
+		return NULL;
+	}
+	for (;;) {
+		root = cursor->path[cursor->depth - 1].root;
+		d = CHAR2INT(*key) - CHAR2INT(get_key(succinct, root / 3));
+		if (0 > d) {
+			if (!(node = get_node(succinct, root + LEFT))) {
+				return forward(cursor, SELF);
+			}
+			if (push(cursor, node, LEFT)) {
+				S__TRACE(0);
+				return NULL;
+			}
+		}
+		else if (0 < d) {
+			if (!(node = get_node(succinct, root + RIGHT))) {
+				return forward(cursor, UP);
+			}
+			if (push(cursor, node, RIGHT)) {
+				S__TRACE(0);
+				return NULL;
+			}
 		}
 		else {
-			i = max(succinct, 3, okey);
+			if ('\0' == (*(++key))) {
+				return forward(cursor, SELF);
+			}
+			if (!(node = get_node(succinct, root + CENTER))) {
+				return forward(cursor, RIGHT);
+			}
+			if (push(cursor, node, CENTER)) {
+				S__TRACE(0);
+				return NULL;
+			}
 		}
 	}
-	return i ? &succinct->records[i] : NULL;
+	return NULL;
 }
 
-uint64_t
-s__index_succinct_items(s__index_succinct_t succinct)
+uint64_t *
+s__index_succinct_cursor_next(s__index_succinct_cursor_t cursor)
+{
+	assert( cursor );
+
+	return forward(cursor, CENTER);
+}
+
+uint64_t *
+s__index_succinct_cursor_prev(s__index_succinct_cursor_t cursor)
+{
+	assert( cursor );
+
+	return backward(cursor, LEFT);
+}
+
+const char *
+s__index_succinct_cursor_key(s__index_succinct_cursor_t cursor)
+{
+	assert( cursor );
+	assert( cursor->depth );
+
+	return cursor->key;
+}
+
+static int
+_compact_(void *ctx, int rewind, const char **key, uint64_t *record)
+{
+	struct s__index_succinct_cursor *cursor;
+	uint64_t *record_;
+
+	cursor = (struct s__index_succinct_cursor *)ctx;
+	if (rewind) {
+		record_ = s__index_succinct_cursor_seek(cursor, NULL);
+	}
+	else {
+		record_ = s__index_succinct_cursor_next(cursor);
+	}
+	if (!record_) {
+		return 0;
+	}
+	(*key) = cursor->key;
+	memcpy(record, record_, (size_t)cursor->succinct->record_size);
+	return 1;
+}
+
+s__index_succinct_t
+s__index_succinct_compact(s__index_succinct_t succinct)
 {
+	s__index_succinct_cursor_t cursor;
+	s__index_succinct_t compact;
+
 	assert( succinct );
 
-	return succinct->items ? (succinct->items - 1) : 0;
+	if (!(cursor = s__index_succinct_cursor_open(succinct))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	if (!(compact = s__index_succinct_stream(_compact_,
+						 cursor,
+						 succinct->record_size))) {
+		s__index_succinct_cursor_close(cursor);
+		S__TRACE(0);
+		return NULL;
+	}
+	s__index_succinct_cursor_close(cursor);
+	return compact;
 }
@@ -7,17 +7,41 @@
 #ifndef _S_INDEX_SUCCINCT_H_
 #define _S_INDEX_SUCCINCT_H_
 
-#include "s_index_ternary.h"
+#include "s_index_tree.h"
 
 typedef struct s__index_succinct *s__index_succinct_t;
 
-s__index_succinct_t s__index_succinct_open(s__index_ternary_t ternary);
+typedef struct s__index_succinct_cursor *s__index_succinct_cursor_t;
+
+typedef int (*s__index_succinct_fnc_t)(void *ctx,
+				       int rewind,
+				       const char **key,
+				       uint64_t *record);
+
+s__index_succinct_t s__index_succinct_build(s__index_tree_t tree, int threads);
+
+s__index_succinct_t s__index_succinct_stream(s__index_succinct_fnc_t fnc,
+					     void *ctx,
+					     uint64_t record_size);
 
 void s__index_succinct_close(s__index_succinct_t succinct);
 
+int s__index_succinct_save(s__index_succinct_t succinct, FILE *file);
+
+s__index_succinct_t s__index_succinct_map(void *map, uint64_t size);
+
 uint64_t *s__index_succinct_find(s__index_succinct_t succinct,
 				 const char *key);
 
+int s__index_succinct_get(s__index_succinct_t succinct,
+			  const char *key,
+			  uint64_t *value);
+
+void s__index_succinct_find_batch(s__index_succinct_t succinct,
+				  const char **keys,
+				  uint64_t n,
+				  uint64_t **records);
+
 uint64_t *s__index_succinct_next(s__index_succinct_t succinct,
 				 const char *key,
 				 char *okey);
@@ -26,6 +50,48 @@ uint64_t *s__index_succinct_prev(s__index_succinct_t succinct,
 				 const char *key,
 				 char *okey);
 
+uint64_t s__index_succinct_record_size(s__index_succinct_t succinct);
+
 uint64_t s__index_succinct_items(s__index_succinct_t succinct);
 
+int s__index_succinct_remove(s__index_succinct_t succinct, const char *key);
+
+uint64_t s__index_succinct_removed(s__index_succinct_t succinct);
+
+int s__index_succinct_collapse(s__index_succinct_t succinct);
+
+int s__index_succinct_collapsed(s__index_succinct_t succinct);
+
+uint64_t s__index_succinct_chained(s__index_succinct_t succinct);
+
+int s__index_succinct_filter(s__index_succinct_t succinct,
+			     uint64_t bits_per_key);
+
+uint64_t s__index_succinct_filtered(s__index_succinct_t succinct);
+
+int s__index_succinct_pack(s__index_succinct_t succinct);
+
+int s__index_succinct_stats(s__index_succinct_t succinct,
+			    struct s__index_tree_stats *stats);
+
+s__index_succinct_t s__index_succinct_compact(s__index_succinct_t succinct);
+
+int s__index_succinct_count(s__index_succinct_t succinct,
+			    const char *prefix,
+			    uint64_t *n);
+
+s__index_succinct_cursor_t
+s__index_succinct_cursor_open(s__index_succinct_t succinct);
+
+void s__index_succinct_cursor_close(s__index_succinct_cursor_t cursor);
+
+uint64_t *s__index_succinct_cursor_seek(s__index_succinct_cursor_t cursor,
+					const char *key);
+
+uint64_t *s__index_succinct_cursor_next(s__index_succinct_cursor_t cursor);
+
+uint64_t *s__index_succinct_cursor_prev(s__index_succinct_cursor_t cursor);
+
+const char *s__index_succinct_cursor_key(s__index_succinct_cursor_t cursor);
+
 #endif /* _S_INDEX_SUCCINCT_H_ */
@@ -5,29 +5,120 @@
  */
 
 #include "s_index_queue.h"
+#include "s_index_art.h"
 #include "s_index_tree.h"
 
+#define DEPTH 128 /* exceeds the height of any AVL tree in memory */
+#define BATCH 16 /* lookups interleaved by s__index_tree_find_batch() */
+#define ALIGN 8 /* node size granularity */
+#define CHUNK_SIZE 1048576 /* node space per allocation */
+#define SHARE 8 /* shortest prefix worth front coding */
+#define LONGER 16 /* prefix gain that warrants a new shared prefix */
+#define SPLITS 8 /* top level subtrees per scanner */
+#define CLASSES S__DUP(S__INDEX_TREE_MAX_RECORD_SIZE +			\
+		       sizeof (struct node) +				\
+		       sizeof (struct code) +				\
+		       S__INDEX_TREE_MAX_KEY_LEN,			\
+		       ALIGN)
+
 #pragma pack(push, 1)
 struct node {
-	int depth;
-	uint64_t record;
 	struct node *left;
 	struct node *right;
+	int depth;
+};
+
+struct code {
+	uint32_t len;
+	struct prefix *prefix; /* aligned, following struct node */
 };
 #pragma pack(pop)
 
+struct prefix {
+	uint64_t refs;
+};
+
+/**
+ * Node space: a node is preceded by its record, of record_size bytes, and
+ * followed by its key, all in a multiple of ALIGN bytes, keeping records
+ * aligned. The space of a removed node is pushed onto the free list of
+ * its size class, linked through its record, and reused by the next node
+ * of the same class. The last byte of a node is always zero, bounding the
+ * key of a node reused under a concurrent reader.
+ *
+ * Reuse rule: space freed by a node is only ever reused by a node, and
+ * space freed by a prefix only by a prefix, each class having two free
+ * lists. A reader still inside a reused node thus reads the links of a
+ * live node, never bytes of text as links. Such links may still lead a
+ * stale traversal around a cycle, so every descent gives up after DEPTH
+ * steps, more than any live path takes, and the reader's version check
+ * discards what it found. The free lists are allocated by the first
+ * removal.
+ */
+
+/**
+ * Front coding: a coded tree follows each node with a code, holding the
+ * length of the key prefix it shares with a prefix string, and only then
+ * the rest of the key. A new node takes the prefix of the node next to
+ * it in key order, its parent at insertion, or creates a prefix out of
+ * their common bytes when it shares at least SHARE bytes. Prefix strings
+ * are reference counted and carved from the node chunks, but freed onto
+ * free lists of their own. A key comparison reads two strings rather than
+ * one.
+ */
+
+/**
+ * Fixed width: an integer tree follows each node with its key as eight
+ * big-endian bytes, so a key comparison is a 64-bit load and a byte swap
+ * per side. Keys still cross the interface as the strings written by
+ * s__index_tree_encode_u64(), ten bytes of seven bits each, which order
+ * as the integers do. A call decodes its key once, and keys leave the
+ * tree encoded again.
+ */
+
 struct s__index_tree {
+	s__index_art_t art; /* adaptive radix tree in place of nodes, or NULL */
+	uint64_t record_size;
+	int coded;
+	int fixed; /* integer keys, as eight big-endian bytes */
 	void *chunk;
 	uint64_t size;
+	uint64_t used; /* bytes of live nodes and prefixes */
+	void **free; /* per size class of nodes, then of prefixes */
 	/*-*/
 	void *root;
 	uint64_t items;
 };
 
+struct s__index_tree_cursor {
+	struct s__index_tree *tree;
+	s__index_art_cursor_t art;
+	char *key; /* of a coded tree */
+	int depth;
+	struct node *path[DEPTH];
+};
+
+/**
+ * Parallel scan: the nodes of the top levels of the tree, in key order,
+ * split it into key ranges of about SPLITS subtrees per scanner. An AVL
+ * tree keeps the subtrees of a level within a small factor of each other
+ * in size. Each scanner walks its range with a cursor, from the first
+ * node of the range to the node starting the next, so the ranges, taken
+ * in scanner order, visit every key in key order.
+ */
+
+struct scan {
+	struct s__index_tree *tree;
+	s__index_tree_fnc_t fnc;
+	void *ctx;
+	const struct node *lo; /* first node, or NULL for the smallest */
+	const struct node *hi; /* node past the last, or NULL */
+	volatile int *error;
+};
+
 static int
 check(struct s__index_tree *tree, uint64_t n)
 {
-	const uint64_t CHUNK_SIZE = 1048576;
 	void *chunk;
 
 	if (!tree->chunk || (CHUNK_SIZE < (tree->size + n))) {
@@ -42,18 +133,339 @@ check(struct s__index_tree *tree, uint64_t n)
 	return 0;
 }
 
-static struct node *
-get_node(struct s__index_tree *tree, uint64_t i)
+static void **
+list(struct s__index_tree *tree, uint64_t n, int prefix)
+{
+	return &tree->free[(prefix ? (CLASSES + 1) : 0) + n / ALIGN];
+}
+
+static void *
+take(struct s__index_tree *tree, uint64_t n, int prefix)
+{
+	void *p;
+
+	if (tree->free && (p = (*list(tree, n, prefix)))) {
+		(*list(tree, n, prefix)) = (*((void **)p));
+	}
+	else {
+		p = (char *)tree->chunk + tree->size;
+		tree->size += n;
+		((char *)p)[n - 1] = '\0';
+	}
+	tree->used += n;
+	return p;
+}
+
+static void
+give(struct s__index_tree *tree, void *p, uint64_t n, int prefix)
+{
+	assert( !(n % ALIGN) && (CLASSES >= (n / ALIGN)) );
+
+	(*((void **)p)) = (*list(tree, n, prefix));
+	(*list(tree, n, prefix)) = p;
+	tree->used -= n;
+}
+
+static uint64_t *
+get_record(const struct s__index_tree *tree, const struct node *node)
+{
+	return (uint64_t *)((char *)node - tree->record_size);
+}
+
+static struct code *
+get_code(const struct node *node)
+{
+	return (struct code *)(node + 1);
+}
+
+static const char *
+get_prefix(const struct code *code)
 {
-	return (struct node *)((char *)tree->chunk + i);
+	return (const char *)(code->prefix + 1);
 }
 
 static const char *
-get_key(const struct node *node)
+get_key(const struct s__index_tree *tree, const struct node *node)
 {
+	if (tree->coded) {
+		return (const char *)(get_code(node) + 1);
+	}
 	return (const char *)(node + 1);
 }
 
+static uint64_t
+get_u64(const char *p)
+{
+	uint64_t x;
+
+	memcpy(&x, p, sizeof (x));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	x = s__bswap(x);
+#endif
+	return x;
+}
+
+static uint64_t
+length(const struct s__index_tree *tree, const char *key)
+{
+	return tree->fixed ? sizeof (uint64_t) : s__strlen(key);
+}
+
+static const char *
+put_u64(uint64_t x, char *buf)
+{
+	int i;
+
+	for (i=0; i<(int)sizeof (x); ++i) {
+		buf[i] = (char)(x >> (8 * ((int)sizeof (x) - 1 - i)));
+	}
+	return buf;
+}
+
+/**
+ * Returns key, or for an integer tree, the eight bytes of the decoded key
+ * in buf, or NULL if key is not an integer key.
+ */
+
+static const char *
+probe(const struct s__index_tree *tree, const char *key, char *buf)
+{
+	uint64_t x;
+
+	if (!tree->fixed) {
+		return key;
+	}
+	if (s__index_tree_decode_u64(key, &x)) {
+		return NULL;
+	}
+	return put_u64(x, buf);
+}
+
+/**
+ * Sets x to the smallest integer whose key is no less than key, a string
+ * of any form, and returns 0 if that key is key, 1 if it is greater, or -1
+ * if no integer key is as great. Ordered lookups in an integer tree take
+ * any string, as the succinct builder seeks by key prefix.
+ */
+
+static int
+ceiling(const char *key, uint64_t *x)
+{
+	const unsigned char *p;
+	int i;
+
+	p = (const unsigned char *)key;
+	(*x) = 0;
+	if (0x81 < p[0]) {
+		return -1;
+	}
+	for (i=0; i<S__INDEX_TREE_U64_LEN; ++i) {
+		if (0x80 > p[i]) {
+			if (i) {
+				(*x) <<= 7 * (S__INDEX_TREE_U64_LEN - i);
+			}
+			return 1;
+		}
+		(*x) = ((*x) << 7) | (p[i] & 0x7f);
+	}
+	if (!p[i]) {
+		return 0;
+	}
+	return ++(*x) ? 1 : -1;
+}
+
+static uint64_t
+size(const struct s__index_tree *tree, uint64_t n)
+{
+	n += tree->record_size + sizeof (struct node) + 1;
+	n += tree->coded ? sizeof (struct code) : 0;
+	return S__DUP(n, ALIGN) * ALIGN;
+}
+
+static uint64_t
+reserve(const struct s__index_tree *tree, const char *key)
+{
+	return size(tree, length(tree, key)) * (tree->coded ? 2 : 1);
+}
+
+static uint64_t
+prefix_size(uint64_t n)
+{
+	return S__DUP(sizeof (struct prefix) + n + 1, ALIGN) * ALIGN;
+}
+
+/**
+ * Returns the sign of the comparison of key with the key of node, as
+ * strcmp(). The prefix of a coded node is compared first, stopping at the
+ * end of key.
+ */
+
+static int
+compare(const struct s__index_tree *tree,
+	const char *key,
+	const struct node *node)
+{
+	const unsigned char *a, *b;
+	const struct code *code;
+	uint64_t i, x, y;
+
+	if (tree->fixed) {
+		x = get_u64(key);
+		y = get_u64(get_key(tree, node));
+		return (x > y) - (x < y);
+	}
+	i = 0;
+	if (tree->coded && (code = get_code(node))->len) {
+		a = (const unsigned char *)key;
+		b = (const unsigned char *)get_prefix(code);
+		for (; i<code->len; ++i) {
+			if (a[i] != b[i]) {
+				return (int)a[i] - (int)b[i];
+			}
+			if (!a[i]) {
+				return -1;
+			}
+		}
+	}
+	return strcmp(key + i, get_key(tree, node));
+}
+
+static char *
+copy_key(const struct s__index_tree *tree, const struct node *node, char *okey)
+{
+	const struct code *code;
+	const char *p;
+	uint64_t i, j;
+
+	if (tree->fixed) {
+		s__index_tree_encode_u64(get_u64(get_key(tree, node)), okey);
+		return okey;
+	}
+	if (!tree->coded) {
+		p = get_key(tree, node);
+		memcpy(okey, p, s__strlen(p) + 1);
+		return okey;
+	}
+	i = 0;
+	code = get_code(node);
+	if (code->len) {
+		p = get_prefix(code);
+		for (; (i<code->len) && p[i]; ++i) {
+			okey[i] = p[i];
+		}
+	}
+	p = get_key(tree, node);
+	for (j=0; p[j] && (i<(S__INDEX_TREE_MAX_KEY_LEN - 1)); ++i, ++j) {
+		okey[i] = p[j];
+	}
+	okey[i] = '\0';
+	return okey;
+}
+
+static uint64_t
+common(const struct s__index_tree *tree,
+       const char *key,
+       const struct node *node)
+{
+	const struct code *code;
+	const char *p;
+	uint64_t i;
+
+	i = 0;
+	code = get_code(node);
+	if (code->len) {
+		p = get_prefix(code);
+		while ((i < code->len) && key[i] && (key[i] == p[i])) {
+			++i;
+		}
+		if (i < code->len) {
+			return i;
+		}
+	}
+	p = get_key(tree, node) - i;
+	while (key[i] && (key[i] == p[i])) {
+		++i;
+	}
+	return i;
+}
+
+static struct prefix *
+share(struct s__index_tree *tree,
+      const char *key,
+      const struct node *neighbor,
+      uint64_t *len)
+{
+	struct prefix *prefix;
+	struct code *code;
+	uint64_t n;
+
+	if (!neighbor) {
+		return NULL;
+	}
+	n = common(tree, key, neighbor);
+	code = get_code(neighbor);
+	if (code->len &&
+	    (SHARE <= S__MIN(n, code->len)) &&
+	    ((code->len + LONGER) > n)) {
+		code->prefix->refs += 1;
+		(*len) = S__MIN(n, code->len);
+		return code->prefix;
+	}
+	if (SHARE > n) {
+		return NULL;
+	}
+	prefix = take(tree, prefix_size(n), 1);
+	prefix->refs = 1;
+	memcpy(prefix + 1, key, (size_t)n);
+	((char *)(prefix + 1))[n] = '\0';
+	(*len) = n;
+	return prefix;
+}
+
+static struct node *
+alloc(struct s__index_tree *tree, const char *key, const struct node *neighbor)
+{
+	struct prefix *prefix;
+	struct node *node;
+	struct code *code;
+	uint64_t len;
+
+	len = 0;
+	prefix = tree->coded ? share(tree, key, neighbor, &len) : NULL;
+	node = take(tree, size(tree, length(tree, key) - len), 0);
+	memset(node, 0, tree->record_size + sizeof (struct node));
+	node = (struct node *)((char *)node + tree->record_size);
+	if (tree->coded) {
+		code = get_code(node);
+		code->len = (uint32_t)len;
+		code->prefix = prefix;
+	}
+	memcpy((char *)get_key(tree, node),
+	       key + len,
+	       length(tree, key) - len);
+	((char *)get_key(tree, node))[length(tree, key) - len] = '\0';
+	return node;
+}
+
+static void
+release(struct s__index_tree *tree, struct node *node)
+{
+	struct code *code;
+
+	if (tree->coded && (code = get_code(node))->len) {
+		if (!--code->prefix->refs) {
+			give(tree,
+			     code->prefix,
+			     prefix_size(s__strlen(get_prefix(code))),
+			     1);
+		}
+	}
+	give(tree,
+	     get_record(tree, node),
+	     size(tree, length(tree, get_key(tree, node))),
+	     0);
+}
+
 static int
 delta(const struct node *node)
 {
@@ -72,6 +484,12 @@ depth(const struct node *a, const struct node *b)
 	return (delta(a) > delta(b)) ? (delta(a) + 1) : (delta(b) + 1);
 }
 
+/**
+ * Rotations and insertions order their stores with a release fence, such
+ * that a concurrent reader may miss keys while a rotation is in progress,
+ * but never follows a cycle or reaches an uninitialized node.
+ */
+
 static struct node *
 rotate_right(struct node *node)
 {
@@ -79,6 +497,7 @@ rotate_right(struct node *node)
 
 	root = node->left;
 	node->left = root->right;
+	s__fence_release();
 	root->right = node;
 	node->depth = depth(node->left, node->right);
 	root->depth = depth(root->left, node);
@@ -92,6 +511,7 @@ rotate_left(struct node *node)
 
 	root = node->right;
 	node->right = root->left;
+	s__fence_release();
 	root->left = node;
 	node->depth = depth(node->left, node->right);
 	root->depth = depth(root->right, node);
@@ -115,27 +535,26 @@ rotate_right_left(struct node *node)
 static struct node *
 update(struct s__index_tree *tree,
        struct node *root,
+       struct node *parent,
        const char *key,
        uint64_t **record)
 {
 	int d;
 
 	if (!root) {
-		root = get_node(tree, tree->size);
-		memset(root, 0, sizeof (struct node));
-		memcpy(root + 1, key, s__strlen(key) + 1);
-		tree->size += sizeof (struct node) + s__strlen(key) + 1;
+		root = alloc(tree, key, parent);
 		tree->items += 1;
-		(*record) = &root->record;
+		(*record) = get_record(tree, root);
+		s__fence_release();
 		return root;
 	}
-	if (!(d = strcmp(key, get_key(root)))) {
-		(*record) = &root->record;
+	if (!(d = compare(tree, key, root))) {
+		(*record) = get_record(tree, root);
 	}
 	else if (0 > d) {
-		root->left = update(tree, root->left, key, record);
+		root->left = update(tree, root->left, root, key, record);
 		if (1 < abs(balance(root))) {
-			if (0 > strcmp(key, get_key(root->left))) {
+			if (0 > compare(tree, key, root->left)) {
 				root = rotate_right(root);
 			}
 			else {
@@ -144,9 +563,9 @@ update(struct s__index_tree *tree,
 		}
 	}
 	else if (0 < d) {
-		root->right = update(tree, root->right, key, record);
+		root->right = update(tree, root->right, root, key, record);
 		if (1 < abs(balance(root))) {
-			if (0 < strcmp(key, get_key(root->right))) {
+			if (0 < compare(tree, key, root->right)) {
 				root = rotate_left(root);
 			}
 			else {
@@ -158,10 +577,201 @@ update(struct s__index_tree *tree,
 	return root;
 }
 
+static struct node *
+rebalance(struct node *root)
+{
+	root->depth = depth(root->left, root->right);
+	if (1 < balance(root)) {
+		if (0 > balance(root->left)) {
+			root = rotate_left_right(root);
+		}
+		else {
+			root = rotate_right(root);
+		}
+	}
+	else if (-1 > balance(root)) {
+		if (0 < balance(root->right)) {
+			root = rotate_right_left(root);
+		}
+		else {
+			root = rotate_left(root);
+		}
+	}
+	return root;
+}
+
+static struct node *
+remove_min(struct node *root, struct node **min)
+{
+	if (!root->left) {
+		(*min) = root;
+		return root->right;
+	}
+	root->left = remove_min(root->left, min);
+	return rebalance(root);
+}
+
+static struct node *
+remove_(struct s__index_tree *tree,
+	struct node *root,
+	const char *key,
+	struct node **node)
+{
+	struct node *min, *right;
+	int d;
+
+	if (!root) {
+		return NULL;
+	}
+	if (0 > (d = compare(tree, key, root))) {
+		root->left = remove_(tree, root->left, key, node);
+	}
+	else if (0 < d) {
+		root->right = remove_(tree, root->right, key, node);
+	}
+	else {
+		(*node) = root;
+		if (!root->left || !root->right) {
+			return root->left ? root->left : root->right;
+		}
+		right = remove_min(root->right, &min);
+		min->left = root->left;
+		min->right = right;
+		s__fence_release();
+		root = min;
+	}
+	return rebalance(root);
+}
+
+/**
+ * Bulk load: an in-order recursion over the count of keys consumes the
+ * sorted source exactly once, allocating each node as its key arrives.
+ * The left subtree of every node takes the larger half, so sibling
+ * depths differ by at most one and the result is a valid AVL tree, laid
+ * out in key order across the chunks. An adaptive radix tree is loaded
+ * by ordered insertion instead.
+ */
+
+struct load {
+	s__index_tree_source_t fnc;
+	void *ctx;
+	struct node *last;
+	int rewind;
+	int error;
+};
+
+struct array {
+	const char **keys;
+	const uint64_t *records;
+	uint64_t words; /* per record */
+	uint64_t i;
+};
+
+static struct node *
+load(struct s__index_tree *tree, struct load *load_, uint64_t n)
+{
+	uint64_t record[S__INDEX_TREE_MAX_RECORD_SIZE / sizeof (uint64_t)];
+	struct node *node, *left;
+	char buf[sizeof (uint64_t)];
+	const char *key;
+
+	if (!n || load_->error) {
+		return NULL;
+	}
+	left = load(tree, load_, n - 1 - (n - 1) / 2);
+	if (load_->error) {
+		return NULL;
+	}
+	key = NULL;
+	memset(record, 0, (size_t)tree->record_size);
+	if ((1 != load_->fnc(load_->ctx, load_->rewind, &key, record)) ||
+	    !s__strlen(key) ||
+	    (S__INDEX_TREE_MAX_KEY_LEN <= s__strlen(key)) ||
+	    !(key = probe(tree, key, buf)) ||
+	    (load_->last && (0 >= compare(tree, key, load_->last)))) {
+		load_->error = 1;
+		S__TRACE(S__ERR_ARGUMENT);
+		return NULL;
+	}
+	if (check(tree, reserve(tree, key))) {
+		load_->error = 1;
+		S__TRACE(0);
+		return NULL;
+	}
+	node = alloc(tree, key, load_->last);
+	memcpy(get_record(tree, node), record, (size_t)tree->record_size);
+	node->left = left;
+	load_->last = node;
+	load_->rewind = 0;
+	node->right = load(tree, load_, (n - 1) / 2);
+	node->depth = depth(node->left, node->right);
+	return node;
+}
+
+static int
+load_art(struct s__index_tree *tree,
+	 uint64_t n,
+	 s__index_tree_source_t fnc,
+	 void *ctx)
+{
+	uint64_t record[S__INDEX_TREE_MAX_RECORD_SIZE / sizeof (uint64_t)];
+	uint64_t i, *record_;
+	const char *key;
+	char *last;
+
+	if (!(last = s__malloc(S__INDEX_TREE_MAX_KEY_LEN))) {
+		S__TRACE(0);
+		return -1;
+	}
+	last[0] = '\0';
+	for (i=0; i<n; ++i) {
+		key = NULL;
+		memset(record, 0, (size_t)tree->record_size);
+		if ((1 != fnc(ctx, !i, &key, record)) ||
+		    !s__strlen(key) ||
+		    (S__INDEX_TREE_MAX_KEY_LEN <= s__strlen(key)) ||
+		    (0 <= strcmp(last, key))) {
+			S__FREE(last);
+			S__TRACE(S__ERR_ARGUMENT);
+			return -1;
+		}
+		if (!(record_ = s__index_art_update(tree->art, key))) {
+			S__FREE(last);
+			S__TRACE(0);
+			return -1;
+		}
+		memcpy(record_, record, (size_t)tree->record_size);
+		memcpy(last, key, s__strlen(key) + 1);
+	}
+	S__FREE(last);
+	return 0;
+}
+
+static int
+_array_(void *ctx, int rewind, const char **key, uint64_t *record)
+{
+	struct array *array;
+
+	array = (struct array *)ctx;
+	if (rewind) {
+		array->i = 0;
+	}
+	(*key) = array->keys[array->i];
+	if (array->records) {
+		memcpy(record,
+		       array->records + array->i * array->words,
+		       (size_t)array->words * sizeof (uint64_t));
+	}
+	array->i += 1;
+	return 1;
+}
+
 static struct node *
 min(struct node *root)
 {
-	while (root->left) {
+	int i;
+
+	for (i=0; root->left && (DEPTH > i); ++i) {
 		root = root->left;
 	}
 	return root;
@@ -170,21 +780,23 @@ min(struct node *root)
 static struct node *
 max(struct node *root)
 {
-	while (root->right) {
+	int i;
+
+	for (i=0; root->right && (DEPTH > i); ++i) {
 		root = root->right;
 	}
 	return root;
 }
 
 static struct node *
-next(struct node *root, const char *key)
+next(const struct s__index_tree *tree, struct node *root, const char *key)
 {
 	struct node *node;
-	int d;
+	int i, d;
 
 	node = NULL;
-	while (root) {
-		if (!(d = strcmp(key, get_key(root)))) {
+	for (i=0; root && (DEPTH > i); ++i) {
+		if (!(d = compare(tree, key, root))) {
 			if (root->right) {
 				return min(root->right);
 			}
@@ -202,14 +814,14 @@ next(struct node *root, const char *key)
 }
 
 static struct node *
-prev(struct node *root, const void *key)
+prev(const struct s__index_tree *tree, struct node *root, const char *key)
 {
 	struct node *node;
-	int d;
+	int i, d;
 
 	node = NULL;
-	while (root) {
-		if (!(d = strcmp(key, get_key(root)))) {
+	for (i=0; root && (DEPTH > i); ++i) {
+		if (!(d = compare(tree, key, root))) {
 			if (root->left) {
 				return max(root->left);
 			}
@@ -226,25 +838,54 @@ prev(struct node *root, const void *key)
 	return node;
 }
 
+static void
+stats(const struct node *root,
+      uint64_t depth,
+      struct s__index_tree_stats *stats_)
+{
+	while (root) {
+		stats_->nodes += 1;
+		stats_->keys += 1;
+		stats_->depths += depth;
+		stats_->max_depth = S__MAX(stats_->max_depth, depth);
+		stats(root->left, depth + 1, stats_);
+		root = root->right;
+		++depth;
+	}
+}
+
 int
 s__index_tree_iterate(s__index_tree_t tree, s__index_tree_fnc_t fnc, void *ctx)
 {
-	struct node *node;
 	s__index_queue_t queue;
+	struct node *node;
+	char *key;
 
 	assert( tree );
 	assert( fnc );
 
+	if (tree->art) {
+		return s__index_art_iterate(tree->art, fnc, ctx);
+	}
 	if (tree->root) {
-		if (!(queue = s__index_queue_open(tree->items))) {
+		key = NULL;
+		if (((tree->coded || tree->fixed) &&
+		     !(key = s__malloc(S__INDEX_TREE_MAX_KEY_LEN))) ||
+		    !(queue = s__index_queue_open(tree->items))) {
+			S__FREE(key);
 			S__TRACE(0);
 			return -1;
 		}
 		s__index_queue_push(queue, tree->root);
 		while (!s__index_queue_empty(queue)) {
 			node = s__index_queue_pop(queue);
-			if (fnc(ctx, get_key(node), node->record)) {
+			if (fnc(ctx,
+				key ?
+				copy_key(tree, node, key) :
+				get_key(tree, node),
+				get_record(tree, node))) {
 				s__index_queue_close(queue);
+				S__FREE(key);
 				S__TRACE(0);
 				return -1;
 			}
@@ -256,33 +897,266 @@ s__index_tree_iterate(s__index_tree_t tree, s__index_tree_fnc_t fnc, void *ctx)
 			}
 		}
 		s__index_queue_close(queue);
+		S__FREE(key);
 	}
 	return 0;
 }
 
-s__index_tree_t
-s__index_tree_open(void)
+int
+s__index_tree_iterate_sorted(s__index_tree_t tree,
+			     s__index_tree_fnc_t fnc,
+			     void *ctx)
 {
-	struct s__index_tree *tree;
+	s__index_tree_cursor_t cursor;
+	uint64_t *record;
 
-	if (!(tree = s__malloc(sizeof (struct s__index_tree)))) {
+	assert( tree );
+	assert( fnc );
+
+	if (tree->art) {
+		return s__index_art_iterate(tree->art, fnc, ctx);
+	}
+	if (!(cursor = s__index_tree_cursor_open(tree))) {
 		S__TRACE(0);
-		return NULL;
+		return -1;
 	}
-	memset(tree, 0, sizeof (struct s__index_tree));
+	record = s__index_tree_cursor_seek(cursor, NULL);
+	while (record) {
+		if (fnc(ctx, s__index_tree_cursor_key(cursor), record)) {
+			s__index_tree_cursor_close(cursor);
+			S__TRACE(0);
+			return -1;
+		}
+		record = s__index_tree_cursor_next(cursor);
+	}
+	s__index_tree_cursor_close(cursor);
+	return 0;
+}
+
+static void
+tops(const struct node *root, int level, const struct node **nodes, int *n)
+{
+	if (root && level) {
+		tops(root->left, level - 1, nodes, n);
+		nodes[(*n)++] = root;
+		tops(root->right, level - 1, nodes, n);
+	}
+}
+
+static void
+_scan_(void *ctx)
+{
+	s__index_tree_cursor_t cursor;
+	const struct node *node;
+	struct scan *scan;
+	uint64_t *record, *hi;
+	char *key;
+
+	scan = (struct scan *)ctx;
+	key = NULL;
+	if (!(cursor = s__index_tree_cursor_open(scan->tree)) ||
+	    ((scan->tree->coded || scan->tree->fixed) &&
+	     !(key = s__malloc(S__INDEX_TREE_MAX_KEY_LEN)))) {
+		s__index_tree_cursor_close(cursor);
+		(*scan->error) = -1;
+		S__TRACE(0);
+		return;
+	}
+	if ((node = scan->lo)) {
+		record = s__index_tree_cursor_seek(cursor,
+						   key ?
+						   copy_key(scan->tree,
+							    node,
+							    key) :
+						   get_key(scan->tree, node));
+	}
+	else {
+		record = s__index_tree_cursor_seek(cursor, NULL);
+	}
+	hi = scan->hi ? get_record(scan->tree, scan->hi) : NULL;
+	while (record && (record != hi) && !(*scan->error)) {
+		if (scan->fnc(scan->ctx,
+			      s__index_tree_cursor_key(cursor),
+			      record)) {
+			(*scan->error) = -1;
+			S__TRACE(0);
+			break;
+		}
+		record = s__index_tree_cursor_next(cursor);
+	}
+	s__index_tree_cursor_close(cursor);
+	S__FREE(key);
+}
+
+int
+s__index_tree_iterate_parallel(s__index_tree_t tree,
+			       int threads,
+			       s__index_tree_fnc_t fnc,
+			       void **ctxs)
+{
+	s__thread_t threads_[S__INDEX_TREE_MAX_SCANNERS];
+	struct scan scans[S__INDEX_TREE_MAX_SCANNERS];
+	const struct node **nodes;
+	volatile int error;
+	int k, n, level;
+
+	assert( tree );
+	assert( (0 < threads) && (S__INDEX_TREE_MAX_SCANNERS >= threads) );
+	assert( fnc );
+	assert( ctxs );
+
+	if (tree->art || (1 == threads) || !tree->root) {
+		return s__index_tree_iterate_sorted(tree, fnc, ctxs[0]);
+	}
+	for (level=1; ((1 << level) - 1) < (threads * SPLITS); ++level);
+	if (!(nodes = s__malloc(((1 << level) - 1) * sizeof (nodes[0])))) {
+		S__TRACE(0);
+		return -1;
+	}
+	n = 0;
+	tops(tree->root, level, nodes, &n);
+	threads = S__MIN(threads, n + 1);
+	memset(threads_, 0, sizeof (threads_));
+	memset(scans, 0, sizeof (scans));
+	error = 0;
+	for (k=0; k<threads; ++k) {
+		scans[k].tree = tree;
+		scans[k].fnc = fnc;
+		scans[k].ctx = ctxs[k];
+		scans[k].lo = k ? nodes[n * k / threads] : NULL;
+		scans[k].hi = ((k + 1) < threads) ?
+			nodes[n * (k + 1) / threads] :
+			NULL;
+		scans[k].error = &error;
+	}
+	for (k=1; k<threads; ++k) {
+		if (!(threads_[k] = s__thread_open(_scan_, &scans[k]))) {
+			_scan_(&scans[k]);
+		}
+	}
+	_scan_(&scans[0]);
+	for (k=1; k<threads; ++k) {
+		s__thread_close(threads_[k]);
+	}
+	S__FREE(nodes);
+	if (error) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+s__index_tree_t
+s__index_tree_open(uint64_t record_size)
+{
+	struct s__index_tree *tree;
+
+	assert( record_size && !(record_size % sizeof (uint64_t)) );
+	assert( S__INDEX_TREE_MAX_RECORD_SIZE >= record_size );
+
+	if (!(tree = s__malloc(sizeof (struct s__index_tree)))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memset(tree, 0, sizeof (struct s__index_tree));
+	tree->record_size = record_size;
+	return tree;
+}
+
+s__index_tree_t
+s__index_tree_open_art(uint64_t record_size)
+{
+	struct s__index_tree *tree;
+
+	if (!(tree = s__index_tree_open(record_size)) ||
+	    !(tree->art = s__index_art_open(record_size))) {
+		s__index_tree_close(tree);
+		S__TRACE(0);
+		return NULL;
+	}
+	return tree;
+}
+
+s__index_tree_t
+s__index_tree_open_coded(uint64_t record_size)
+{
+	struct s__index_tree *tree;
+
+	if (!(tree = s__index_tree_open(record_size))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	tree->coded = 1;
+	return tree;
+}
+
+s__index_tree_t
+s__index_tree_open_u64(uint64_t record_size)
+{
+	struct s__index_tree *tree;
+
+	if (!(tree = s__index_tree_open(record_size))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	tree->fixed = 1;
 	return tree;
 }
 
+void
+s__index_tree_encode_u64(uint64_t key, char *okey)
+{
+	int i;
+
+	assert( okey );
+
+	for (i=0; i<S__INDEX_TREE_U64_LEN; ++i) {
+		okey[i] = (char)(0x80 | ((key >> (7 * (S__INDEX_TREE_U64_LEN -
+							1 -
+							i))) & 0x7f));
+	}
+	okey[S__INDEX_TREE_U64_LEN] = '\0';
+}
+
+int
+s__index_tree_decode_u64(const char *key, uint64_t *okey)
+{
+	const unsigned char *p;
+	uint64_t key_;
+	int i;
+
+	assert( okey );
+
+	p = (const unsigned char *)key;
+	if (!p || (0x81 < p[0])) {
+		return -1;
+	}
+	key_ = 0;
+	for (i=0; i<S__INDEX_TREE_U64_LEN; ++i) {
+		if (!(0x80 & p[i])) {
+			return -1;
+		}
+		key_ = (key_ << 7) | (p[i] & 0x7f);
+	}
+	if (p[i]) {
+		return -1;
+	}
+	(*okey) = key_;
+	return 0;
+}
+
 void
 s__index_tree_close(s__index_tree_t tree)
 {
 	void *chunk;
 
 	if (tree) {
+		s__index_art_close(tree->art);
 		while ((chunk = tree->chunk)) {
 			tree->chunk = (*((void **)chunk));
 			S__FREE(chunk);
 		}
+		S__FREE(tree->free);
 		memset(tree, 0, sizeof (struct s__index_tree));
 	}
 	S__FREE(tree);
@@ -291,75 +1165,268 @@ s__index_tree_close(s__index_tree_t tree)
 void
 s__index_tree_truncate(s__index_tree_t tree)
 {
+	uint64_t record_size;
+	s__index_art_t art;
 	void *chunk;
+	int coded, fixed;
 
 	if (tree) {
+		art = tree->art;
+		record_size = tree->record_size;
+		coded = tree->coded;
+		fixed = tree->fixed;
+		s__index_art_truncate(art);
 		while ((chunk = tree->chunk)) {
 			tree->chunk = (*((void **)chunk));
 			S__FREE(chunk);
 		}
+		S__FREE(tree->free);
 		memset(tree, 0, sizeof (struct s__index_tree));
+		tree->art = art;
+		tree->record_size = record_size;
+		tree->coded = coded;
+		tree->fixed = fixed;
 	}
 }
 
 uint64_t *
 s__index_tree_update(s__index_tree_t tree, const char *key)
 {
+	char buf[sizeof (uint64_t)];
 	uint64_t *record;
 
 	assert( tree );
 	assert( s__strlen(key) );
 	assert( S__INDEX_TREE_MAX_KEY_LEN > s__strlen(key) );
 
-	if (check(tree, sizeof (struct node) + s__strlen(key) + 1)) {
+	if (tree->art) {
+		return s__index_art_update(tree->art, key);
+	}
+	if (!(key = probe(tree, key, buf))) {
+		S__TRACE(S__ERR_ARGUMENT);
+		return NULL;
+	}
+	if (check(tree, reserve(tree, key))) {
 		S__TRACE(0);
 		return NULL;
 	}
-	tree->root = update(tree, tree->root, key, &record);
+	tree->root = update(tree, tree->root, NULL, key, &record);
 	return record;
 }
 
+int
+s__index_tree_bulk_load(s__index_tree_t tree,
+			const char **keys,
+			const uint64_t *records,
+			uint64_t n)
+{
+	struct array array;
+
+	assert( tree );
+	assert( !s__index_tree_items(tree) );
+	assert( !n || keys );
+
+	memset(&array, 0, sizeof (struct array));
+	array.keys = keys;
+	array.records = records;
+	array.words = tree->record_size / sizeof (uint64_t);
+	if (s__index_tree_bulk_stream(tree, n, _array_, &array)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+int
+s__index_tree_bulk_stream(s__index_tree_t tree,
+			  uint64_t n,
+			  s__index_tree_source_t fnc,
+			  void *ctx)
+{
+	struct load load_;
+	void *root;
+
+	assert( tree );
+	assert( !s__index_tree_items(tree) );
+	assert( fnc );
+
+	if (tree->art) {
+		s__index_tree_truncate(tree);
+		if (load_art(tree, n, fnc, ctx)) {
+			s__index_tree_truncate(tree);
+			S__TRACE(0);
+			return -1;
+		}
+		return 0;
+	}
+	memset(&load_, 0, sizeof (struct load));
+	load_.fnc = fnc;
+	load_.ctx = ctx;
+	load_.rewind = 1;
+	s__index_tree_truncate(tree);
+	root = NULL;
+	if (n) {
+		if (!(root = load(tree, &load_, n))) {
+			s__index_tree_truncate(tree);
+			S__TRACE(0);
+			return -1;
+		}
+	}
+	tree->items = n;
+	s__fence_release();
+	tree->root = root;
+	return 0;
+}
+
+int
+s__index_tree_remove(s__index_tree_t tree, const char *key)
+{
+	char buf[sizeof (uint64_t)];
+	struct node *node;
+	uint64_t n;
+
+	assert( tree );
+	assert( s__strlen(key) );
+
+	if (tree->art) {
+		return s__index_art_remove(tree->art, key);
+	}
+	if (!(key = probe(tree, key, buf))) {
+		return 0;
+	}
+	if (!tree->free) {
+		n = 2 * (CLASSES + 1) * sizeof (tree->free[0]);
+		if (!(tree->free = s__malloc(n))) {
+			S__TRACE(0);
+			return -1;
+		}
+		memset(tree->free, 0, n);
+	}
+	node = NULL;
+	tree->root = remove_(tree, tree->root, key, &node);
+	if (!node) {
+		return 0;
+	}
+	tree->items -= 1;
+	release(tree, node);
+	return 1;
+}
+
 uint64_t *
 s__index_tree_find(s__index_tree_t tree, const char *key)
 {
+	char buf[sizeof (uint64_t)];
 	struct node *node;
-	int d;
+	int i, d;
 
 	assert( tree );
 	assert( s__strlen(key) );
 
+	if (tree->art) {
+		return s__index_art_find(tree->art, key);
+	}
+	if (!(key = probe(tree, key, buf))) {
+		return NULL;
+	}
 	node = tree->root;
-	while (node) {
-		if (!(d = strcmp(key, get_key(node)))) {
-			return &node->record;
+	for (i=0; node && (DEPTH > i); ++i) {
+		if (!(d = compare(tree, key, node))) {
+			return get_record(tree, node);
 		}
 		node = (0 > d) ? node->left : node->right;
 	}
 	return NULL;
 }
 
+void
+s__index_tree_find_batch(s__index_tree_t tree,
+			 const char **keys,
+			 uint64_t n,
+			 uint64_t **records)
+{
+	char bufs[BATCH][sizeof (uint64_t)];
+	const char *probes[BATCH];
+	struct node *nodes[BATCH];
+	uint64_t i, j, m, active;
+	int k, d;
+
+	assert( tree );
+	assert( !n || (keys && records) );
+
+	if (tree->art) {
+		s__index_art_find_batch(tree->art, keys, n, records);
+		return;
+	}
+	for (i=0; i<n; i+=m) {
+		m = S__MIN(BATCH, n - i);
+		active = 0;
+		for (j=0; j<m; ++j) {
+			records[i + j] = NULL;
+			probes[j] = probe(tree, keys[i + j], bufs[j]);
+			nodes[j] = probes[j] ? tree->root : NULL;
+			active += nodes[j] ? 1 : 0;
+		}
+		for (k=0; active && (DEPTH > k); ++k) {
+			for (j=0; j<m; ++j) {
+				if (!nodes[j]) {
+					continue;
+				}
+				d = compare(tree, probes[j], nodes[j]);
+				if (!d) {
+					records[i + j] =
+						get_record(tree, nodes[j]);
+					nodes[j] = NULL;
+				}
+				else {
+					nodes[j] = (0 > d) ?
+						nodes[j]->left :
+						nodes[j]->right;
+				}
+				if (nodes[j]) {
+					s__prefetch(nodes[j]);
+				}
+				else {
+					--active;
+				}
+			}
+		}
+	}
+}
+
 uint64_t *
 s__index_tree_next(s__index_tree_t tree, const char *key, char *okey)
 {
+	char buf[sizeof (uint64_t)];
 	struct node *node;
+	uint64_t x;
+	int d;
 
 	assert( tree );
 	assert( okey );
 
-	if (s__strlen(key)) {
-		if ((node = next(tree->root, key))) {
-			memcpy(okey,
-			       get_key(node),
-			       s__strlen(get_key(node)) + 1);
-			return &node->record;
+	if (tree->art) {
+		return s__index_art_next(tree->art, key, okey);
+	}
+	if (!s__strlen(key)) {
+		key = NULL;
+	}
+	else if (tree->fixed) {
+		if (0 > (d = ceiling(key, &x))) {
+			return NULL;
+		}
+		/* the successor of x - 1 is the first key from x on */
+		key = (d && !x) ? NULL : put_u64(x - (d ? 1 : 0), buf);
+	}
+	if (key) {
+		if ((node = next(tree, tree->root, key))) {
+			copy_key(tree, node, okey);
+			return get_record(tree, node);
 		}
 	}
 	else if (tree->root) {
 		if ((node = min(tree->root))) {
-			memcpy(okey,
-			       get_key(node),
-			       s__strlen(get_key(node)) + 1);
-			return &node->record;
+			copy_key(tree, node, okey);
+			return get_record(tree, node);
 		}
 	}
 	return NULL;
@@ -368,34 +1435,248 @@ s__index_tree_next(s__index_tree_t tree, const char *key, char *okey)
 uint64_t *
 s__index_tree_prev(s__index_tree_t tree, const char *key, char *okey)
 {
+	char buf[sizeof (uint64_t)];
 	struct node *node;
+	uint64_t x;
 
 	assert( tree );
 	assert( okey );
 
-	if (s__strlen(key)) {
-		if ((node = prev(tree->root, key))) {
-			memcpy(okey,
-			       get_key(node),
-			       s__strlen(get_key(node)) + 1);
-			return &node->record;
+	if (tree->art) {
+		return s__index_art_prev(tree->art, key, okey);
+	}
+	if (!s__strlen(key)) {
+		key = NULL;
+	}
+	else if (tree->fixed) {
+		key = (0 > ceiling(key, &x)) ? NULL : put_u64(x, buf);
+	}
+	if (key) {
+		if ((node = prev(tree, tree->root, key))) {
+			copy_key(tree, node, okey);
+			return get_record(tree, node);
 		}
 	}
 	else if (tree->root) {
 		if ((node = max(tree->root))) {
-			memcpy(okey,
-			       get_key(node),
-			       s__strlen(get_key(node)) + 1);
-			return &node->record;
+			copy_key(tree, node, okey);
+			return get_record(tree, node);
 		}
 	}
 	return NULL;
 }
 
+void
+s__index_tree_stats(s__index_tree_t tree, struct s__index_tree_stats *stats_)
+{
+	struct s__index_art_stats art;
+	void *chunk;
+
+	assert( tree );
+	assert( stats_ );
+
+	memset(stats_, 0, sizeof (struct s__index_tree_stats));
+	if (tree->art) {
+		s__index_art_stats(tree->art, &art);
+		stats_->used = art.used;
+		stats_->allocated = art.allocated;
+		stats_->nodes = art.nodes;
+		stats_->keys = art.keys;
+		stats_->depths = art.depths;
+		stats_->max_depth = art.max_depth;
+		return;
+	}
+	for (chunk=tree->chunk; chunk; chunk=(*((void **)chunk))) {
+		stats_->allocated += CHUNK_SIZE;
+	}
+	if (tree->free) {
+		stats_->allocated += 2 * (CLASSES + 1) * sizeof (tree->free[0]);
+	}
+	stats_->used = tree->used;
+	stats(tree->root, 1, stats_);
+}
+
+uint64_t
+s__index_tree_record_size(s__index_tree_t tree)
+{
+	assert( tree );
+
+	return tree->record_size;
+}
+
 uint64_t
 s__index_tree_items(s__index_tree_t tree)
 {
 	assert( tree );
 
+	if (tree->art) {
+		return s__index_art_items(tree->art);
+	}
 	return tree->items;
 }
+
+s__index_tree_cursor_t
+s__index_tree_cursor_open(s__index_tree_t tree)
+{
+	struct s__index_tree_cursor *cursor;
+
+	assert( tree );
+
+	if (!(cursor = s__malloc(sizeof (struct s__index_tree_cursor)))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memset(cursor, 0, sizeof (struct s__index_tree_cursor));
+	cursor->tree = tree;
+	if ((tree->art &&
+	     !(cursor->art = s__index_art_cursor_open(tree->art))) ||
+	    ((tree->coded || tree->fixed) &&
+	     !(cursor->key = s__malloc(S__INDEX_TREE_MAX_KEY_LEN)))) {
+		s__index_tree_cursor_close(cursor);
+		S__TRACE(0);
+		return NULL;
+	}
+	return cursor;
+}
+
+void
+s__index_tree_cursor_close(s__index_tree_cursor_t cursor)
+{
+	if (cursor) {
+		s__index_art_cursor_close(cursor->art);
+		S__FREE(cursor->key);
+		memset(cursor, 0, sizeof (struct s__index_tree_cursor));
+	}
+	S__FREE(cursor);
+}
+
+uint64_t *
+s__index_tree_cursor_seek(s__index_tree_cursor_t cursor, const char *key)
+{
+	char buf[sizeof (uint64_t)];
+	struct node *node;
+	uint64_t x;
+	int d;
+
+	assert( cursor );
+
+	if (cursor->art) {
+		return s__index_art_cursor_seek(cursor->art, key);
+	}
+	d = 0;
+	cursor->depth = 0;
+	if (!s__strlen(key)) {
+		key = NULL;
+	}
+	else if (cursor->tree->fixed) {
+		if (0 > ceiling(key, &x)) {
+			return NULL;
+		}
+		key = put_u64(x, buf);
+	}
+	node = cursor->tree->root;
+	while (node) {
+		cursor->path[cursor->depth++] = node;
+		if (!key) {
+			node = node->left;
+			d = -1;
+		}
+		else if (!(d = compare(cursor->tree, key, node))) {
+			return get_record(cursor->tree, node);
+		}
+		else {
+			node = (0 > d) ? node->left : node->right;
+		}
+	}
+	if (!cursor->depth) {
+		return NULL;
+	}
+	if (0 > d) {
+		return get_record(cursor->tree,
+				  cursor->path[cursor->depth - 1]);
+	}
+	return s__index_tree_cursor_next(cursor);
+}
+
+uint64_t *
+s__index_tree_cursor_next(s__index_tree_cursor_t cursor)
+{
+	struct node *node;
+
+	assert( cursor );
+
+	if (cursor->art) {
+		return s__index_art_cursor_next(cursor->art);
+	}
+	if (!cursor->depth) {
+		return NULL;
+	}
+	node = cursor->path[cursor->depth - 1];
+	if (node->right) {
+		node = node->right;
+		while (node) {
+			cursor->path[cursor->depth++] = node;
+			node = node->left;
+		}
+		return get_record(cursor->tree,
+				  cursor->path[cursor->depth - 1]);
+	}
+	while (--cursor->depth) {
+		if (node == cursor->path[cursor->depth - 1]->left) {
+			return get_record(cursor->tree,
+					  cursor->path[cursor->depth - 1]);
+		}
+		node = cursor->path[cursor->depth - 1];
+	}
+	return NULL;
+}
+
+uint64_t *
+s__index_tree_cursor_prev(s__index_tree_cursor_t cursor)
+{
+	struct node *node;
+
+	assert( cursor );
+
+	if (cursor->art) {
+		return s__index_art_cursor_prev(cursor->art);
+	}
+	if (!cursor->depth) {
+		return NULL;
+	}
+	node = cursor->path[cursor->depth - 1];
+	if (node->left) {
+		node = node->left;
+		while (node) {
+			cursor->path[cursor->depth++] = node;
+			node = node->right;
+		}
+		return get_record(cursor->tree,
+				  cursor->path[cursor->depth - 1]);
+	}
+	while (--cursor->depth) {
+		if (node == cursor->path[cursor->depth - 1]->right) {
+			return get_record(cursor->tree,
+					  cursor->path[cursor->depth - 1]);
+		}
+		node = cursor->path[cursor->depth - 1];
+	}
+	return NULL;
+}
+
+const char *
+s__index_tree_cursor_key(s__index_tree_cursor_t cursor)
+{
+	assert( cursor );
+	assert( cursor->art || cursor->depth );
+
+	if (cursor->art) {
+		return s__index_art_cursor_key(cursor->art);
+	}
+	if (cursor->key) {
+		return copy_key(cursor->tree,
+				cursor->path[cursor->depth - 1],
+				cursor->key);
+	}
+	return get_key(cursor->tree, cursor->path[cursor->depth - 1]);
+}
@@ -11,17 +11,58 @@
 
 #define S__INDEX_TREE_MAX_KEY_LEN 32767 /* including '\0' */
 
+#define S__INDEX_TREE_MAX_RECORD_SIZE 256 /* bytes */
+
+#define S__INDEX_TREE_MAX_SCANNERS 64 /* threads of a parallel iteration */
+
+#define S__INDEX_TREE_U64_LEN 10 /* bytes of an integer key, excluding '\0' */
+
 typedef struct s__index_tree *s__index_tree_t;
 
+typedef struct s__index_tree_cursor *s__index_tree_cursor_t;
+
+struct s__index_tree_stats {
+	uint64_t used; /* bytes */
+	uint64_t allocated; /* bytes */
+	uint64_t nodes;
+	uint64_t keys;
+	uint64_t depths; /* sum of key depths, in nodes */
+	uint64_t max_depth;
+};
+
 typedef int (*s__index_tree_fnc_t)(void *ctx,
 				   const char *key,
-				   uint64_t record);
+				   const uint64_t *record);
+
+typedef int (*s__index_tree_source_t)(void *ctx,
+				      int rewind,
+				      const char **key,
+				      uint64_t *record);
 
 int s__index_tree_iterate(s__index_tree_t tree,
 			  s__index_tree_fnc_t fnc,
 			  void *ctx);
 
-s__index_tree_t s__index_tree_open(void);
+int s__index_tree_iterate_sorted(s__index_tree_t tree,
+				 s__index_tree_fnc_t fnc,
+				 void *ctx);
+
+int s__index_tree_iterate_parallel(s__index_tree_t tree,
+				   int threads,
+				   s__index_tree_fnc_t fnc,
+				   void **ctxs);
+
+s__index_tree_t s__index_tree_open(uint64_t record_size);
+
+s__index_tree_t s__index_tree_open_art(uint64_t record_size);
+
+s__index_tree_t s__index_tree_open_coded(uint64_t record_size);
+
+s__index_tree_t s__index_tree_open_u64(uint64_t record_size);
+
+void s__index_tree_encode_u64(uint64_t key, char *okey);
+
+int s__index_tree_decode_u64(const char *key, uint64_t *okey);
 
 void s__index_tree_close(s__index_tree_t tree);
 
@@ -29,8 +70,25 @@ void s__index_tree_truncate(s__index_tree_t tree);
 
 uint64_t *s__index_tree_update(s__index_tree_t tree, const char *key);
 
+int s__index_tree_bulk_load(s__index_tree_t tree,
+			    const char **keys,
+			    const uint64_t *records,
+			    uint64_t n);
+
+int s__index_tree_bulk_stream(s__index_tree_t tree,
+			      uint64_t n,
+			      s__index_tree_source_t fnc,
+			      void *ctx);
+
+int s__index_tree_remove(s__index_tree_t tree, const char *key);
+
 uint64_t *s__index_tree_find(s__index_tree_t tree, const char *key);
 
+void s__index_tree_find_batch(s__index_tree_t tree,
+			      const char **keys,
+			      uint64_t n,
+			      uint64_t **records);
+
 uint64_t *s__index_tree_next(s__index_tree_t tree,
 			     const char *key,
 			     char *okey);
@@ -39,6 +97,24 @@ uint64_t *s__index_tree_prev(s__index_tree_t tree,
 			     const char *key,
 			     char *okey);
 
+void s__index_tree_stats(s__index_tree_t tree,
+			 struct s__index_tree_stats *stats);
+
+uint64_t s__index_tree_record_size(s__index_tree_t tree);
+
 uint64_t s__index_tree_items(s__index_tree_t tree);
 
+s__index_tree_cursor_t s__index_tree_cursor_open(s__index_tree_t tree);
+
+void s__index_tree_cursor_close(s__index_tree_cursor_t cursor);
+
+uint64_t *s__index_tree_cursor_seek(s__index_tree_cursor_t cursor,
+				    const char *key);
+
+uint64_t *s__index_tree_cursor_next(s__index_tree_cursor_t cursor);
+
+uint64_t *s__index_tree_cursor_prev(s__index_tree_cursor_t cursor);
+
+const char *s__index_tree_cursor_key(s__index_tree_cursor_t cursor);
+
 #endif /* _S_INDEX_TREE_H_ */
@@ -0,0 +1,551 @@
+/**
+ * Copyright (c) Tony Givargis, 2020-2025
+ *
+ * s_index_wal.c
+ */
+
+#include "s_index_wal.h"
+
+#define MAGIC "STINGWAL"
+#define WORD 8
+#define FLUSH 1048576 /* buffered bytes flushed by a log without a thread */
+#define WORKERS 64 /* maximum replay threads */
+
+/**
+ * Log: appended entries collect in memory and reach the file as a batch,
+ * a header followed by the entries, once per group commit. An entry is a
+ * word holding its operation and key size, then the record, then the key
+ * and its terminator, padded to a whole word, so every entry and record is
+ * word aligned in a mapped log. A background thread sleeps until an entry
+ * is appended to an empty buffer, lets further entries gather for
+ * interval microseconds, and commits, one write and one fsync covering
+ * every entry appended since the last commit. The buffer is doubled, so
+ * appends proceed while a batch is written.
+ *
+ * Replay: the log is mapped, and its batch headers are walked up to the
+ * first malformed one, as a crash in the middle of a write leaves behind.
+ * Workers then verify the checksums and the entries of disjoint runs of
+ * batches in parallel, and the entries of every batch before the first
+ * that fails are applied, in log order.
+ */
+
+struct batch {
+	char magic[8];
+	uint64_t bytes; /* of the entries that follow */
+	uint64_t count;
+	uint64_t record_size;
+	uint64_t checksum; /* of the entries */
+};
+
+struct buffer {
+	char *memory;
+	uint64_t len;
+	uint64_t capacity;
+	uint64_t count;
+};
+
+struct s__index_wal {
+	FILE *file;
+	char *pathname;
+	uint64_t record_size;
+	uint64_t interval;
+	s__thread_t thread;
+	s__mutex_t flushing; /* one batch written at a time */
+	/*-*/
+	s__mutex_t mutex;
+	s__cond_t cond; /* signaled at each commit */
+	s__cond_t wake; /* signaled by the first entry of a batch */
+	struct buffer buffers[2];
+	int active;
+	uint64_t appended; /* entries */
+	uint64_t durable; /* entries */
+	uint64_t bytes; /* in the file */
+	int error;
+	int stop;
+};
+
+struct job {
+	const char *map;
+	const uint64_t *offsets;
+	uint64_t record_size;
+	uint64_t lo;
+	uint64_t hi;
+	uint64_t bad; /* first batch that fails, or hi */
+};
+
+static uint64_t
+entry_size(uint64_t record_size, uint64_t n)
+{
+	return WORD + record_size + S__DUP(n, WORD) * WORD;
+}
+
+static int
+grow(struct buffer *buffer, uint64_t n)
+{
+	uint64_t capacity;
+	char *memory;
+
+	if ((buffer->len + n) > buffer->capacity) {
+		capacity = S__MAX(2 * buffer->capacity, buffer->len + n);
+		if (!(memory = s__realloc(buffer->memory, capacity))) {
+			S__TRACE(0);
+			return -1;
+		}
+		buffer->memory = memory;
+		buffer->capacity = capacity;
+	}
+	return 0;
+}
+
+static int
+flush(struct s__index_wal *wal)
+{
+	struct buffer *buffer;
+	struct batch batch;
+	uint64_t target;
+	int e;
+
+	s__mutex_lock(wal->flushing);
+	s__mutex_lock(wal->mutex);
+	buffer = &wal->buffers[wal->active];
+	wal->active = !wal->active;
+	target = wal->appended;
+	s__mutex_unlock(wal->mutex);
+	e = 0;
+	if (buffer->count) {
+		memset(&batch, 0, sizeof (struct batch));
+		memcpy(batch.magic, MAGIC, sizeof (batch.magic));
+		batch.bytes = buffer->len;
+		batch.count = buffer->count;
+		batch.record_size = wal->record_size;
+		batch.checksum = s__hash(buffer->memory, buffer->len);
+		if ((1 != fwrite(&batch, sizeof (batch), 1, wal->file)) ||
+		    (1 != fwrite(buffer->memory,
+				 (size_t)buffer->len,
+				 1,
+				 wal->file)) ||
+		    s__file_sync(wal->file)) {
+			S__TRACE(S__ERR_FILE_WRITE);
+			e = -1;
+		}
+	}
+	s__mutex_lock(wal->mutex);
+	if (buffer->count) {
+		wal->bytes += sizeof (struct batch) + buffer->len;
+	}
+	buffer->len = 0;
+	buffer->count = 0;
+	if (e) {
+		wal->error = -1;
+	}
+	else {
+		wal->durable = S__MAX(wal->durable, target);
+	}
+	s__cond_signal(wal->cond);
+	s__mutex_unlock(wal->mutex);
+	s__mutex_unlock(wal->flushing);
+	return e;
+}
+
+static void
+_flusher_(void *ctx)
+{
+	struct s__index_wal *wal;
+	int stop;
+
+	wal = (struct s__index_wal *)ctx;
+	while (1) {
+		s__mutex_lock(wal->mutex);
+		while (!wal->stop && !wal->buffers[wal->active].count) {
+			s__cond_wait(wal->wake);
+		}
+		stop = wal->stop;
+		s__mutex_unlock(wal->mutex);
+		if (stop) {
+			break; /* flushed by s__index_wal_close() */
+		}
+		s__usleep(wal->interval);
+		if (flush(wal)) {
+			S__TRACE(0); /* reported by the next commit */
+		}
+	}
+}
+
+s__index_wal_t
+s__index_wal_open(const char *pathname, uint64_t record_size, uint64_t interval)
+{
+	struct s__index_wal *wal;
+
+	assert( s__strlen(pathname) );
+	assert( record_size && !(record_size % WORD) );
+
+	if (!(wal = s__malloc(sizeof (struct s__index_wal)))) {
+		S__TRACE(0);
+		return NULL;
+	}
+	memset(wal, 0, sizeof (struct s__index_wal));
+	wal->record_size = record_size;
+	wal->interval = interval;
+	if (!(wal->pathname = s__strdup(pathname)) ||
+	    !(wal->flushing = s__mutex_open()) ||
+	    !(wal->mutex = s__mutex_open()) ||
+	    !(wal->cond = s__cond_open(wal->mutex)) ||
+	    !(wal->wake = s__cond_open(wal->mutex))) {
+		s__index_wal_close(wal);
+		S__TRACE(0);
+		return NULL;
+	}
+	if (!(wal->file = fopen(pathname, "ab")) ||
+	    fseek(wal->file, 0, SEEK_END) ||
+	    (0 > (long)(wal->bytes = (uint64_t)ftell(wal->file)))) {
+		s__index_wal_close(wal);
+		S__TRACE(S__ERR_FILE_OPEN);
+		return NULL;
+	}
+	if (s__file_sync_dir(pathname)) { /* a new log must outlive a crash */
+		s__index_wal_close(wal);
+		S__TRACE(0);
+		return NULL;
+	}
+	if (interval && !(wal->thread = s__thread_open(_flusher_, wal))) {
+		s__index_wal_close(wal);
+		S__TRACE(0);
+		return NULL;
+	}
+	return wal;
+}
+
+void
+s__index_wal_close(s__index_wal_t wal)
+{
+	if (wal) {
+		if (wal->thread) {
+			s__mutex_lock(wal->mutex);
+			wal->stop = 1;
+			s__cond_signal(wal->wake);
+			s__mutex_unlock(wal->mutex);
+			s__thread_close(wal->thread);
+		}
+		if (wal->file) {
+			if (flush(wal)) {
+				S__TRACE(0);
+			}
+			fclose(wal->file);
+		}
+		s__cond_close(wal->wake);
+		s__cond_close(wal->cond);
+		s__mutex_close(wal->mutex);
+		s__mutex_close(wal->flushing);
+		S__FREE(wal->buffers[0].memory);
+		S__FREE(wal->buffers[1].memory);
+		S__FREE(wal->pathname);
+		memset(wal, 0, sizeof (struct s__index_wal));
+	}
+	S__FREE(wal);
+}
+
+int
+s__index_wal_append(s__index_wal_t wal,
+		    int op,
+		    const char *key,
+		    const uint64_t *record)
+{
+	struct buffer *buffer;
+	uint64_t n, size, word;
+	char *p;
+
+	assert( wal );
+	assert( (S__INDEX_WAL_PUT == op) || (S__INDEX_WAL_REMOVE == op) );
+	assert( s__strlen(key) );
+
+	n = s__strlen(key) + 1;
+	size = entry_size(wal->record_size, n);
+	s__mutex_lock(wal->mutex);
+	buffer = &wal->buffers[wal->active];
+	if (grow(buffer, size)) {
+		s__mutex_unlock(wal->mutex);
+		S__TRACE(0);
+		return -1;
+	}
+	p = buffer->memory + buffer->len;
+	word = ((uint64_t)op << 32) | n;
+	memcpy(p, &word, WORD);
+	p += WORD;
+	if (record) {
+		memcpy(p, record, (size_t)wal->record_size);
+	}
+	else {
+		memset(p, 0, (size_t)wal->record_size);
+	}
+	p += wal->record_size;
+	memset(p + n - 1, 0, (size_t)(size - WORD - wal->record_size - n + 1));
+	memcpy(p, key, (size_t)n);
+	if (!buffer->count) {
+		s__cond_signal(wal->wake); /* of an idle thread */
+	}
+	buffer->len += size;
+	buffer->count += 1;
+	wal->appended += 1;
+	n = buffer->len;
+	s__mutex_unlock(wal->mutex);
+	if (!wal->thread && (FLUSH <= n) && flush(wal)) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+int
+s__index_wal_commit(s__index_wal_t wal)
+{
+	uint64_t target;
+	int e;
+
+	assert( wal );
+
+	s__mutex_lock(wal->mutex);
+	target = wal->appended;
+	s__mutex_unlock(wal->mutex);
+	if (!wal->thread && flush(wal)) {
+		S__TRACE(0);
+		return -1;
+	}
+	s__mutex_lock(wal->mutex);
+	while (!wal->error && (wal->durable < target)) {
+		s__cond_wait(wal->cond);
+	}
+	e = wal->error;
+	s__mutex_unlock(wal->mutex);
+	if (e) {
+		S__TRACE(0);
+		return -1;
+	}
+	return 0;
+}
+
+int
+s__index_wal_reset(s__index_wal_t wal)
+{
+	FILE *file;
+
+	assert( wal );
+
+	if (s__index_wal_commit(wal)) {
+		S__TRACE(0);
+		return -1;
+	}
+	s__mutex_lock(wal->flushing);
+	file = fopen(wal->pathname, "wb");
+	if (!file || s__file_sync(file)) {
+		if (file) {
+			fclose(file);
+		}
+		s__mutex_unlock(wal->flushing);
+		S__TRACE(S__ERR_FILE_OPEN);
+		return -1;
+	}
+	fclose(wal->file);
+	wal->file = file;
+	s__mutex_lock(wal->mutex);
+	wal->bytes = 0;
+	s__mutex_unlock(wal->mutex);
+	s__mutex_unlock(wal->flushing);
+	return 0;
+}
+
+uint64_t
+s__index_wal_bytes(s__index_wal_t wal)
+{
+	uint64_t bytes;
+
+	assert( wal );
+
+	s__mutex_lock(wal->mutex);
+	bytes = wal->bytes;
+	bytes += wal->buffers[0].len;
+	bytes += wal->buffers[1].len;
+	s__mutex_unlock(wal->mutex);
+	return bytes;
+}
+
+static int
+check(const char *p, uint64_t bytes, uint64_t count, uint64_t record_size)
+{
+	uint64_t i, n, op, word;
+
+	for (i=0; i<count; ++i) {
+		if (WORD > bytes) {
+			return -1;
+		}
+		memcpy(&word, p, WORD);
+		op = word >> 32;
+		n = word & 0xffffffff;
+		if (((S__INDEX_WAL_PUT != op) && (S__INDEX_WAL_REMOVE != op)) ||
+		    (2 > n) ||
+		    (entry_size(record_size, n) > bytes) ||
+		    memchr(p + WORD + record_size, '\0', n - 1) ||
+		    p[WORD + record_size + n - 1]) {
+			return -1;
+		}
+		p += entry_size(record_size, n);
+		bytes -= entry_size(record_size, n);
+	}
+	return bytes ? -1 : 0;
+}
+
+static void
+_verify_(void *ctx)
+{
+	const struct batch *batch;
+	struct job *job;
+	const char *p;
+	uint64_t i;
+
+	job = (struct job *)ctx;
+	for (i=job->lo; i<job->hi; ++i) {
+		batch = (const struct batch *)(job->map + job->offsets[i]);
+		p = (const char *)(batch + 1);
+		if ((batch->checksum != s__hash(p, batch->bytes)) ||
+		    check(p, batch->bytes, batch->count, job->record_size)) {
+			break;
+		}
+	}
+	job->bad = i;
+}
+
+static int
+scan(const char *map,
+     uint64_t size,
+     uint64_t record_size,
+     uint64_t **offsets,
+     uint64_t *n)
+{
+	const struct batch *batch;
+	uint64_t p, capacity;
+	void *memory;
+
+	p = 0;
+	capacity = 0;
+	while (sizeof (struct batch) <= (size - p)) {
+		batch = (const struct batch *)(map + p);
+		if (memcmp(batch->magic, MAGIC, sizeof (batch->magic)) ||
+		    (batch->bytes % WORD) ||
+		    (batch->bytes > (size - p - sizeof (struct batch)))) {
+			break;
+		}
+		if (record_size != batch->record_size) {
+			S__TRACE(S__ERR_ARGUMENT); /* log of another index */
+			return -1;
+		}
+		if ((*n) == capacity) {
+			capacity = S__MAX(2 * capacity, 64);
+			memory = s__realloc((*offsets),
+					    capacity * sizeof ((*offsets)[0]));
+			if (!memory) {
+				S__TRACE(0);
+				return -1;
+			}
+			(*offsets) = (uint64_t *)memory;
+		}
+		(*offsets)[(*n)++] = p;
+		p += sizeof (struct batch) + batch->bytes;
+	}
+	return 0;
+}
+
+static uint64_t
+verify(const char *map,
+       const uint64_t *offsets,
+       uint64_t n,
+       uint64_t record_size)
+{
+	s__thread_t threads[WORKERS];
+	struct job jobs[WORKERS];
+	uint64_t i, k, bad;
+
+	k = S__MIN(S__MIN(s__cores(), WORKERS), n);
+	memset(threads, 0, sizeof (threads));
+	memset(jobs, 0, sizeof (jobs));
+	for (i=0; i<k; ++i) {
+		jobs[i].map = map;
+		jobs[i].offsets = offsets;
+		jobs[i].record_size = record_size;
+		jobs[i].lo = n * i / k;
+		jobs[i].hi = n * (i + 1) / k;
+		if (!i || !(threads[i] = s__thread_open(_verify_, &jobs[i]))) {
+			_verify_(&jobs[i]);
+		}
+	}
+	bad = n;
+	for (i=0; i<k; ++i) {
+		s__thread_close(threads[i]);
+		if (jobs[i].bad < jobs[i].hi) {
+			bad = S__MIN(bad, jobs[i].bad);
+		}
+	}
+	return bad;
+}
+
+int
+s__index_wal_replay(const char *pathname,
+		    uint64_t record_size,
+		    s__index_wal_fnc_t fnc,
+		    void *ctx)
+{
+	const struct batch *batch;
+	uint64_t i, j, n, size, word, *offsets;
+	const char *p;
+	FILE *file;
+	char *map;
+	int e;
+
+	assert( s__strlen(pathname) );
+	assert( record_size && !(record_size % WORD) );
+	assert( fnc );
+
+	if (!(file = fopen(pathname, "rb"))) {
+		return 0; /* no log */
+	}
+	e = fseek(file, 0, SEEK_END) ? -1 : (0 < ftell(file));
+	fclose(file);
+	if (0 >= e) {
+		if (e) {
+			S__TRACE(S__ERR_FILE_READ);
+			return -1;
+		}
+		return 0;
+	}
+	if (!(map = s__file_map(pathname, &size))) {
+		S__TRACE(0);
+		return -1;
+	}
+	n = 0;
+	offsets = NULL;
+	if (scan(map, size, record_size, &offsets, &n)) {
+		s__file_unmap(map, size);
+		S__FREE(offsets);
+		S__TRACE(0);
+		return -1;
+	}
+	n = verify(map, offsets, n, record_size);
+	e = 0;
+	for (i=0; !e && (i<n); ++i) {
+		batch = (const struct batch *)(map + offsets[i]);
+		p = (const char *)(batch + 1);
+		for (j=0; j<batch->count; ++j) {
+			memcpy(&word, p, WORD);
+			if (fnc(ctx,
+				(int)(word >> 32),
+				p + WORD + record_size,
+				(const uint64_t *)(p + WORD))) {
+				S__TRACE(0);
+				e = -1;
+				break;
+			}
+			p += entry_size(record_size, word & 0xffffffff);
+		}
+	}
+	s__file_unmap(map, size);
+	S__FREE(offsets);
+	return e;
+}
@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) Tony Givargis, 2020-2025
+ *
+ * s_index_wal.h
+ */
+
+#ifndef _S_INDEX_WAL_H_
+#define _S_INDEX_WAL_H_
+
+#include "../utils/s_utils.h"
+
+#define S__INDEX_WAL_PUT 0
+#define S__INDEX_WAL_REMOVE 1
+
+typedef struct s__index_wal *s__index_wal_t;
+
+typedef int (*s__index_wal_fnc_t)(void *ctx,
+				  int op,
+				  const char *key,
+				  const uint64_t *record);
+
+s__index_wal_t s__index_wal_open(const char *pathname,
+				 uint64_t record_size,
+				 uint64_t interval);
+
+void s__index_wal_close(s__index_wal_t wal);
+
+int s__index_wal_append(s__index_wal_t wal,
+			int op,
+			const char *key,
+			const uint64_t *record);
+
+int s__index_wal_commit(s__index_wal_t wal);
+
+int s__index_wal_reset(s__index_wal_t wal);
+
+uint64_t s__index_wal_bytes(s__index_wal_t wal);
+
+int s__index_wal_replay(const char *pathname,
+			uint64_t record_size,
+			s__index_wal_fnc_t fnc,
+			void *ctx);
+
+#endif /* _S_INDEX_WAL_H_ */
@@ -7,6 +7,7 @@
 #define _GNU_SOURCE
 
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "s_spinlock.h"
@@ -180,6 +181,19 @@ s__time(void)
 	return (uint64_t)timeval.tv_sec * 1000000 + (uint64_t)timeval.tv_usec;
 }
 
+uint64_t
+s__time_ns(void)
+{
+	struct timespec timespec;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &timespec)) {
+		S__HALT(S__ERR_SYSTEM);
+		return 0;
+	}
+	return (uint64_t)timespec.tv_sec * 1000000000 +
+		(uint64_t)timespec.tv_nsec;
+}
+
 uint64_t
 s__cores(void)
 {
@@ -105,6 +105,8 @@ char *s__strdup(const char *s);
 
 uint64_t s__time(void);
 
+uint64_t s__time_ns(void); /* monotonic */
+
 uint64_t s__cores(void);
 
 int s__endian(void); /* 0 -> little, 1 -> big */
@@ -123,12 +125,42 @@ s__popcount(uint64_t x)
 	return __builtin_popcountll(x);
 }
 
+S__INLINE uint64_t
+s__ctz(uint64_t x)
+{
+	return __builtin_ctzll(x);
+}
+
+S__INLINE uint64_t
+s__bswap(uint64_t x)
+{
+	return __builtin_bswap64(x);
+}
+
+S__INLINE void
+s__prefetch(const void *p)
+{
+	__builtin_prefetch(p);
+}
+
 S__INLINE void
 s__atomic_add(volatile uint64_t *a, int64_t b)
 {
 	__sync_add_and_fetch(a, b);
 }
 
+S__INLINE void
+s__fence_acquire(void)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+S__INLINE void
+s__fence_release(void)
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
 S__INLINE void *
 s__align(void *p, uint64_t n)
 {
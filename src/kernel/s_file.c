@@ -4,6 +4,14 @@
  * s_file.c
  */
 
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
 #include "s_file.h"
 
 const char *
@@ -66,3 +74,118 @@ s__file_write(const char *pathname, const char *content)
 	fclose(file);
 	return 0;
 }
+
+void *
+s__file_map(const char *pathname, uint64_t *size)
+{
+	struct stat stat_;
+	void *map;
+	int fd;
+
+	assert( s__strlen(pathname) );
+	assert( size );
+
+	if (0 > (fd = open(pathname, O_RDONLY))) {
+		S__TRACE(S__ERR_FILE_OPEN);
+		return NULL;
+	}
+	if (fstat(fd, &stat_) || (0 >= stat_.st_size)) {
+		close(fd);
+		S__TRACE(S__ERR_FILE_READ);
+		return NULL;
+	}
+	map = mmap(NULL,
+		   (size_t)stat_.st_size,
+		   PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE,
+		   fd,
+		   0);
+	close(fd);
+	if (MAP_FAILED == map) {
+		S__TRACE(S__ERR_FILE_READ);
+		return NULL;
+	}
+	(*size) = (uint64_t)stat_.st_size;
+	return map;
+}
+
+int
+s__file_sync(FILE *file)
+{
+	assert( file );
+
+	if (fflush(file) || fsync(fileno(file))) {
+		S__TRACE(S__ERR_FILE_WRITE);
+		return -1;
+	}
+	return 0;
+}
+
+int
+s__file_write_aligned(FILE *file, const void *buf, uint64_t n, uint64_t align)
+{
+	static const char ZERO[64];
+	uint64_t pad, k;
+
+	assert( file );
+	assert( align );
+
+	pad = S__DUP(n, align) * align - n;
+	if (n && (1 != fwrite(buf, (size_t)n, 1, file))) {
+		S__TRACE(S__ERR_FILE_WRITE);
+		return -1;
+	}
+	while (pad) {
+		k = S__MIN(pad, sizeof (ZERO));
+		if (1 != fwrite(ZERO, (size_t)k, 1, file)) {
+			S__TRACE(S__ERR_FILE_WRITE);
+			return -1;
+		}
+		pad -= k;
+	}
+	return 0;
+}
+
+int
+s__file_sync_dir(const char *pathname)
+{
+	char *dirname, *slash;
+	int fd;
+
+	assert( s__strlen(pathname) );
+
+	if (!(dirname = s__strdup(pathname))) {
+		S__TRACE(0);
+		return -1;
+	}
+	if ((slash = strrchr(dirname, '/'))) {
+		slash[slash == dirname] = '\0';
+	}
+	else {
+		dirname[0] = '.';
+		dirname[1] = '\0';
+	}
+	if (0 > (fd = open(dirname, O_RDONLY))) {
+		S__FREE(dirname);
+		S__TRACE(S__ERR_FILE_OPEN);
+		return -1;
+	}
+	S__FREE(dirname);
+	if (fsync(fd)) {
+		close(fd);
+		S__TRACE(S__ERR_FILE_WRITE);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+void
+s__file_unmap(void *map, uint64_t size)
+{
+	if (map) {
+		if (munmap(map, (size_t)size)) {
+			S__HALT(S__ERR_SYSTEM);
+		}
+	}
+}
@@ -13,4 +13,17 @@ const char *s__file_read(const char *pathname);
 
 int s__file_write(const char *pathname, const char *content);
 
+void *s__file_map(const char *pathname, uint64_t *size);
+
+void s__file_unmap(void *map, uint64_t size);
+
+int s__file_write_aligned(FILE *file,
+			  const void *buf,
+			  uint64_t n,
+			  uint64_t align);
+
+int s__file_sync(FILE *file);
+
+int s__file_sync_dir(const char *pathname);
+
 #endif /* _S_FILE_H_ */
@@ -9,6 +9,8 @@
 
 #define VERSION 100
 
+#define UL(x) ( (unsigned long)(x) )
+
 static void
 print(const struct s__lang_node *node)
 {
@@ -63,6 +65,116 @@ stage(void)
 	return 0;
 }
 
+static void
+part(const char *name, const struct s__index_stats_part *part_)
+{
+	printf("%-8s %12lu %12lu %12lu %12lu %9.2f %9lu\n",
+	       name,
+	       UL(part_->used),
+	       UL(part_->allocated),
+	       UL(part_->nodes),
+	       UL(part_->keys),
+	       part_->avg_depth,
+	       UL(part_->max_depth));
+}
+
+static int
+stats(const char *pathname)
+{
+	struct s__index_stats stats_;
+	s__index_t index;
+	int i;
+
+	if (!(index = s__index_mmap(pathname))) {
+		S__TRACE(0);
+		return -1;
+	}
+	if (s__index_stats(index, &stats_)) {
+		s__index_close(index);
+		S__TRACE(0);
+		return -1;
+	}
+	s__index_close(index);
+	printf("%-8s %12s %12s %12s %12s %9s %9s\n",
+	       "",
+	       "used",
+	       "allocated",
+	       "nodes",
+	       "keys",
+	       "avg-depth",
+	       "max-depth");
+	part("tree", &stats_.tree);
+	part("succinct", &stats_.succinct);
+	printf("\n"
+	       "items         %lu\n"
+	       "used          %lu\n"
+	       "allocated     %lu\n"
+	       "bytes/key     %.2f\n"
+	       "avg-depth     %.2f\n"
+	       "max-depth     %lu\n"
+	       "\n"
+	       "key length   keys\n",
+	       UL(stats_.items),
+	       UL(stats_.used),
+	       UL(stats_.allocated),
+	       stats_.bytes_per_key,
+	       stats_.avg_depth,
+	       UL(stats_.max_depth));
+	for (i=0; i<S__INDEX_STATS_LENS; ++i) {
+		if (stats_.lens[i]) {
+			printf("%5lu-%-6lu %lu\n",
+			       UL(1) << i,
+			       ((S__INDEX_STATS_LENS - 1) == i) ?
+			       UL(S__INDEX_MAX_KEY_LEN - 1) :
+			       (UL(2) << i) - 1,
+			       UL(stats_.lens[i]));
+		}
+	}
+	return 0;
+}
+
+static int
+number(const char *s, uint64_t *n)
+{
+	char *end;
+
+	(*n) = (uint64_t)strtoul(s, &end, 10);
+	return (!s[0] || end[0]) ? -1 : 0;
+}
+
+static int
+tree(const char *s, struct s__index_bench *bench)
+{
+	if (!strcmp(s, "avl")) {
+		bench->open = s__index_open;
+	}
+	else if (!strcmp(s, "art")) {
+		bench->open = s__index_open_art;
+	}
+	else if (!strcmp(s, "coded")) {
+		bench->open = s__index_open_coded;
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+static int
+lengths(const char *s, struct s__index_bench *bench)
+{
+	if (!strcmp(s, "uniform")) {
+		bench->zipf = 0;
+	}
+	else if (!strcmp(s, "zipf")) {
+		bench->zipf = 1;
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
 static void
 help(void)
 {
@@ -70,22 +182,47 @@ help(void)
 	       "Usage: stingray [options]\n"
 	       "\n"
 	       "Options:\n"
-	       "\t --help    Print the help menu and exit\n"
-	       "\t --version Print the version string and exit\n"
-	       "\t --bist    Run the built-in-test mode and exit\n"
-	       "\t --notrace Do not print error traces\n"
-	       "\t --nocolor Do not use terminal colors\n"
+	       "\t --help     Print the help menu and exit\n"
+	       "\t --version  Print the version string and exit\n"
+	       "\t --bist     Run the built-in-test mode and exit\n"
+	       "\t --stats    Print the statistics of an index file and exit\n"
+	       "\t --notrace  Do not print error traces\n"
+	       "\t --nocolor  Do not use terminal colors\n"
+	       "\n");
+	printf("Benchmark options:\n"
+	       "\t --bench    Run the index benchmark, print JSON and exit\n"
+	       "\t --keys     Key count (1000000)\n"
+	       "\t --min-len  Minimum key length (8)\n"
+	       "\t --max-len  Maximum key length (32)\n"
+	       "\t --lengths  Key lengths: uniform or zipf (uniform)\n");
+	printf("\t --prefix   Key prefix shared by all keys (0)\n"
+	       "\t --threads  Lookup threads (cores)\n"
+	       "\t --tree     Tree: avl, art or coded (avl)\n"
+	       "\t --filter   Filter bits per key, 0 for none (0)\n"
+	       "\t --collapse Collapse chains when compressed\n"
+	       "\t --log      Log inserts to a new file, then delete it\n"
 	       "\n");
 }
 
 int
 main(int argc, char *argv[])
 {
+	struct s__index_bench bench_;
+	const char *pathname = NULL;
+	uint64_t threads = 0;
 	int notrace = 0;
 	int nocolor = 0;
+	int bench = 0;
 	int bist = 0;
 	int i;
 
+	memset(&bench_, 0, sizeof (struct s__index_bench));
+	bench_.open = s__index_open;
+	bench_.keys = 1000000;
+	bench_.min_len = 8;
+	bench_.max_len = 32;
+	bench_.seed = 1;
+
 	for (i=1; i<argc; ++i) {
 		if (!strcmp(argv[i], "--help") && (2 == argc)) {
 			help();
@@ -107,6 +244,55 @@ main(int argc, char *argv[])
 		else if (!strcmp(argv[i], "--bist")) {
 			bist = 1;
 		}
+		else if (!strcmp(argv[i], "--stats") && ((i + 1) < argc)) {
+			pathname = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--bench")) {
+			bench = 1;
+		}
+		else if (!strcmp(argv[i], "--keys") && ((i + 1) < argc) &&
+			 !number(argv[i + 1], &bench_.keys) && bench_.keys) {
+			++i;
+		}
+		else if (!strcmp(argv[i], "--min-len") && ((i + 1) < argc) &&
+			 !number(argv[i + 1], &bench_.min_len) &&
+			 bench_.min_len) {
+			++i;
+		}
+		else if (!strcmp(argv[i], "--max-len") && ((i + 1) < argc) &&
+			 !number(argv[i + 1], &bench_.max_len) &&
+			 (S__INDEX_MAX_KEY_LEN > bench_.max_len)) {
+			++i;
+		}
+		else if (!strcmp(argv[i], "--lengths") && ((i + 1) < argc) &&
+			 !lengths(argv[i + 1], &bench_)) {
+			++i;
+		}
+		else if (!strcmp(argv[i], "--prefix") && ((i + 1) < argc) &&
+			 !number(argv[i + 1], &bench_.prefix) &&
+			 (64 > bench_.prefix)) {
+			++i;
+		}
+		else if (!strcmp(argv[i], "--threads") && ((i + 1) < argc) &&
+			 !number(argv[i + 1], &threads) &&
+			 threads && (256 >= threads)) {
+			++i;
+		}
+		else if (!strcmp(argv[i], "--collapse")) {
+			bench_.collapse = 1;
+		}
+		else if (!strcmp(argv[i], "--filter") && ((i + 1) < argc) &&
+			 !number(argv[i + 1], &bench_.filter) &&
+			 (S__INDEX_MAX_FILTER_BITS >= bench_.filter)) {
+			++i;
+		}
+		else if (!strcmp(argv[i], "--log") && ((i + 1) < argc)) {
+			bench_.log = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--tree") && ((i + 1) < argc) &&
+			 !tree(argv[i + 1], &bench_)) {
+			++i;
+		}
 		else {
 			fprintf(stderr, "bad argument: '%s'\n", argv[i]);
 			return -1;
@@ -121,5 +307,25 @@ main(int argc, char *argv[])
 		}
 		return 0;
 	}
+	if (bench) {
+		if (bench_.min_len > bench_.max_len) {
+			fprintf(stderr, "bad argument: '--min-len'\n");
+			return -1;
+		}
+		bench_.threads = (int)(threads ? threads : s__cores());
+		bench_.threads = S__MIN(bench_.threads, 256);
+		if (s__index_bench(&bench_, stdout)) {
+			S__TRACE(0);
+			return -1;
+		}
+		return 0;
+	}
+	if (pathname) {
+		if (stats(pathname)) {
+			S__TRACE(0);
+			return -1;
+		}
+		return 0;
+	}
 	return stage();
 }